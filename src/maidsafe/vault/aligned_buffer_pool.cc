@@ -0,0 +1,129 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/aligned_buffer_pool.h"
+
+#include <algorithm>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+byte* AllocateAligned(std::size_t size) {
+#ifdef _WIN32
+  void* data(_aligned_malloc(size, AlignedBufferPool::kAlignment));
+#else
+  void* data(nullptr);
+  if (posix_memalign(&data, AlignedBufferPool::kAlignment, size) != 0)
+    data = nullptr;
+#endif
+  if (!data)
+    throw std::bad_alloc();
+  return static_cast<byte*>(data);
+}
+
+void FreeAligned(byte* data) {
+#ifdef _WIN32
+  _aligned_free(data);
+#else
+  free(data);
+#endif
+}
+
+}  // unnamed namespace
+
+const std::size_t AlignedBufferPool::kAlignment;
+
+AlignedBufferPool::Buffer::Buffer(AlignedBufferPool* pool, byte* data, std::size_t capacity)
+    : pool_(pool), data_(data), capacity_(capacity) {}
+
+AlignedBufferPool::Buffer::Buffer(Buffer&& other)
+    : pool_(other.pool_), data_(other.data_), capacity_(other.capacity_) {
+  other.data_ = nullptr;
+}
+
+AlignedBufferPool::Buffer::~Buffer() {
+  if (data_)
+    pool_->Release(data_, capacity_);
+}
+
+AlignedBufferPool::AlignedBufferPool(std::size_t max_pooled)
+    : kMaxPooled_(max_pooled), mutex_(), pooled_() {}
+
+AlignedBufferPool::~AlignedBufferPool() {
+  for (const auto& block : pooled_)
+    FreeAligned(block.data);
+}
+
+AlignedBufferPool::Buffer AlignedBufferPool::Acquire(std::size_t size) {
+  std::size_t capacity(kAlignment);
+  while (capacity < size)
+    capacity *= 2;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto best(pooled_.end());
+    for (auto itr(pooled_.begin()); itr != pooled_.end(); ++itr) {
+      if (itr->capacity >= capacity && (best == pooled_.end() || itr->capacity < best->capacity))
+        best = itr;
+    }
+    if (best != pooled_.end()) {
+      Block block(*best);
+      pooled_.erase(best);
+      return Buffer(this, block.data, block.capacity);
+    }
+  }
+  return Buffer(this, AllocateAligned(capacity), capacity);
+}
+
+std::size_t AlignedBufferPool::PooledCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pooled_.size();
+}
+
+void AlignedBufferPool::Release(byte* data, std::size_t capacity) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pooled_.size() < kMaxPooled_) {
+      pooled_.push_back(Block{data, capacity});
+      return;
+    }
+    // The pool is full, so the smallest buffer, being the least useful to keep, is freed.
+    auto smallest(std::min_element(pooled_.begin(), pooled_.end(),
+                                   [](const Block& lhs, const Block& rhs) {
+                                     return lhs.capacity < rhs.capacity;
+                                   }));
+    if (smallest != pooled_.end() && smallest->capacity < capacity) {
+      std::swap(data, smallest->data);
+      smallest->capacity = capacity;
+    }
+  }
+  FreeAligned(data);
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
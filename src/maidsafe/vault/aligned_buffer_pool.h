@@ -0,0 +1,91 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_ALIGNED_BUFFER_POOL_H_
+#define MAIDSAFE_VAULT_ALIGNED_BUFFER_POOL_H_
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "maidsafe/common/types.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Hands out memory aligned for direct I/O, keeping up to 'max_pooled' released buffers for reuse
+// so that large transfers neither allocate nor fault in fresh pages each time.  Capacities are
+// rounded up to a power of two of at least kAlignment bytes, which is also a multiple of the
+// logical block size of common devices.  Acquire may be called concurrently; every Buffer must be
+// destroyed before the pool.
+class AlignedBufferPool {
+ public:
+  static const std::size_t kAlignment = 4096;
+
+  class Buffer {
+   public:
+    Buffer(Buffer&& other);
+    ~Buffer();
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+    Buffer& operator=(Buffer&&) = delete;
+
+    byte* data() const { return data_; }
+    std::size_t capacity() const { return capacity_; }
+
+   private:
+    friend class AlignedBufferPool;
+    Buffer(AlignedBufferPool* pool, byte* data, std::size_t capacity);
+
+    AlignedBufferPool* pool_;
+    byte* data_;
+    std::size_t capacity_;
+  };
+
+  explicit AlignedBufferPool(std::size_t max_pooled);
+  ~AlignedBufferPool();
+  AlignedBufferPool(const AlignedBufferPool&) = delete;
+  AlignedBufferPool(AlignedBufferPool&&) = delete;
+  AlignedBufferPool& operator=(const AlignedBufferPool&) = delete;
+  AlignedBufferPool& operator=(AlignedBufferPool&&) = delete;
+
+  // Returns a buffer of at least 'size' bytes, reusing the smallest pooled one large enough.
+  // Throws std::bad_alloc if a new buffer is needed and can't be allocated.
+  Buffer Acquire(std::size_t size);
+  // The number of released buffers currently held for reuse.
+  std::size_t PooledCount() const;
+
+ private:
+  struct Block {
+    byte* data;
+    std::size_t capacity;
+  };
+
+  void Release(byte* data, std::size_t capacity);
+
+  const std::size_t kMaxPooled_;
+  mutable std::mutex mutex_;
+  std::vector<Block> pooled_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_ALIGNED_BUFFER_POOL_H_
@@ -0,0 +1,385 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+// Throughput and latency of the storage paths behind a PmidNode.  Results can be written as JSON
+// and compared between builds with Google Benchmark's own tools, e.g.
+//
+//   bench_vault_chunk_store --benchmark_out=before.json --benchmark_out_format=json
+//   compare.py benchmarks before.json after.json
+//
+// Arguments are chunk size in bytes, engine (0 for kFilePerChunk, 1 for kPackFile, 2 for kMemory)
+// and, where named, whether the page cache is dropped before reads ("cold").  The stores for the
+// Names and Startup benchmarks are populated once per process, which takes a long time at 10M
+// chunks; use --benchmark_filter to select the sizes of interest.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "benchmark/benchmark.h"
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/chunk_store.h"
+#include "maidsafe/vault/chunk_store_engine.h"
+#include "maidsafe/vault/pmid_node/chunk_cache.h"
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+using NameType = ChunkStore::NameType;
+using Chunks = std::vector<std::pair<NameType, NonEmptyString>>;
+
+const std::int64_t kOneKB(1024);
+// Large enough that no benchmark is limited by the store's quota.
+const DiskUsage kUnlimited(std::numeric_limits<std::uint64_t>::max() / 2);
+// Chunks are generated and stored in batches of this many.
+const std::uint32_t kBatchSize(1000);
+// Size of the PmidNode's default chunk cache.
+const MemoryUsage kCacheCapacity(64 * 1024 * 1024);
+#if defined(__linux__)
+const bool kCanDropPageCache(true);
+#else
+const bool kCanDropPageCache(false);
+#endif
+
+ChunkStore::Engine EngineArg(std::int64_t arg) { return static_cast<ChunkStore::Engine>(arg); }
+
+// Engines as benchmark arguments.  The in-memory engine has no page cache to drop and nothing to
+// restart from, so is left out of the cold read and startup benchmarks.
+const std::vector<std::int64_t> kAllEngines{0, 1, 2}, kDiskEngines{0, 1};
+
+// Number of chunks of 'size' bytes which each thread puts, gets or deletes before it does untimed
+// housekeeping (deleting what it has put, replacing what it has deleted, or dropping the page
+// cache).  Keeps each round to around 16 MB, and short enough that housekeeping doesn't dominate
+// the run time for small chunks.
+std::uint32_t RoundSize(std::int64_t size) {
+  return static_cast<std::uint32_t>(
+      std::min<std::int64_t>(4096, std::max<std::int64_t>(16, 16 * 1024 * kOneKB / size)));
+}
+
+std::vector<NameType> Names(const Chunks& chunks) {
+  std::vector<NameType> names;
+  for (const auto& chunk : chunks)
+    names.push_back(chunk.first);
+  return names;
+}
+
+// Drops the files under 'root' from the page cache, so that the next reads go to the device.
+void DropPageCache(const fs::path& root) {
+#if defined(__linux__)
+  for (fs::recursive_directory_iterator itr(root), end; itr != end; ++itr) {
+    if (!fs::is_regular_file(itr->status()))
+      continue;
+    int fd(open(itr->path().c_str(), O_RDONLY));
+    if (fd < 0)
+      continue;
+    // Dirty pages aren't dropped.
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#else
+  static_cast<void>(root);
+#endif
+}
+
+// Times operations on one thread, and reports their latency percentiles as counters averaged
+// over the benchmark's threads.
+class Latencies {
+ public:
+  template <typename Operation>
+  void Time(const Operation& operation) {
+    auto start(std::chrono::steady_clock::now());
+    operation();
+    samples_.push_back(
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start)
+            .count());
+  }
+
+  void Report(benchmark::State& state) {
+    if (samples_.empty())
+      return;
+    std::sort(samples_.begin(), samples_.end());
+    auto percentile([&](double fraction) {
+      auto index(static_cast<std::size_t>(fraction * (samples_.size() - 1)));
+      return benchmark::Counter(samples_[index], benchmark::Counter::kAvgThreads);
+    });
+    state.counters["p50_us"] = percentile(0.5);
+    state.counters["p99_us"] = percentile(0.99);
+    state.counters["p999_us"] = percentile(0.999);
+  }
+
+ private:
+  std::vector<double> samples_;
+};
+
+// A store holding 'count' chunks of 'size' bytes, shared by all threads and runs of the
+// benchmarks using it, and kept until the process exits.
+struct Population {
+  Population(ChunkStore::Engine engine_in, std::uint64_t count, std::int64_t size,
+             bool keep_names)
+      : path(maidsafe::test::CreateTestPath("MaidSafe_Bench_ChunkStore")),
+        engine(engine_in),
+        store(new ChunkStore(*path, kUnlimited, engine)),
+        names(),
+        cache(kCacheCapacity) {
+    Chunks batch;
+    for (std::uint64_t added(0); added < count; added += batch.size()) {
+      batch.clear();
+      test::AddRandomNameValuePairs(
+          batch, static_cast<std::uint32_t>(std::min<std::uint64_t>(kBatchSize, count - added)),
+          static_cast<std::uint32_t>(size));
+      store->PutMany(batch);
+      if (keep_names) {
+        for (const auto& chunk : batch)
+          names.push_back(chunk.first);
+      }
+    }
+  }
+
+  maidsafe::test::TestPath path;
+  ChunkStore::Engine engine;
+  std::unique_ptr<ChunkStore> store;
+  std::vector<NameType> names;
+  ChunkCache cache;
+};
+
+Population& GetPopulation(ChunkStore::Engine engine, std::uint64_t count, std::int64_t size,
+                          bool keep_names = true) {
+  static std::mutex mutex;
+  static std::map<std::tuple<ChunkStore::Engine, std::uint64_t, std::int64_t>,
+                  std::unique_ptr<Population>> populations;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& population(populations[std::make_tuple(engine, count, size)]);
+  if (!population)
+    population.reset(new Population(engine, count, size, keep_names));
+  return *population;
+}
+
+void BM_Put(benchmark::State& state) {
+  const std::int64_t size(state.range(0));
+  ChunkStore& store(*GetPopulation(EngineArg(state.range(1)), 0, size).store);
+  Chunks chunks;
+  test::AddRandomNameValuePairs(chunks, RoundSize(size), static_cast<std::uint32_t>(size));
+  Latencies latencies;
+  std::size_t next(0);
+  while (state.KeepRunning()) {
+    if (next == chunks.size()) {
+      state.PauseTiming();
+      store.DeleteMany(Names(chunks));
+      next = 0;
+      state.ResumeTiming();
+    }
+    latencies.Time([&] { store.Put(chunks[next].first, chunks[next].second); });
+    ++next;
+  }
+  store.DeleteMany(Names(Chunks(chunks.begin(), chunks.begin() + next)));
+  state.SetBytesProcessed(state.iterations() * size);
+  latencies.Report(state);
+}
+
+void BM_Get(benchmark::State& state) {
+  const std::int64_t size(state.range(0));
+  const bool cold(state.range(2) != 0);
+  Population& population(GetPopulation(EngineArg(state.range(1)), RoundSize(size), size));
+  if (cold && !kCanDropPageCache)
+    state.SkipWithError("Dropping the page cache isn't supported on this platform");
+  std::vector<byte> value;
+  Latencies latencies;
+  // Threads start at different chunks, and each reads through all of them between drops.
+  std::size_t start(RandomUint32() % population.names.size()), read(0);
+  while (state.KeepRunning()) {
+    if (cold && read % population.names.size() == 0) {
+      state.PauseTiming();
+      DropPageCache(*population.path);
+      state.ResumeTiming();
+    }
+    const auto& name(population.names[(start + read++) % population.names.size()]);
+    latencies.Time([&] { population.store->Get(name, value); });
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  latencies.Report(state);
+}
+
+void BM_Delete(benchmark::State& state) {
+  const std::int64_t size(state.range(0));
+  ChunkStore& store(*GetPopulation(EngineArg(state.range(1)), 0, size).store);
+  Chunks chunks;
+  test::AddRandomNameValuePairs(chunks, RoundSize(size), static_cast<std::uint32_t>(size));
+  Latencies latencies;
+  std::size_t next(chunks.size());
+  while (state.KeepRunning()) {
+    if (next == chunks.size()) {
+      state.PauseTiming();
+      store.PutMany(chunks);
+      next = 0;
+      state.ResumeTiming();
+    }
+    latencies.Time([&] { store.Delete(chunks[next].first); });
+    ++next;
+  }
+  store.DeleteMany(Names(Chunks(chunks.begin() + next, chunks.end())));
+  state.SetItemsProcessed(state.iterations());
+  latencies.Report(state);
+}
+
+// The read path of PmidNode::HandleGet: the chunk cache in front of the store.  The chunks read
+// either all fit in the cache and are read into it before timing starts ("hits"), or are read in
+// turn from a set four times its capacity.
+void BM_PmidNodeGet(benchmark::State& state) {
+  const std::int64_t size(state.range(0));
+  const bool hits(state.range(2) != 0);
+  const std::int64_t capacity(static_cast<std::int64_t>(kCacheCapacity));
+  const std::int64_t working_set(hits ? capacity / 4 : capacity * 4);
+  Population& population(GetPopulation(EngineArg(state.range(1)),
+                                       std::max<std::int64_t>(1, working_set / size), size));
+  auto get([&](const NameType& name, std::vector<byte>& value) {
+    if (!population.cache.Get(name, value)) {
+      auto token(population.cache.InsertToken());
+      population.store->Get(name, value);
+      population.cache.Insert(name, value, token);
+    }
+  });
+  std::vector<byte> value;
+  if (hits) {
+    for (const auto& name : population.names)
+      get(name, value);
+  }
+  Latencies latencies;
+  std::size_t start(RandomUint32() % population.names.size()), read(0);
+  while (state.KeepRunning()) {
+    const auto& name(population.names[(start + read++) % population.names.size()]);
+    latencies.Time([&] { get(name, value); });
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  latencies.Report(state);
+}
+
+void BM_Names(benchmark::State& state) {
+  const std::uint64_t count(static_cast<std::uint64_t>(state.range(0)));
+  Population& population(GetPopulation(EngineArg(state.range(1)), count, 64, false));
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(population.store->Names());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// Opening a store, either from its index snapshot or ("rebuild") by scanning the engine.
+void BM_Startup(benchmark::State& state) {
+  const std::uint64_t count(static_cast<std::uint64_t>(state.range(0)));
+  const bool rebuild(state.range(2) != 0);
+  Population& population(GetPopulation(EngineArg(state.range(1)), count, 64, false));
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    population.store.reset();
+    if (rebuild) {
+      boost::system::error_code error_code;
+      fs::remove_all(ChunkStoreEngine::MetadataDirectory(*population.path), error_code);
+    }
+    state.ResumeTiming();
+    population.store.reset(new ChunkStore(*population.path, kUnlimited, population.engine));
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+void SizesAndEngines(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgNames({"size", "engine"});
+  for (std::int64_t engine : kAllEngines) {
+    for (std::int64_t size(kOneKB); size <= 1024 * kOneKB; size *= 4)
+      benchmark->Args({size, engine});
+  }
+}
+
+void SizesEnginesAndCold(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgNames({"size", "engine", "cold"});
+  for (std::int64_t engine : kAllEngines) {
+    for (std::int64_t size(kOneKB); size <= 1024 * kOneKB; size *= 4) {
+      for (std::int64_t cold : {0, 1}) {
+        if (cold == 0 || EngineArg(engine) != ChunkStore::Engine::kMemory)
+          benchmark->Args({size, engine, cold});
+      }
+    }
+  }
+}
+
+void SizesEnginesAndHits(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgNames({"size", "engine", "hits"});
+  for (std::int64_t engine : kAllEngines) {
+    for (std::int64_t size(kOneKB); size <= 1024 * kOneKB; size *= 4) {
+      for (std::int64_t hits : {0, 1})
+        benchmark->Args({size, engine, hits});
+    }
+  }
+}
+
+void CountsAndEngines(benchmark::internal::Benchmark* benchmark, bool with_rebuild) {
+  if (with_rebuild)
+    benchmark->ArgNames({"chunks", "engine", "rebuild"});
+  else
+    benchmark->ArgNames({"chunks", "engine"});
+  for (std::int64_t engine : with_rebuild ? kDiskEngines : kAllEngines) {
+    for (std::int64_t count(10000); count <= 10000000; count *= 10) {
+      if (!with_rebuild) {
+        benchmark->Args({count, engine});
+        continue;
+      }
+      for (std::int64_t rebuild : {0, 1})
+        benchmark->Args({count, engine, rebuild});
+    }
+  }
+}
+
+BENCHMARK(BM_Put)->Apply(SizesAndEngines)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_Get)->Apply(SizesEnginesAndCold)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_Delete)->Apply(SizesAndEngines)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_PmidNodeGet)->Apply(SizesEnginesAndHits)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_Names)
+    ->Apply([](benchmark::internal::Benchmark* benchmark) { CountsAndEngines(benchmark, false); })
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Startup)
+    ->Apply([](benchmark::internal::Benchmark* benchmark) { CountsAndEngines(benchmark, true); })
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // unnamed namespace
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+BENCHMARK_MAIN();
@@ -0,0 +1,69 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/bloom_filter.h"
+
+#include <algorithm>
+
+#include "maidsafe/vault/chunk_store_utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+const std::uint64_t BloomFilter::kMinCapacity;
+const unsigned BloomFilter::kProbeCount;
+const std::uint64_t BloomFilter::kBitsPerName;
+
+BloomFilter::BloomFilter(std::uint64_t capacity)
+    : kCapacity_(std::max(capacity, kMinCapacity)),
+      kBitCount_(kCapacity_ * kBitsPerName),
+      words_((kBitCount_ + 63) / 64),
+      added_(0) {}
+
+void BloomFilter::Add(const NameType& hashed_name) {
+  auto probes(Probes(hashed_name));
+  for (unsigned i(0); i != kProbeCount; ++i, probes.first += probes.second) {
+    std::uint64_t bit(probes.first % kBitCount_);
+    words_[bit / 64].fetch_or(std::uint64_t(1) << (bit % 64));
+  }
+  ++added_;
+}
+
+bool BloomFilter::MayContain(const NameType& hashed_name) const {
+  auto probes(Probes(hashed_name));
+  for (unsigned i(0); i != kProbeCount; ++i, probes.first += probes.second) {
+    std::uint64_t bit(probes.first % kBitCount_);
+    if ((words_[bit / 64].load() & (std::uint64_t(1) << (bit % 64))) == 0)
+      return false;
+  }
+  return true;
+}
+
+std::pair<std::uint64_t, std::uint64_t> BloomFilter::Probes(const NameType& hashed_name) const {
+  // Chunks of different types may share a name, so the type is mixed into the start.
+  const byte* name(hashed_name.name.string().data());
+  return std::make_pair(
+      detail::GetLittleEndian<std::uint64_t>(name) ^
+          (static_cast<std::uint64_t>(hashed_name.type_id.data) * 0x9e3779b97f4a7c15ULL),
+      detail::GetLittleEndian<std::uint64_t>(name + 8) | 1);
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
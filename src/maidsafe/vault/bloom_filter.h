@@ -0,0 +1,74 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_BLOOM_FILTER_H_
+#define MAIDSAFE_VAULT_BLOOM_FILTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/data.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Bloom filter over the hashed names held by a ChunkStore, which answers "definitely not held"
+// without locking.  Hashed names are uniformly distributed already, so the probe positions are
+// taken from the name's own bytes rather than by hashing it again.  Names can't be removed;
+// instead the owner builds a replacement once the filter is Full().  Add and MayContain may be
+// called concurrently.
+class BloomFilter {
+ public:
+  using NameType = Data::NameAndTypeId;
+  static const std::uint64_t kMinCapacity = 1 << 16;
+
+  // Sized for 'capacity' names (at least kMinCapacity) at a false positive rate of about 1%.
+  explicit BloomFilter(std::uint64_t capacity);
+  BloomFilter(const BloomFilter&) = delete;
+  BloomFilter(BloomFilter&&) = delete;
+  BloomFilter& operator=(const BloomFilter&) = delete;
+  BloomFilter& operator=(BloomFilter&&) = delete;
+
+  void Add(const NameType& hashed_name);
+  bool MayContain(const NameType& hashed_name) const;
+  // True once as many names have been added as the filter was sized for, beyond which the false
+  // positive rate climbs.
+  bool Full() const { return added_ >= kCapacity_; }
+  std::uint64_t Capacity() const { return kCapacity_; }
+
+ private:
+  static const unsigned kProbeCount = 7;
+  static const std::uint64_t kBitsPerName = 10;
+
+  // The start and step of the probe sequence for 'hashed_name'.
+  std::pair<std::uint64_t, std::uint64_t> Probes(const NameType& hashed_name) const;
+
+  const std::uint64_t kCapacity_, kBitCount_;
+  std::vector<std::atomic<std::uint64_t>> words_;
+  std::atomic<std::uint64_t> added_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_BLOOM_FILTER_H_
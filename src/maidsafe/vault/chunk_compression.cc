@@ -0,0 +1,163 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "cryptopp/filters.h"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+enum Method : byte { kStored = 0, kDeflated = 1 };
+
+const std::size_t kDeflatedHeaderSize(5);
+// Inputs this small can't gain enough to pay for the header.
+const std::size_t kMinCompressibleSize(64);
+
+void SetFramedSize(std::uint32_t size, byte* header) {
+  for (int i(0); i != 4; ++i)
+    header[1 + i] = static_cast<byte>(size >> (8 * i));
+}
+
+std::uint32_t FramedSize(const byte* header) {
+  std::uint32_t size(0);
+  for (int i(0); i != 4; ++i)
+    size |= static_cast<std::uint32_t>(header[1 + i]) << (8 * i);
+  return size;
+}
+
+// Like CryptoPP::ArraySink, but never blocks the filter feeding it and counts everything it's
+// given, including whatever doesn't fit.
+class BoundedSink : public CryptoPP::Bufferless<CryptoPP::Sink> {
+ public:
+  BoundedSink(byte* buffer, std::size_t capacity)
+      : buffer_(buffer), capacity_(capacity), total_(0) {}
+
+  std::size_t Put2(const byte* data, std::size_t length, int /*message_end*/,
+                   bool /*blocking*/) override {
+    if (length != 0 && total_ < capacity_) {
+      std::memcpy(buffer_ + total_, data,
+                  static_cast<std::size_t>(std::min<std::uint64_t>(length, capacity_ - total_)));
+    }
+    total_ += length;
+    return 0;
+  }
+
+  std::uint64_t Total() const { return total_; }
+
+ private:
+  byte* const buffer_;
+  const std::size_t capacity_;
+  std::uint64_t total_;
+};
+
+}  // unnamed namespace
+
+const std::size_t ChunkCompressor::kMaxOverhead;
+const std::size_t ChunkCompressor::kSampleThreshold;
+const std::size_t ChunkCompressor::kSampleSlices;
+const std::size_t ChunkCompressor::kSampleSliceSize;
+const double ChunkCompressor::kMinSampleSaving(0.125);
+
+ChunkCompressor::ChunkCompressor()
+    : deflator_(), inflator_(), sample_(kSampleSlices * kSampleSliceSize) {}
+
+void ChunkCompressor::Compress(Level level, const byte* data, std::size_t size,
+                               std::vector<byte>& framed) {
+  if (size >= kMinCompressibleSize && size <= std::numeric_limits<std::uint32_t>::max() &&
+      WorthCompressing(data, size)) {
+    // Deflated content is only kept if it's smaller than the stored form would be.
+    framed.resize(kDeflatedHeaderSize + size);
+    std::size_t capacity(size - kDeflatedHeaderSize);
+    auto deflated_size(Deflate(level == Level::kFast ? 1 : CryptoPP::Deflator::MAX_DEFLATE_LEVEL,
+                               data, size, framed.data() + kDeflatedHeaderSize, capacity));
+    if (deflated_size <= capacity) {
+      framed[0] = kDeflated;
+      SetFramedSize(static_cast<std::uint32_t>(size), framed.data());
+      framed.resize(kDeflatedHeaderSize + static_cast<std::size_t>(deflated_size));
+      return;
+    }
+  }
+  framed.resize(1 + size);
+  framed[0] = kStored;
+  std::memcpy(framed.data() + 1, data, size);
+}
+
+void ChunkCompressor::Decompress(const byte* framed, std::size_t size, std::vector<byte>& data) {
+  if (size != 0 && framed[0] == kStored) {
+    data.assign(framed + 1, framed + size);
+    return;
+  }
+  if (size > kDeflatedHeaderSize && framed[0] == kDeflated && FramedSize(framed) != 0) {
+    data.resize(FramedSize(framed));
+    auto sink(new BoundedSink(data.data(), data.size()));
+    inflator_.Attach(sink);
+    try {
+      inflator_.Put(framed + kDeflatedHeaderSize, size - kDeflatedHeaderSize);
+      inflator_.MessageEnd();
+      if (sink->Total() == data.size())
+        return;
+    } catch (const CryptoPP::Exception& e) {
+      LOG(kError) << "Failed to inflate chunk: " << e.what();
+      inflator_.IsolatedInitialize(CryptoPP::g_nullNameValuePairs);
+    }
+  }
+  LOG(kError) << "Malformed compressed chunk";
+  data.clear();
+  BOOST_THROW_EXCEPTION(MakeError(CommonErrors::parsing_error));
+}
+
+bool ChunkCompressor::WorthCompressing(const byte* data, std::size_t size) {
+  if (size < kSampleThreshold)
+    return true;
+  // Slices are taken from evenly spaced points, so a compressible header on otherwise random
+  // content (or the reverse) doesn't decide the outcome alone.
+  std::size_t stride((size - kSampleSliceSize) / (kSampleSlices - 1));
+  deflator_.SetDeflateLevel(1);
+  auto sink(new BoundedSink(sample_.data(), sample_.size()));
+  deflator_.Attach(sink);
+  for (std::size_t i(0); i != kSampleSlices; ++i)
+    deflator_.Put(data + i * stride, kSampleSliceSize);
+  deflator_.MessageEnd();
+  return static_cast<double>(sink->Total()) <=
+         (1.0 - kMinSampleSaving) * static_cast<double>(sample_.size());
+}
+
+std::uint64_t ChunkCompressor::Deflate(int level, const byte* data, std::size_t size,
+                                       byte* output, std::size_t capacity) {
+  deflator_.SetDeflateLevel(level);
+  auto sink(new BoundedSink(output, capacity));
+  deflator_.Attach(sink);
+  deflator_.Put(data, size);
+  deflator_.MessageEnd();
+  return sink->Total();
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
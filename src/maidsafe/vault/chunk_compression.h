@@ -0,0 +1,78 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_COMPRESSION_H_
+#define MAIDSAFE_VAULT_CHUNK_COMPRESSION_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "cryptopp/zdeflate.h"
+#include "cryptopp/zinflate.h"
+
+#include "maidsafe/common/types.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Compresses chunks for ChunkStore before they're obfuscated.  Output is framed by a one byte
+// header naming the method, followed for deflated content by its original size as four
+// little-endian bytes, so Decompress needs nothing else.  Content which wouldn't shrink is framed
+// as stored.  Large inputs are sampled first: unless a fast compression of a few slices saves at
+// least kMinSampleSaving of them, the input is stored without compressing it in full.  The
+// Crypto++ filters are reused between calls, so an instance isn't thread-safe; use one per thread.
+class ChunkCompressor {
+ public:
+  // kFast favours speed and kBest favours ratio (DEFLATE levels 1 and 9).
+  enum class Level { kFast, kBest };
+  // Most that Compress can add to the size of its input.
+  static const std::size_t kMaxOverhead = 1;
+
+  ChunkCompressor();
+  ChunkCompressor(const ChunkCompressor&) = delete;
+  ChunkCompressor(ChunkCompressor&&) = delete;
+  ChunkCompressor& operator=(const ChunkCompressor&) = delete;
+  ChunkCompressor& operator=(ChunkCompressor&&) = delete;
+
+  // 'framed' is resized to fit the result.
+  void Compress(Level level, const byte* data, std::size_t size, std::vector<byte>& framed);
+  // Throws CommonErrors::parsing_error, leaving 'data' empty, if 'framed' is malformed.
+  void Decompress(const byte* framed, std::size_t size, std::vector<byte>& data);
+
+ private:
+  static const std::size_t kSampleThreshold = 16 * 1024;
+  static const std::size_t kSampleSlices = 4;
+  static const std::size_t kSampleSliceSize = 1024;
+  static const double kMinSampleSaving;
+
+  bool WorthCompressing(const byte* data, std::size_t size);
+  // Returns the size of the deflated 'data', which is only written to 'output' if it fits.
+  std::uint64_t Deflate(int level, const byte* data, std::size_t size, byte* output,
+                        std::size_t capacity);
+
+  CryptoPP::Deflator deflator_;
+  CryptoPP::Inflator inflator_;
+  std::vector<byte> sample_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_COMPRESSION_H_
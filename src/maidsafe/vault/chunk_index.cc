@@ -0,0 +1,372 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_index.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <utility>
+
+#include "boost/crc.hpp"
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+#include "maidsafe/vault/chunk_store_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Snapshot layout: magic(4) version(4) count(8) {name(identity_size) type_id(4) size(8)}* crc(4)
+const std::uint32_t kSnapshotMagic(0x49435350);  // "PSCI"
+const std::uint32_t kSnapshotVersion(1);
+const std::size_t kSnapshotHeaderSize(16);
+const std::size_t kEntrySize(identity_size + 4 + 8);
+const std::size_t kEntriesPerBlock(4096);
+
+}  // unnamed namespace
+
+const std::uint64_t ChunkIndex::kRemoved(std::numeric_limits<std::uint64_t>::max());
+const std::size_t ChunkIndex::kMinMergeSize;
+const std::size_t ChunkIndex::kMergeRatio;
+
+ChunkIndex::ChunkIndex(const fs::path& metadata_directory)
+    : kSnapshotPath_(metadata_directory / "index"), shards_() {}
+
+bool ChunkIndex::Load() {
+  Clear();
+  boost::system::error_code error_code;
+  if (!fs::exists(kSnapshotPath_, error_code))
+    return false;
+
+  bool loaded(false);
+  {
+    std::ifstream stream(kSnapshotPath_.string(), std::ios::binary);
+    boost::crc_32_type crc;
+    byte header[kSnapshotHeaderSize];
+    if (stream.read(reinterpret_cast<char*>(header), kSnapshotHeaderSize) &&
+        detail::GetLittleEndian<std::uint32_t>(header) == kSnapshotMagic &&
+        detail::GetLittleEndian<std::uint32_t>(header + 4) == kSnapshotVersion) {
+      crc.process_bytes(header, kSnapshotHeaderSize);
+      auto remaining(detail::GetLittleEndian<std::uint64_t>(header + 8));
+      bool ordered(true);
+      std::vector<byte> block(kEntriesPerBlock * kEntrySize);
+      while (remaining != 0) {
+        auto count(std::min<std::uint64_t>(remaining, kEntriesPerBlock));
+        if (!stream.read(reinterpret_cast<char*>(block.data()), count * kEntrySize))
+          break;
+        crc.process_bytes(block.data(), count * kEntrySize);
+        for (std::size_t i(0); i != count; ++i) {
+          const byte* entry(block.data() + i * kEntrySize);
+          Key key;
+          std::copy(entry, entry + identity_size, key.name.begin());
+          key.type_id = detail::GetLittleEndian<std::uint32_t>(entry + identity_size);
+          // Entries were saved in order, so are appended to the arrays.
+          auto& shard(ShardFor(key));
+          ordered = ordered && (shard.keys.empty() || shard.keys.back() < key);
+          shard.keys.push_back(key);
+          shard.sizes.push_back(
+              detail::GetLittleEndian<std::uint64_t>(entry + identity_size + 4));
+          ++shard.count;
+        }
+        remaining -= count;
+      }
+      byte checksum[4];
+      loaded = remaining == 0 && ordered && stream.read(reinterpret_cast<char*>(checksum), 4) &&
+               detail::GetLittleEndian<std::uint32_t>(checksum) == crc.checksum();
+    }
+  }
+
+  // The snapshot is only valid until the next modification, so it mustn't survive a crash.
+  fs::remove(kSnapshotPath_, error_code);
+  if (error_code) {
+    LOG(kError) << "Failed to remove " << kSnapshotPath_ << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  if (!loaded) {
+    LOG(kWarning) << kSnapshotPath_ << " is corrupt; index will be rebuilt";
+    Clear();
+  }
+  return loaded;
+}
+
+void ChunkIndex::Rebuild(const std::vector<ChunkStoreEngine::StoredChunk>& chunks) {
+  Clear();
+  std::array<std::vector<std::pair<Key, std::uint64_t>>, kShardCount> sorted;
+  for (const auto& chunk : chunks) {
+    auto key(MakeKey(chunk.name));
+    sorted[key.name[0] * kShardCount / 256].emplace_back(key, chunk.size);
+  }
+  for (std::size_t i(0); i != kShardCount; ++i) {
+    auto& entries(sorted[i]);
+    // As with a sequence of Puts, the last size given for a name is kept.
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const std::pair<Key, std::uint64_t>& lhs,
+                        const std::pair<Key, std::uint64_t>& rhs) {
+                       return lhs.first < rhs.first;
+                     });
+    auto& shard(shards_[i]);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (std::size_t j(0); j != entries.size(); ++j) {
+      if (j + 1 != entries.size() && !(entries[j].first < entries[j + 1].first))
+        continue;
+      shard.keys.push_back(entries[j].first);
+      shard.sizes.push_back(entries[j].second);
+    }
+    shard.count = shard.keys.size();
+    std::vector<std::pair<Key, std::uint64_t>>().swap(entries);
+  }
+}
+
+void ChunkIndex::Save() const {
+  boost::system::error_code error_code;
+  fs::create_directories(kSnapshotPath_.parent_path(), error_code);
+  fs::path temp_path(kSnapshotPath_.string() + ".tmp");
+  {
+    std::ofstream stream(temp_path.string(), std::ios::binary | std::ios::trunc);
+    boost::crc_32_type crc;
+    byte header[kSnapshotHeaderSize];
+    detail::PutLittleEndian(kSnapshotMagic, header);
+    detail::PutLittleEndian(kSnapshotVersion, header + 4);
+    detail::PutLittleEndian(static_cast<std::uint64_t>(Count()), header + 8);
+    crc.process_bytes(header, kSnapshotHeaderSize);
+    stream.write(reinterpret_cast<const char*>(header), kSnapshotHeaderSize);
+
+    std::vector<byte> entry(kEntrySize);
+    Key first;
+    first.name.fill(0);
+    first.type_id = 0;
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      Visit(shard, first, true, [&](const Key& key, std::uint64_t size) {
+        std::copy(key.name.begin(), key.name.end(), entry.begin());
+        detail::PutLittleEndian(key.type_id, entry.data() + identity_size);
+        detail::PutLittleEndian(size, entry.data() + identity_size + 4);
+        crc.process_bytes(entry.data(), kEntrySize);
+        stream.write(reinterpret_cast<const char*>(entry.data()), kEntrySize);
+        return true;
+      });
+    }
+    byte checksum[4];
+    detail::PutLittleEndian(static_cast<std::uint32_t>(crc.checksum()), checksum);
+    stream.write(reinterpret_cast<const char*>(checksum), 4);
+    if (!stream) {
+      LOG(kError) << "Failed to write " << temp_path;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+  }
+  fs::rename(temp_path, kSnapshotPath_, error_code);
+  if (error_code) {
+    LOG(kError) << "Failed to rename " << temp_path << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+}
+
+void ChunkIndex::Put(const NameType& name, std::uint64_t size) {
+  auto key(MakeKey(name));
+  auto& shard(ShardFor(key));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  Change(shard, key, size);
+}
+
+void ChunkIndex::Delete(const NameType& name) {
+  auto key(MakeKey(name));
+  auto& shard(ShardFor(key));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  Change(shard, key, kRemoved);
+}
+
+bool ChunkIndex::Has(const NameType& name) const {
+  auto key(MakeKey(name));
+  const auto& shard(ShardFor(key));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return Find(shard, key) != kRemoved;
+}
+
+std::uint64_t ChunkIndex::Size(const NameType& name) const {
+  auto key(MakeKey(name));
+  const auto& shard(ShardFor(key));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto size(Find(shard, key));
+  return size == kRemoved ? 0 : size;
+}
+
+std::size_t ChunkIndex::Count() const {
+  std::size_t count(0);
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    count += shard.count;
+  }
+  return count;
+}
+
+std::vector<ChunkIndex::NameType> ChunkIndex::Names() const {
+  std::vector<NameType> names;
+  Key first;
+  first.name.fill(0);
+  first.type_id = 0;
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Visit(shard, first, true, [&](const Key& key, std::uint64_t /*size*/) {
+      names.push_back(MakeName(key));
+      return true;
+    });
+  }
+  return names;
+}
+
+std::vector<ChunkIndex::NameType> ChunkIndex::NamesAfter(const boost::optional<NameType>& after,
+                                                         std::size_t max_count,
+                                                         const Filter& filter) const {
+  std::vector<NameType> names;
+  if (max_count == 0 || filter.prefix.size() > identity_size)
+    return names;
+  // Nothing ordered before the first name with the prefix can match.
+  Key start;
+  start.name.fill(0);
+  std::copy(filter.prefix.begin(), filter.prefix.end(), start.name.begin());
+  start.type_id = 0;
+  bool inclusive(true);
+  if (after && start < MakeKey(*after)) {
+    start = MakeKey(*after);
+    inclusive = false;
+  }
+
+  for (auto i(start.name[0] * kShardCount / 256); i != kShardCount; ++i) {
+    const auto& shard(shards_[i]);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    bool more(Visit(shard, start, inclusive, [&](const Key& key, std::uint64_t /*size*/) {
+      // Names with the prefix are contiguous, so the first without it ends the listing.
+      if (!std::equal(filter.prefix.begin(), filter.prefix.end(), key.name.begin()))
+        return false;
+      if (!filter.type_id || key.type_id == filter.type_id->data)
+        names.push_back(MakeName(key));
+      return names.size() != max_count;
+    }));
+    if (!more)
+      return names;
+  }
+  return names;
+}
+
+ChunkIndex::Key ChunkIndex::MakeKey(const NameType& name) {
+  Key key;
+  const auto& raw_name(name.name.string());
+  std::copy(raw_name.begin(), raw_name.end(), key.name.begin());
+  key.type_id = name.type_id.data;
+  return key;
+}
+
+ChunkIndex::NameType ChunkIndex::MakeName(const Key& key) {
+  return NameType(Identity(std::vector<byte>(key.name.begin(), key.name.end())),
+                  DataTypeId(key.type_id));
+}
+
+ChunkIndex::Shard& ChunkIndex::ShardFor(const Key& key) {
+  return shards_[key.name[0] * kShardCount / 256];
+}
+
+const ChunkIndex::Shard& ChunkIndex::ShardFor(const Key& key) const {
+  return shards_[key.name[0] * kShardCount / 256];
+}
+
+std::uint64_t ChunkIndex::Find(const Shard& shard, const Key& key) {
+  auto change(shard.changes.find(key));
+  if (change != shard.changes.end())
+    return change->second;
+  auto itr(std::lower_bound(shard.keys.begin(), shard.keys.end(), key));
+  if (itr == shard.keys.end() || key < *itr)
+    return kRemoved;
+  return shard.sizes[itr - shard.keys.begin()];
+}
+
+void ChunkIndex::Change(Shard& shard, const Key& key, std::uint64_t size) {
+  bool held(Find(shard, key) != kRemoved);
+  if (size == kRemoved && !held)
+    return;
+  shard.changes[key] = size;
+  if (held && size == kRemoved)
+    --shard.count;
+  else if (!held)
+    ++shard.count;
+  if (shard.changes.size() > std::max(kMinMergeSize, shard.keys.size() / kMergeRatio))
+    Merge(shard);
+}
+
+void ChunkIndex::Merge(Shard& shard) {
+  std::vector<Key> keys;
+  std::vector<std::uint64_t> sizes;
+  keys.reserve(shard.count);
+  sizes.reserve(shard.count);
+  Key first;
+  first.name.fill(0);
+  first.type_id = 0;
+  Visit(shard, first, true, [&](const Key& key, std::uint64_t size) {
+    keys.push_back(key);
+    sizes.push_back(size);
+    return true;
+  });
+  shard.keys.swap(keys);
+  shard.sizes.swap(sizes);
+  shard.changes.clear();
+}
+
+template <typename Visitor>
+bool ChunkIndex::Visit(const Shard& shard, const Key& start, bool inclusive, Visitor visit) {
+  auto key_itr(inclusive ? std::lower_bound(shard.keys.begin(), shard.keys.end(), start)
+                         : std::upper_bound(shard.keys.begin(), shard.keys.end(), start));
+  auto change_itr(inclusive ? shard.changes.lower_bound(start) : shard.changes.upper_bound(start));
+  while (key_itr != shard.keys.end() || change_itr != shard.changes.end()) {
+    bool from_change(change_itr != shard.changes.end() &&
+                     (key_itr == shard.keys.end() || !(*key_itr < change_itr->first)));
+    if (!from_change) {
+      if (!visit(*key_itr, shard.sizes[key_itr - shard.keys.begin()]))
+        return false;
+      ++key_itr;
+      continue;
+    }
+    // A change overrides the entry for the same key in the arrays.
+    if (key_itr != shard.keys.end() && !(change_itr->first < *key_itr))
+      ++key_itr;
+    if (change_itr->second != kRemoved && !visit(change_itr->first, change_itr->second))
+      return false;
+    ++change_itr;
+  }
+  return true;
+}
+
+void ChunkIndex::Clear() {
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    std::vector<Key>().swap(shard.keys);
+    std::vector<std::uint64_t>().swap(shard.sizes);
+    shard.changes.clear();
+    shard.count = 0;
+  }
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
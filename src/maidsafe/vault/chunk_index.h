@@ -0,0 +1,134 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_INDEX_H_
+#define MAIDSAFE_VAULT_CHUNK_INDEX_H_
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+#include "boost/optional/optional.hpp"
+
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/data.h"
+
+#include "maidsafe/vault/chunk_store_engine.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// In-memory index of the (hashed) names held by a ChunkStore and their stored sizes.  It is
+// persisted as a single snapshot file written on clean shutdown.  Load() consumes the snapshot,
+// so after a crash there is none and the caller must Rebuild() the index from its engine; the
+// index can therefore never disagree with the chunks on disk.
+// Each shard keeps most of its entries in sorted flat arrays, costing little more than the names
+// and sizes themselves, and recent changes in a small ordered map.  The map is merged into the
+// arrays once it grows beyond a fraction of them, so lookups stay logarithmic and the merges'
+// cost is spread over many changes.
+class ChunkIndex {
+ public:
+  using NameType = Data::NameAndTypeId;
+  // Selects names starting with 'prefix' and, if 'type_id' is set, of that type.
+  struct Filter {
+    std::vector<byte> prefix;
+    boost::optional<DataTypeId> type_id;
+  };
+
+  explicit ChunkIndex(const boost::filesystem::path& metadata_directory);
+  ChunkIndex(const ChunkIndex&) = delete;
+  ChunkIndex(ChunkIndex&&) = delete;
+  ChunkIndex& operator=(const ChunkIndex&) = delete;
+  ChunkIndex& operator=(ChunkIndex&&) = delete;
+
+  // Returns false if there is no valid snapshot, leaving the index empty.
+  bool Load();
+  void Rebuild(const std::vector<ChunkStoreEngine::StoredChunk>& chunks);
+  // Writes the snapshot.  No further modifications should be made afterwards.
+  void Save() const;
+
+  void Put(const NameType& name, std::uint64_t size);
+  void Delete(const NameType& name);
+  bool Has(const NameType& name) const;
+  // Returns 0 if 'name' isn't held.
+  std::uint64_t Size(const NameType& name) const;
+  std::size_t Count() const;
+  // Names are returned in ascending order.
+  std::vector<NameType> Names() const;
+  // Returns up to 'max_count' of the names matching 'filter' which follow 'after' (or from the
+  // first if it isn't set) in ascending order.  Fewer are returned only once there are no more.
+  // Only one shard is locked at a time, so this doesn't hold up modifications for long.
+  std::vector<NameType> NamesAfter(const boost::optional<NameType>& after, std::size_t max_count,
+                                   const Filter& filter) const;
+
+ private:
+  struct Key {
+    bool operator<(const Key& other) const {
+      return name < other.name || (name == other.name && type_id < other.type_id);
+    }
+    std::array<byte, identity_size> name;
+    std::uint32_t type_id;
+  };
+  // Shards partition the index by the leading byte of the name, so concatenating them in order
+  // gives a sorted listing.  'keys' and 'sizes' are parallel and sorted by key.  An entry in
+  // 'changes' overrides any for the same key in the arrays, with kRemoved marking a deletion.
+  // 'count' is the number of names held.
+  struct Shard {
+    Shard() : mutex(), keys(), sizes(), changes(), count(0) {}
+    mutable std::mutex mutex;
+    std::vector<Key> keys;
+    std::vector<std::uint64_t> sizes;
+    std::map<Key, std::uint64_t> changes;
+    std::size_t count;
+  };
+  static const std::size_t kShardCount = 64;
+  static const std::uint64_t kRemoved;
+  // 'changes' is merged once it holds more than this many entries, or more than one for every
+  // kMergeRatio in the arrays.
+  static const std::size_t kMinMergeSize = 1024;
+  static const std::size_t kMergeRatio = 16;
+
+  static Key MakeKey(const NameType& name);
+  static NameType MakeName(const Key& key);
+  Shard& ShardFor(const Key& key);
+  const Shard& ShardFor(const Key& key) const;
+  // Returns the size held for 'key' in the shard, whose mutex must be held, or kRemoved.
+  static std::uint64_t Find(const Shard& shard, const Key& key);
+  // Records 'size' (or kRemoved) for 'key' in the shard, whose mutex must be held.
+  static void Change(Shard& shard, const Key& key, std::uint64_t size);
+  static void Merge(Shard& shard);
+  // Calls 'visit' with each key and size held in the shard, whose mutex must be held, in order
+  // from 'start' (or the key after it, if not 'inclusive') until 'visit' returns false.  Returns
+  // false if 'visit' did.
+  template <typename Visitor>
+  static bool Visit(const Shard& shard, const Key& start, bool inclusive, Visitor visit);
+  void Clear();
+
+  const boost::filesystem::path kSnapshotPath_;
+  std::array<Shard, kShardCount> shards_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_INDEX_H_
@@ -0,0 +1,268 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_obfuscation.h"
+
+#include <algorithm>
+#include <array>
+
+#include "cryptopp/cpu.h"
+
+#include "maidsafe/common/crypto.h"
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+#include "maidsafe/vault/chunk_store_utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+const byte* KeyAndIv(const Identity& name) {
+  const auto& raw_name(name.string());
+  if (raw_name.size() < crypto::AES256_KeySize + crypto::AES256_IVSize) {
+    LOG(kError) << "Name is too short to derive an obfuscation key";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  return raw_name.data();
+}
+
+// Starts content in the seekable format.  Legacy content starting with the same bytes would fail
+// to verify as blocks, and is then deobfuscated as a whole.  The last byte is the format version;
+// version 1 didn't authenticate the chunk's length and is no longer read.
+const byte kSeekableMagic[] = {0x8a, 'S', 'E', 'E', 'K', 0x0d, 0x0a, 0x02};
+const std::size_t kMagicSize(sizeof(kSeekableMagic));
+const std::size_t kBlockRecordSize(ChunkObfuscator::kBlockSize + ChunkObfuscator::kTagSize);
+
+// Block IVs differ from the chunk's IV (used by the non-seekable format) and from each other.
+std::array<byte, crypto::AES256_IVSize> BlockIv(const byte* iv, std::uint64_t index) {
+  std::array<byte, crypto::AES256_IVSize> block_iv;
+  std::copy(iv, iv + crypto::AES256_IVSize, block_iv.begin());
+  std::uint64_t counter(index + 1);
+  for (std::size_t i(0); i != 8; ++i)
+    block_iv[crypto::AES256_IVSize - 1 - i] ^= static_cast<byte>(counter >> (8 * i));
+  return block_iv;
+}
+
+// Every block is authenticated together with the plain text size of the whole chunk, so content cut
+// short at a block boundary (which still looks like a whole number of blocks) fails to verify.
+using BlockAad = std::array<byte, sizeof(std::uint64_t)>;
+
+BlockAad BlockAssociatedData(std::uint64_t plain_size) {
+  BlockAad aad;
+  detail::PutLittleEndian(plain_size, aad.data());
+  return aad;
+}
+
+// Returns the plain text size of content in the seekable format, or 0 if it isn't laid out as
+// such.
+std::uint64_t SeekablePlainSize(const byte* data, std::size_t size) {
+  if (size <= kMagicSize || !std::equal(kSeekableMagic, kSeekableMagic + kMagicSize, data))
+    return 0;
+  std::uint64_t records(size - kMagicSize), tail(records % kBlockRecordSize);
+  if (tail != 0 && tail <= ChunkObfuscator::kTagSize)
+    return 0;
+  std::uint64_t plain_size((records / kBlockRecordSize) * ChunkObfuscator::kBlockSize +
+                           (tail == 0 ? 0 : tail - ChunkObfuscator::kTagSize));
+  return plain_size > ChunkObfuscator::kBlockSize ? plain_size : 0;
+}
+
+}  // unnamed namespace
+
+const std::size_t ChunkObfuscator::kTagSize;
+const std::size_t ChunkObfuscator::kBlockSize;
+
+ChunkObfuscator::ChunkObfuscator() : encryptor_(), decryptor_(), scratch_() {}
+
+bool ChunkObfuscator::HardwareAccelerated() {
+#if CRYPTOPP_BOOL_X86 || CRYPTOPP_BOOL_X32 || CRYPTOPP_BOOL_X64
+  return CryptoPP::HasAESNI();
+#else
+  return false;
+#endif
+}
+
+void ChunkObfuscator::Obfuscate(const Identity& name, const byte* data, std::size_t size,
+                                std::vector<byte>& obfuscated) {
+  const byte* key(KeyAndIv(name));
+  if (size == 0)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  const byte* iv(key + crypto::AES256_KeySize);
+  obfuscated.resize(size + kTagSize);
+  try {
+    encryptor_.SetKeyWithIV(key, crypto::AES256_KeySize, iv, crypto::AES256_IVSize);
+    encryptor_.EncryptAndAuthenticate(obfuscated.data(), obfuscated.data() + size, kTagSize, iv,
+                                      static_cast<int>(crypto::AES256_IVSize), nullptr, 0, data,
+                                      size);
+  } catch (const std::exception& e) {
+    LOG(kError) << "Failed to obfuscate: " << e.what();
+    obfuscated.clear();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::symmetric_encryption_error));
+  }
+}
+
+void ChunkObfuscator::Deobfuscate(const Identity& name, const byte* data, std::size_t size,
+                                  std::vector<byte>& plain_text) {
+  const byte* key(KeyAndIv(name));
+  bool out_of_range(false);
+  if (!DecryptBlocks(key, data, size, 0, size, plain_text, out_of_range) &&
+      !DecryptWhole(key, data, size, plain_text)) {
+    plain_text.clear();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::symmetric_decryption_error));
+  }
+}
+
+std::uint64_t ChunkObfuscator::SeekableSize(std::uint64_t size) {
+  if (size <= kBlockSize)
+    return size + kTagSize;
+  return kMagicSize + size + kTagSize * ((size + kBlockSize - 1) / kBlockSize);
+}
+
+void ChunkObfuscator::ObfuscateSeekable(const Identity& name, const byte* data, std::size_t size,
+                                        std::vector<byte>& obfuscated) {
+  if (size <= kBlockSize)
+    return Obfuscate(name, data, size, obfuscated);
+  const byte* key(KeyAndIv(name));
+  const byte* iv(key + crypto::AES256_KeySize);
+  obfuscated.resize(static_cast<std::size_t>(SeekableSize(size)));
+  std::copy(kSeekableMagic, kSeekableMagic + kMagicSize, obfuscated.begin());
+  try {
+    encryptor_.SetKeyWithIV(key, crypto::AES256_KeySize, iv, crypto::AES256_IVSize);
+    auto aad(BlockAssociatedData(size));
+    byte* output(obfuscated.data() + kMagicSize);
+    for (std::uint64_t index(0), offset(0); offset < size; ++index, offset += kBlockSize) {
+      std::size_t block_size(static_cast<std::size_t>(std::min<std::uint64_t>(kBlockSize,
+                                                                              size - offset)));
+      auto block_iv(BlockIv(iv, index));
+      encryptor_.EncryptAndAuthenticate(output, output + block_size, kTagSize, block_iv.data(),
+                                        static_cast<int>(block_iv.size()), aad.data(),
+                                        aad.size(), data + offset, block_size);
+      output += block_size + kTagSize;
+    }
+  } catch (const std::exception& e) {
+    LOG(kError) << "Failed to obfuscate: " << e.what();
+    obfuscated.clear();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::symmetric_encryption_error));
+  }
+}
+
+void ChunkObfuscator::DeobfuscateRange(const Identity& name, const byte* data, std::size_t size,
+                                       std::uint64_t offset, std::uint64_t length,
+                                       std::vector<byte>& plain_text) {
+  const byte* key(KeyAndIv(name));
+  bool out_of_range(false);
+  if (!DecryptBlocks(key, data, size, offset, length, plain_text, out_of_range)) {
+    if (!out_of_range) {
+      if (!DecryptWhole(key, data, size, scratch_)) {
+        plain_text.clear();
+        BOOST_THROW_EXCEPTION(MakeError(CommonErrors::symmetric_decryption_error));
+      }
+      out_of_range = offset > scratch_.size();
+    }
+    if (out_of_range) {
+      plain_text.clear();
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+    }
+    auto begin(scratch_.begin() + static_cast<std::ptrdiff_t>(offset));
+    plain_text.assign(begin, begin + static_cast<std::ptrdiff_t>(
+                                         std::min<std::uint64_t>(length, scratch_.end() - begin)));
+  }
+}
+
+void ChunkObfuscator::Obfuscate(const std::vector<Job>& jobs) {
+  for (const auto& job : jobs)
+    Obfuscate(*job.name, job.data, job.size, *job.output);
+}
+
+std::size_t ChunkObfuscator::Deobfuscate(const std::vector<Job>& jobs) {
+  std::size_t failures(0);
+  for (const auto& job : jobs) {
+    try {
+      Deobfuscate(*job.name, job.data, job.size, *job.output);
+    } catch (const maidsafe_error&) {
+      job.output->clear();
+      ++failures;
+    }
+  }
+  return failures;
+}
+
+bool ChunkObfuscator::DecryptWhole(const byte* key, const byte* data, std::size_t size,
+                                   std::vector<byte>& plain_text) {
+  if (size <= kTagSize)
+    return false;
+  const byte* iv(key + crypto::AES256_KeySize);
+  std::size_t plain_size(size - kTagSize);
+  plain_text.resize(plain_size);
+  try {
+    decryptor_.SetKeyWithIV(key, crypto::AES256_KeySize, iv, crypto::AES256_IVSize);
+    return decryptor_.DecryptAndVerify(plain_text.data(), data + plain_size, kTagSize, iv,
+                                       static_cast<int>(crypto::AES256_IVSize), nullptr, 0, data,
+                                       plain_size);
+  } catch (const std::exception& e) {
+    LOG(kError) << "Failed to deobfuscate: " << e.what();
+    return false;
+  }
+}
+
+bool ChunkObfuscator::DecryptBlocks(const byte* key, const byte* data, std::size_t size,
+                                    std::uint64_t offset, std::uint64_t length,
+                                    std::vector<byte>& plain_text, bool& out_of_range) {
+  std::uint64_t plain_size(SeekablePlainSize(data, size));
+  if (plain_size == 0)
+    return false;
+  if (offset > plain_size) {
+    out_of_range = true;
+    return false;
+  }
+  std::uint64_t end(offset + std::min(length, plain_size - offset));
+  plain_text.resize(static_cast<std::size_t>(end - offset));
+  const byte* iv(key + crypto::AES256_KeySize);
+  try {
+    decryptor_.SetKeyWithIV(key, crypto::AES256_KeySize, iv, crypto::AES256_IVSize);
+    auto aad(BlockAssociatedData(plain_size));
+    for (std::uint64_t index(offset / kBlockSize); index * kBlockSize < end; ++index) {
+      std::uint64_t block_start(index * kBlockSize);
+      std::size_t block_size(static_cast<std::size_t>(
+          std::min<std::uint64_t>(kBlockSize, plain_size - block_start)));
+      const byte* record(data + kMagicSize + index * kBlockRecordSize);
+      auto block_iv(BlockIv(iv, index));
+      scratch_.resize(block_size);
+      if (!decryptor_.DecryptAndVerify(scratch_.data(), record + block_size, kTagSize,
+                                       block_iv.data(), static_cast<int>(block_iv.size()),
+                                       aad.data(), aad.size(), record, block_size)) {
+        return false;
+      }
+      std::uint64_t copy_start(std::max(offset, block_start));
+      std::uint64_t copy_end(std::min<std::uint64_t>(end, block_start + block_size));
+      std::copy(scratch_.begin() + static_cast<std::ptrdiff_t>(copy_start - block_start),
+                scratch_.begin() + static_cast<std::ptrdiff_t>(copy_end - block_start),
+                plain_text.begin() + static_cast<std::ptrdiff_t>(copy_start - offset));
+    }
+  } catch (const std::exception& e) {
+    LOG(kError) << "Failed to deobfuscate: " << e.what();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
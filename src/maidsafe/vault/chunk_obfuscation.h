@@ -0,0 +1,112 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_OBFUSCATION_H_
+#define MAIDSAFE_VAULT_CHUNK_OBFUSCATION_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "cryptopp/aes.h"
+#include "cryptopp/gcm.h"
+
+#include "maidsafe/common/types.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Obfuscates chunks for ChunkStore exactly as crypto::SymmEncrypt would: AES-256-GCM keyed by the
+// first 48 bytes (key then IV) of the chunk's name, with the 16 byte authentication tag appended
+// to the ciphertext.  Unlike SymmEncrypt/SymmDecrypt, no key objects or intermediate buffers are
+// allocated per chunk: the cipher objects are reused and output goes into caller-owned vectors
+// whose capacity is kept between calls.  An instance isn't thread-safe; use one per thread.
+//
+// ObfuscateSeekable writes chunks longer than kBlockSize in a seekable format instead: a short
+// magic header, then kBlockSize blocks each encrypted and authenticated on its own, with an IV
+// derived from the chunk's IV and the block's index, and the chunk's plain text size as associated
+// data so that truncation is detected.  A range can then be deobfuscated by reading and verifying
+// only the blocks covering it.  Shorter chunks gain nothing from this and are
+// written as by Obfuscate.  Deobfuscate and DeobfuscateRange accept both formats.
+class ChunkObfuscator {
+ public:
+  static const std::size_t kTagSize = 16;
+  static const std::size_t kBlockSize = 64 * 1024;
+
+  // Describes one chunk of a batch.  'output' is resized to fit the result.
+  struct Job {
+    const Identity* name;
+    const byte* data;
+    std::size_t size;
+    std::vector<byte>* output;
+  };
+
+  ChunkObfuscator();
+  ChunkObfuscator(const ChunkObfuscator&) = delete;
+  ChunkObfuscator(ChunkObfuscator&&) = delete;
+  ChunkObfuscator& operator=(const ChunkObfuscator&) = delete;
+  ChunkObfuscator& operator=(ChunkObfuscator&&) = delete;
+
+  // True if the CPU has AES instructions (AES-NI), which Crypto++ then uses for every call.
+  static bool HardwareAccelerated();
+
+  // Throws CommonErrors::invalid_argument if 'name' is too short to supply a key or 'size' is 0.
+  void Obfuscate(const Identity& name, const byte* data, std::size_t size,
+                 std::vector<byte>& obfuscated);
+  // Throws CommonErrors::symmetric_decryption_error, leaving 'plain_text' empty, if the content
+  // doesn't verify.
+  void Deobfuscate(const Identity& name, const byte* data, std::size_t size,
+                   std::vector<byte>& plain_text);
+
+  // Size of the output of ObfuscateSeekable for 'size' bytes of input.
+  static std::uint64_t SeekableSize(std::uint64_t size);
+  // Throws as Obfuscate.
+  void ObfuscateSeekable(const Identity& name, const byte* data, std::size_t size,
+                         std::vector<byte>& obfuscated);
+  // Deobfuscates up to 'length' bytes of the plain text starting at 'offset', fewer if it ends
+  // first.  Content in the seekable format is only decrypted (and verified) where it covers the
+  // range; other content is deobfuscated in full.  Throws as Deobfuscate, or with
+  // CommonErrors::invalid_argument if 'offset' is beyond the end.
+  void DeobfuscateRange(const Identity& name, const byte* data, std::size_t size,
+                        std::uint64_t offset, std::uint64_t length,
+                        std::vector<byte>& plain_text);
+
+  // Batch forms.  Obfuscate throws on the first failure.  Deobfuscate carries on past failures,
+  // leaving the output of each failed job empty, and returns the number of failures.
+  void Obfuscate(const std::vector<Job>& jobs);
+  std::size_t Deobfuscate(const std::vector<Job>& jobs);
+
+ private:
+  // Each returns false, rather than throwing, if the content doesn't verify.  DecryptBlocks also
+  // returns false if the content isn't laid out in the seekable format, and sets 'out_of_range'
+  // if it is but 'offset' is beyond the end.
+  bool DecryptWhole(const byte* key, const byte* data, std::size_t size,
+                    std::vector<byte>& plain_text);
+  bool DecryptBlocks(const byte* key, const byte* data, std::size_t size, std::uint64_t offset,
+                     std::uint64_t length, std::vector<byte>& plain_text, bool& out_of_range);
+
+  CryptoPP::GCM<CryptoPP::AES>::Encryption encryptor_;
+  CryptoPP::GCM<CryptoPP::AES>::Decryption decryptor_;
+  std::vector<byte> scratch_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_OBFUSCATION_H_
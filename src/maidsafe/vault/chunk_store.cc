@@ -19,15 +19,24 @@
 #include "maidsafe/vault/chunk_store.h"
 
 #include <algorithm>
-#include <future>
+#include <map>
+#include <numeric>
 
-#include "boost/filesystem/convenience.hpp"
-#include "boost/lexical_cast.hpp"
+#include "boost/filesystem/operations.hpp"
 
 #include "maidsafe/common/crypto.h"
 #include "maidsafe/common/log.h"
 #include "maidsafe/common/utils.h"
 
+#include "maidsafe/vault/chunk_compression.h"
+#include "maidsafe/vault/chunk_obfuscation.h"
+#include "maidsafe/vault/chunk_store_utils.h"
+#include "maidsafe/vault/file_chunk_engine.h"
+#include "maidsafe/vault/group_committer.h"
+#include "maidsafe/vault/memory_chunk_engine.h"
+#include "maidsafe/vault/pack_chunk_engine.h"
+#include "maidsafe/vault/tiered_chunk_engine.h"
+
 namespace fs = boost::filesystem;
 
 namespace maidsafe {
@@ -36,241 +45,1077 @@ namespace vault {
 
 namespace {
 
-struct UsedSpace {
-  UsedSpace() : directories(), disk_usage(0) {}
-  UsedSpace(UsedSpace&& other)
-      : directories(std::move(other.directories)), disk_usage(std::move(other.disk_usage)) {}
-
-  std::vector<fs::path> directories;
-  DiskUsage disk_usage;
-};
-
-UsedSpace GetUsedSpace(fs::path directory) {
-  UsedSpace used_space;
-  try {
-    for (fs::directory_iterator it(directory); it != fs::directory_iterator(); ++it) {
-      if (fs::is_directory(*it))
-        used_space.directories.push_back(it->path());
-      else
-        used_space.disk_usage.data += fs::file_size(*it);
-    }
-  } catch (const std::exception& e) {
-    LOG(kError) << "GetUsedSpace when handling " << directory
-                << " caught an error : " << boost::diagnostic_information(e);
-    throw;
+std::unique_ptr<ChunkStoreEngine> MakeEngine(const fs::path& disk_path, ChunkStore::Engine engine,
+                                             std::shared_ptr<GroupCommitter> committer,
+                                             ChunkStore::CacheBypass cache_bypass,
+                                             ChunkStore::Layout layout) {
+  switch (engine) {
+    case ChunkStore::Engine::kFilePerChunk:
+      return std::unique_ptr<ChunkStoreEngine>(
+          new FileChunkEngine(disk_path, committer, cache_bypass, layout));
+    case ChunkStore::Engine::kPackFile:
+      return std::unique_ptr<ChunkStoreEngine>(new PackChunkEngine(
+          disk_path, 256 * 1024 * 1024, std::chrono::seconds(60), committer));
+    case ChunkStore::Engine::kMemory:
+      return std::unique_ptr<ChunkStoreEngine>(new MemoryChunkEngine);
+    default:
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
   }
-  return used_space;
 }
 
-DiskUsage InitialiseDiskRoot(const fs::path& disk_root) {
-  boost::system::error_code error_code;
-  DiskUsage disk_usage(0);
-  if (!fs::exists(disk_root, error_code)) {
-    if (!fs::create_directories(disk_root, error_code)) {
-      LOG(kError) << "Can't create disk root at " << disk_root << ": " << error_code.message();
-      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::uninitialised));
-    }
-  } else {
-    std::vector<fs::path> dirs_to_do;
-    dirs_to_do.push_back(disk_root);
-    while (!dirs_to_do.empty()) {
-      std::vector<std::future<UsedSpace>> futures;
-      for (std::uint32_t i = 0; i < 16 && !dirs_to_do.empty(); ++i) {
-        auto temp_copy(dirs_to_do.back());
-        auto future = std::async(&GetUsedSpace, temp_copy);
-        dirs_to_do.pop_back();
-        futures.push_back(std::move(future));
-      }
-      try {
-        while (!futures.empty()) {
-          auto future = std::move(futures.back());
-          futures.pop_back();
-          UsedSpace result = future.get();
-          disk_usage.data += result.disk_usage.data;
-          std::move(result.directories.begin(), result.directories.end(),
-                    std::back_inserter(dirs_to_do));
-        }
-      } catch (const std::system_error& exception) {
-        LOG(kError) << boost::diagnostic_information(exception);
-        BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
-      } catch (...) {
-        LOG(kError) << "exception during InitialiseDiskRoot";
-        BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
-      }
+// An empty 'fast_tier.path' means the store isn't tiered.
+std::unique_ptr<ChunkStoreEngine> MakeEngine(const fs::path& disk_path, DiskUsage max_disk_usage,
+                                             const ChunkStore::FastTier& fast_tier,
+                                             ChunkStore::Engine engine,
+                                             ChunkStore::Durability durability,
+                                             ChunkStore::CacheBypass cache_bypass,
+                                             ChunkStore::Layout layout) {
+  std::shared_ptr<GroupCommitter> committer;
+  if (durability.mode == ChunkStore::Durability::kGroupCommit) {
+    if (durability.commit_window < std::chrono::microseconds(0)) {
+      LOG(kError) << "Commit window must not be negative";
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
     }
+    committer = std::make_shared<GroupCommitter>(durability.commit_window);
   }
-  return disk_usage;
+  if (fast_tier.path.empty())
+    return MakeEngine(disk_path, engine, committer, cache_bypass, layout);
+  return std::unique_ptr<ChunkStoreEngine>(new TieredChunkEngine(
+      MakeEngine(fast_tier.path, engine, committer, cache_bypass, layout),
+      fast_tier.max_disk_usage.data,
+      MakeEngine(disk_path, engine, committer, cache_bypass, layout), max_disk_usage.data,
+      TieredChunkEngine::kDefaultMigrationInterval,
+      ChunkStoreEngine::MetadataDirectory(fast_tier.path)));
+}
+
+// Two ChunkStores can be opened on the same path in one process (e.g. while one replaces
+// another).  Only the most recently opened one may record its state on shutdown, since the view
+// of any older instance is stale.
+std::mutex g_open_stores_mutex;
+std::map<fs::path, std::uint64_t> g_latest_generations;
+
+std::uint64_t RegisterOpenStore(const fs::path& disk_path) {
+  static std::uint64_t generation(0);
+  std::lock_guard<std::mutex> lock(g_open_stores_mutex);
+  return g_latest_generations[fs::absolute(disk_path)] = ++generation;
+}
+
+bool UnregisterOpenStore(const fs::path& disk_path, std::uint64_t generation) {
+  std::lock_guard<std::mutex> lock(g_open_stores_mutex);
+  auto itr(g_latest_generations.find(fs::absolute(disk_path)));
+  if (itr == g_latest_generations.end() || itr->second != generation)
+    return false;
+  g_latest_generations.erase(itr);
+  return true;
+}
+
+// Each thread obfuscates with its own cipher objects and reuses its own output buffer, so neither
+// is allocated per chunk.
+ChunkObfuscator& Obfuscator() {
+  static thread_local ChunkObfuscator obfuscator;
+  return obfuscator;
+}
+
+std::vector<byte>& ObfuscationBuffer() {
+  static thread_local std::vector<byte> buffer;
+  return buffer;
+}
+
+// Likewise for compression, whose framed output is kept separately from the obfuscated content.
+ChunkCompressor& Compressor() {
+  static thread_local ChunkCompressor compressor;
+  return compressor;
+}
+
+std::vector<byte>& CompressionBuffer() {
+  static thread_local std::vector<byte> buffer;
+  return buffer;
 }
 
 }  // unnamed namespace
 
-ChunkStore::ChunkStore(const fs::path& disk_path, DiskUsage max_disk_usage)
+const std::chrono::seconds ChunkStore::kMaintenanceInterval(std::chrono::minutes(5));
+const std::chrono::microseconds ChunkStore::kDefaultCommitWindow(2000);
+const std::chrono::seconds ChunkStore::kScrubInterval(std::chrono::hours(24));
+const std::chrono::milliseconds ChunkStore::kReclaimDelay(100);
+
+ChunkStore::ChunkStore(const fs::path& disk_path, DiskUsage max_disk_usage, Engine engine,
+                       Durability durability, Compression compression, CacheBypass cache_bypass,
+                       std::shared_ptr<DiskBudget::Account> disk_budget, Layout layout)
+    : ChunkStore(disk_path, max_disk_usage, FastTier{fs::path(), DiskUsage(0)}, engine, durability,
+                 compression, cache_bypass, std::move(disk_budget), layout) {}
+
+ChunkStore::ChunkStore(const fs::path& disk_path, DiskUsage max_disk_usage,
+                       const FastTier& fast_tier, Engine engine, Durability durability,
+                       Compression compression, CacheBypass cache_bypass,
+                       std::shared_ptr<DiskBudget::Account> disk_budget, Layout layout)
     : kDiskPath_(disk_path),
-      max_disk_usage_(std::move(max_disk_usage)),
-      current_disk_usage_(InitialiseDiskRoot(kDiskPath_)),
-      kDepth_(5),
-      mutex_() {
+      kInMemory_(engine == Engine::kMemory),
+      kCompression_(compression),
+      engine_(MakeEngine(kDiskPath_, max_disk_usage, fast_tier, engine, durability, cache_bypass,
+                         layout)),
+      index_(ChunkStoreEngine::MetadataDirectory(kDiskPath_)),
+      filter_(),
+      next_filter_(),
+      ledger_(ChunkStoreEngine::MetadataDirectory(kDiskPath_)),
+      max_disk_usage_(max_disk_usage.data + fast_tier.max_disk_usage.data),
+      current_disk_usage_(0),
+      disk_budget_(std::move(disk_budget)),
+      stripes_(),
+      maintenance_mutex_(),
+      maintenance_condition_(),
+      stopping_(false),
+      maintenance_thread_(),
+      async_mutex_(),
+      async_condition_(),
+      pending_async_(0),
+      scrub_mutex_(),
+      scrub_condition_(),
+      stop_scrubbing_(false),
+      scrub_stats_(),
+      scrub_thread_(),
+      reclaim_mutex_(),
+      reclaim_condition_(),
+      tombstones_(),
+      journal_(ChunkStoreEngine::MetadataDirectory(kDiskPath_)),
+      stop_reclaiming_(false),
+      reclaim_thread_(),
+      kGeneration_(RegisterOpenStore(kDiskPath_)) {
+  LOG(kInfo) << "Chunk obfuscation is "
+             << (ChunkObfuscator::HardwareAccelerated() ? "" : "not ") << "hardware accelerated";
+  engine_->Initialise();
+  RestoreState();
+  RebuildFilter();
   if (current_disk_usage_ > max_disk_usage_) {
     LOG(kError) << "current disk usage " << current_disk_usage_
                 << " is greater than max disk usage " << max_disk_usage_;
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
   }
+  if (disk_budget_)
+    disk_budget_->Charge(current_disk_usage_);
+  maintenance_thread_ = std::thread([this] { MaintenanceLoop(); });
+  reclaim_thread_ = std::thread([this] { ReclaimLoop(); });
 }
 
-ChunkStore::~ChunkStore() {}
+ChunkStore::~ChunkStore() {
+  StopScrubbing();
+  {
+    std::unique_lock<std::mutex> lock(async_mutex_);
+    async_condition_.wait(lock, [this] { return pending_async_ == 0; });
+  }
+  {
+    std::lock_guard<std::mutex> lock(maintenance_mutex_);
+    stopping_ = true;
+  }
+  maintenance_condition_.notify_one();
+  maintenance_thread_.join();
+  {
+    std::lock_guard<std::mutex> lock(reclaim_mutex_);
+    stop_reclaiming_ = true;
+  }
+  reclaim_condition_.notify_one();
+  reclaim_thread_.join();
+  Reclaim();
+  if (disk_budget_)
+    disk_budget_->Release(current_disk_usage_);
+
+  // The store may have been removed from under us, in which case there is nothing to record.
+  if (!UnregisterOpenStore(kDiskPath_, kGeneration_) || kInMemory_ || !Available())
+    return;
+  try {
+    engine_->SaveState();
+    index_.Save();
+    ledger_.Write(UsageLedger::Checkpoint{current_disk_usage_, index_.Count(), true});
+  } catch (const std::exception& e) {
+    LOG(kError) << "Failed to save state of " << kDiskPath_ << ": "
+                << boost::diagnostic_information(e);
+  }
+}
 
 void ChunkStore::Put(const NameType& name, const NonEmptyString& value) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (!fs::exists(kDiskPath_)) {
+  if (!Available()) {
     LOG(kError) << "ChunkStore::Put kDiskPath_ " << kDiskPath_ << " doesn't exists";
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
   }
 
-  const auto& name_str(name.name.string());
-  crypto::AES256KeyAndIV key_and_iv(std::vector<byte>(
-      name_str.begin(), name_str.begin() + crypto::AES256_KeySize + crypto::AES256_IVSize));
-  auto content(crypto::SymmEncrypt(value, key_and_iv));
-  auto file_path(NameToFilePath(name));
-  std::uint32_t value_size(static_cast<std::uint32_t>(content.data.string().size()));
-  std::uint64_t file_size(0), size(0);
-  bool increment(true);
-  boost::system::error_code error_code;
+  auto& content(ObfuscationBuffer());
+  Encode(name, value, content);
+  auto hashed_name(HashedName(name));
+  auto lock(LockIdle(hashed_name));
+  StoreLocked(name, hashed_name, content, 0);
+}
+
+std::vector<std::error_code> ChunkStore::PutMany(
+    const std::vector<std::pair<NameType, NonEmptyString>>& chunks) {
+  std::vector<std::error_code> results(chunks.size());
+  if (!Available()) {
+    LOG(kError) << "ChunkStore::PutMany kDiskPath_ " << kDiskPath_ << " doesn't exists";
+    std::fill(results.begin(), results.end(), make_error_code(CommonErrors::filesystem_io_error));
+    return results;
+  }
+
+  std::vector<NameType> hashed_names;
+  for (const auto& chunk : chunks)
+    hashed_names.push_back(HashedName(chunk.first));
+  auto order(HashedOrder(hashed_names));
 
-  if (fs::exists(file_path, error_code)) {
-    if (error_code) {
-      LOG(kError) << "Unable to determine file status for " << file_path << ": "
-                  << error_code.message();
-      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  // The stored sizes are bounded in advance, so space for the whole batch can be reserved at once
+  // (the excess being returned as each chunk is stored).  If it doesn't all fit, each chunk
+  // reserves its own space as it's stored instead.
+  std::vector<std::uint64_t> reserved(chunks.size());
+  std::uint64_t total_reserved(0);
+  for (std::size_t i(0); i != chunks.size(); ++i) {
+    std::uint64_t value_size(StoredSizeBound(chunks[i].second.string().size()));
+    std::uint64_t stored_size(index_.Size(hashed_names[i]));
+    reserved[i] = value_size > stored_size ? value_size - stored_size : 0;
+    total_reserved += reserved[i];
+  }
+  if (!ReserveDiskSpace(total_reserved))
+    std::fill(reserved.begin(), reserved.end(), 0);
+
+  // Chunks are obfuscated on a separate thread, at most kBatchLookahead ahead of the writes.
+  std::vector<std::vector<byte>> contents(chunks.size());
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::size_t obfuscated(0), written(0);
+  std::thread obfuscator([&] {
+    for (std::size_t k(0); k != order.size(); ++k) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&] { return k < written + kBatchLookahead; });
+      }
+      const auto& chunk(chunks[order[k]]);
+      try {
+        Encode(chunk.first, chunk.second, contents[k]);
+      } catch (const maidsafe_error& e) {
+        results[order[k]] = e.code();
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++obfuscated;
+      }
+      condition.notify_all();
     }
-    file_size = fs::file_size(file_path, error_code);
-    if (error_code) {
-      LOG(kError) << "Error getting file size of " << file_path << ": " << error_code.message();
-      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  });
+
+  for (std::size_t k(0); k != order.size(); ++k) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [&] { return k < obfuscated; });
     }
-  }
-  if (file_size != 0) {
-    if (file_size <= value_size) {
-      size = value_size - file_size;
+    std::size_t i(order[k]);
+    if (results[i]) {
+      ReleaseDiskSpace(reserved[i]);
     } else {
-      size = file_size - value_size;
-      increment = false;
+      try {
+        auto lock(LockIdle(hashed_names[i]));
+        StoreLocked(chunks[i].first, hashed_names[i], contents[k], reserved[i]);
+      } catch (const maidsafe_error& e) {
+        results[i] = e.code();
+      } catch (const std::exception&) {
+        results[i] = make_error_code(CommonErrors::filesystem_io_error);
+      }
     }
-  } else {
-    size = value_size;
+    std::vector<byte>().swap(contents[k]);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++written;
+    }
+    condition.notify_all();
   }
+  obfuscator.join();
+  return results;
+}
 
-  if (increment) {
-    if (!HasDiskSpace(size)) {
-      LOG(kError) << "Cannot store " << name.name << " since the addition of " << size
-                  << " bytes exceeds max of " << max_disk_usage_ << " bytes.";
-      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+void ChunkStore::Delete(const NameType& name) {
+  auto hashed_name(HashedName(name));
+  auto lock(LockIdle(hashed_name));
+  ReleaseDiskSpace(TombstoneLocked(hashed_name));
+}
+
+std::vector<std::error_code> ChunkStore::DeleteMany(const std::vector<NameType>& names) {
+  std::vector<std::error_code> results(names.size());
+  std::vector<NameType> hashed_names;
+  for (const auto& name : names)
+    hashed_names.push_back(HashedName(name));
+  std::uint64_t freed(0);
+  for (auto i : HashedOrder(hashed_names)) {
+    try {
+      auto lock(LockIdle(hashed_names[i]));
+      freed += TombstoneLocked(hashed_names[i]);
+    } catch (const maidsafe_error& e) {
+      results[i] = e.code();
+    } catch (const std::exception&) {
+      results[i] = make_error_code(CommonErrors::filesystem_io_error);
     }
   }
-  if (!WriteFile(file_path, content.data.string())) {
-    LOG(kError) << "Failed to write " << name.name << " to disk.";
-    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  ReleaseDiskSpace(freed);
+  return results;
+}
+
+NonEmptyString ChunkStore::Get(const NameType& name) const {
+  std::vector<byte> value;
+  Get(name, value);
+  return NonEmptyString(std::move(value));
+}
+
+void ChunkStore::Get(const NameType& name, std::vector<byte>& value) const {
+  auto error(Read(name, value));
+  if (error)
+    BOOST_THROW_EXCEPTION(maidsafe_error(error));
+}
+
+void ChunkStore::Get(const NameType& name, std::uint64_t offset, std::uint64_t length,
+                     std::vector<byte>& value) const {
+  auto error(Read(name, offset, length, value));
+  if (error)
+    BOOST_THROW_EXCEPTION(maidsafe_error(error));
+}
+
+ChunkStore::GetResult ChunkStore::TryGet(const NameType& name) const {
+  std::vector<byte> value;
+  auto error(Read(name, value));
+  if (error)
+    return boost::make_unexpected(maidsafe_error(error));
+  return GetResult(std::move(value));
+}
+
+ChunkStore::GetResult ChunkStore::TryGet(const NameType& name, std::uint64_t offset,
+                                         std::uint64_t length) const {
+  std::vector<byte> value;
+  auto error(Read(name, offset, length, value));
+  if (error)
+    return boost::make_unexpected(maidsafe_error(error));
+  return GetResult(std::move(value));
+}
+
+std::vector<std::error_code> ChunkStore::GetMany(const std::vector<NameType>& names,
+                                                 std::vector<std::vector<byte>>& values) const {
+  std::vector<std::error_code> results(names.size());
+  values.resize(names.size());
+  std::vector<NameType> hashed_names;
+  for (const auto& name : names)
+    hashed_names.push_back(HashedName(name));
+  for (auto i : HashedOrder(hashed_names))
+    results[i] = Read(names[i], values[i]);
+  return results;
+}
+
+void ChunkStore::PutAsync(const NameType& name, const NonEmptyString& value,
+                          Completion handler) {
+  if (!Available()) {
+    LOG(kError) << "ChunkStore::PutAsync kDiskPath_ " << kDiskPath_ << " doesn't exists";
+    return handler(make_error_code(CommonErrors::filesystem_io_error));
+  }
+  auto content(std::make_shared<std::vector<byte>>());
+  try {
+    Encode(name, value, *content);
+  } catch (const maidsafe_error& e) {
+    return handler(e.code());
   }
+  auto hashed_name(HashedName(name));
+  BeginAsync(hashed_name, [=] {
+    std::uint64_t value_size(content->size()), stored_size(0), reserved(0);
+    bool exceeded(false);
+    {
+      std::lock_guard<Stripe> lock(StripeFor(hashed_name));
+      stored_size = index_.Size(hashed_name);
+      reserved = value_size > stored_size ? value_size - stored_size : 0;
+      exceeded = reserved != 0 && !ReserveDiskSpace(reserved);
+    }
+    if (exceeded) {
+      LOG(kError) << "Cannot store " << name.name << " since the addition of " << reserved
+                  << " bytes exceeds max of " << max_disk_usage_ << " bytes.";
+      return EndAsync(hashed_name,
+                      [&] { handler(make_error_code(CommonErrors::cannot_exceed_limit)); });
+    }
+    auto on_written([=](std::error_code error) {
+      {
+        std::lock_guard<Stripe> lock(StripeFor(hashed_name));
+        if (!error) {
+          try {
+            ClearTombstone(hashed_name);
+          } catch (const maidsafe_error& e) {
+            error = e.code();
+          } catch (const std::exception&) {
+            error = make_error_code(CommonErrors::filesystem_io_error);
+          }
+        }
+        if (error) {
+          ReleaseDiskSpace(reserved);
+        } else {
+          index_.Put(hashed_name, value_size);
+          AddToFilter(hashed_name);
+          if (stored_size > value_size)
+            ReleaseDiskSpace(stored_size - value_size);
+        }
+      }
+      // 'content' is captured to keep it alive until the write has completed.
+      EndAsync(hashed_name, [&] {
+        content->clear();
+        handler(error);
+      });
+    });
+    engine_->PutAsync(hashed_name, *content, on_written);
+  });
+}
 
-  if (increment) {
-    current_disk_usage_.data += size;
-  } else {
-    current_disk_usage_.data -= size;
+void ChunkStore::GetAsync(const NameType& name, GetCompletion handler) const {
+  auto hashed_name(HashedName(name));
+  if (!MayHold(hashed_name))
+    return handler(make_error_code(CommonErrors::no_such_element), std::vector<byte>());
+  BeginAsync(hashed_name, [=] {
+    std::uint64_t stored_size(0);
+    {
+      std::lock_guard<Stripe> lock(StripeFor(hashed_name));
+      stored_size = index_.Size(hashed_name);
+    }
+    if (stored_size == 0) {
+      return EndAsync(hashed_name, [&] {
+        handler(make_error_code(CommonErrors::no_such_element), std::vector<byte>());
+      });
+    }
+    engine_->GetAsync(hashed_name, stored_size,
+                      [=](std::error_code error, std::vector<byte> content) {
+      EndAsync(hashed_name, [&] {
+        std::vector<byte> value;
+        if (!error) {
+          try {
+            Decode(name, content.data(), content.size(), value);
+          } catch (const maidsafe_error& e) {
+            error = e.code();
+          }
+        }
+        handler(error, std::move(value));
+      });
+    });
+  });
+}
+
+void ChunkStore::DeleteAsync(const NameType& name, Completion handler) {
+  auto hashed_name(HashedName(name));
+  BeginAsync(hashed_name, [=] {
+    std::error_code error;
+    try {
+      std::lock_guard<Stripe> lock(StripeFor(hashed_name));
+      ReleaseDiskSpace(TombstoneLocked(hashed_name));
+    } catch (const maidsafe_error& e) {
+      error = e.code();
+    } catch (const std::exception&) {
+      error = make_error_code(CommonErrors::filesystem_io_error);
+    }
+    EndAsync(hashed_name, [&] { handler(error); });
+  });
+}
+
+void ChunkStore::StartScrubbing(NameSource names, std::uint64_t bytes_per_second,
+                                CorruptionHandler on_corrupt, ContentValidator validate) {
+  if (bytes_per_second == 0) {
+    LOG(kError) << "Scrubbing rate must be non-zero";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
   }
+  StopScrubbing();
+  std::lock_guard<std::mutex> lock(scrub_mutex_);
+  stop_scrubbing_ = false;
+  scrub_thread_ =
+      std::thread([=] { ScrubLoop(names, bytes_per_second, on_corrupt, validate); });
 }
 
-void ChunkStore::Delete(const NameType& name) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  auto path(NameToFilePath(name));
-  boost::system::error_code error_code;
-  std::uint64_t file_size(fs::file_size(path, error_code));
-  if (error_code) {
-    LOG(kError) << "Error getting file size of " << path << ": " << error_code.message();
-    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+void ChunkStore::StopScrubbing() {
+  {
+    std::lock_guard<std::mutex> lock(scrub_mutex_);
+    stop_scrubbing_ = true;
   }
-  if (!fs::remove(path, error_code) || error_code) {
-    LOG(kError) << "Error removing " << path << ": " << error_code.message();
-    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  scrub_condition_.notify_one();
+  if (scrub_thread_.joinable())
+    scrub_thread_.join();
+}
+
+ChunkStore::ScrubStats ChunkStore::GetScrubStats() const {
+  std::lock_guard<std::mutex> lock(scrub_mutex_);
+  return scrub_stats_;
+}
+
+void ChunkStore::Reclaim() {
+  while (ReclaimBatch() != 0) {
   }
-  current_disk_usage_.data -= file_size;
 }
 
-NonEmptyString ChunkStore::Get(const NameType& name) const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  auto content(ReadFile(NameToFilePath(name)));
-  if (!content)
-    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
-  try {
-    const auto& name_str(name.name.string());
-    crypto::AES256KeyAndIV key_and_iv(std::vector<byte>(
-        name_str.begin(), name_str.begin() + crypto::AES256_KeySize + crypto::AES256_IVSize));
-    return crypto::SymmDecrypt(crypto::CipherText(NonEmptyString(*content)), key_and_iv);
-  } catch (const std::exception&) {
-    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+std::size_t ChunkStore::PendingReclaims() const {
+  std::lock_guard<std::mutex> lock(reclaim_mutex_);
+  return tombstones_.size();
+}
+
+void ChunkStore::Import(ChunkStore& source) {
+  if ((kCompression_ == Compression::kNone) != (source.kCompression_ == Compression::kNone)) {
+    LOG(kError) << "Cannot import " << source.kDiskPath_ << " into " << kDiskPath_
+                << " since only one of them compresses chunks";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
   }
+  // Names are in hashed-name order, which is also on-disk directory order for both stores.
+  std::size_t imported(0), skipped(0);
+  NameCursor cursor(source, NameFilter());
+  while (!cursor.Done()) {
+    for (const auto& hashed_name : cursor.Next(kImportBatch)) {
+      auto source_lock(source.LockIdle(hashed_name));
+      if (!source.Holds(hashed_name))
+        continue;
+      auto lock(LockIdle(hashed_name));
+      if (!Holds(hashed_name)) {
+        std::vector<byte> content;
+        try {
+          content = source.engine_->Get(hashed_name);
+        } catch (const std::exception& e) {
+          LOG(kWarning) << "Failed to read " << hashed_name.name << " from " << source.kDiskPath_
+                        << ": " << boost::diagnostic_information(e);
+          ++skipped;
+          continue;
+        }
+        StoreLocked(hashed_name, hashed_name, content, 0);
+        ++imported;
+      }
+      source.ReleaseDiskSpace(source.TombstoneLocked(hashed_name));
+    }
+  }
+  LOG(kInfo) << "Imported " << imported << " chunks from " << source.kDiskPath_ << " into "
+             << kDiskPath_;
+  if (skipped != 0)
+    LOG(kWarning) << skipped << " unreadable chunks were left in " << source.kDiskPath_;
 }
 
 void ChunkStore::SetMaxDiskUsage(DiskUsage max_disk_usage) {
-  if (current_disk_usage_ > max_disk_usage) {
-    LOG(kError) << "current_disk_usage_ " << current_disk_usage_.data
+  if (current_disk_usage_ > max_disk_usage.data) {
+    LOG(kError) << "current_disk_usage_ " << current_disk_usage_
                 << " exceeds target max_disk_usage " << max_disk_usage.data;
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
   }
-  max_disk_usage_ = max_disk_usage;
+  max_disk_usage_ = max_disk_usage.data;
+}
+
+bool ChunkStore::Has(const NameType& name) const {
+  return Holds(HashedName(name));
+}
+
+std::uint64_t ChunkStore::StoredSize(const NameType& name) const {
+  return index_.Size(HashedName(name));
 }
 
 std::vector<ChunkStore::NameType> ChunkStore::Names() const {
+  return index_.Names();
+}
+
+ChunkStore::NameCursor::NameCursor(const ChunkStore& chunk_store, NameFilter filter,
+                                   const std::vector<byte>& token)
+    : index_(chunk_store.index_), kFilter_(std::move(filter)), last_(), done_(false) {
+  if (token.empty())
+    return;
+  if (token.size() != identity_size + 4) {
+    LOG(kError) << "Malformed name cursor token of " << token.size() << " bytes";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  last_ = NameType(Identity(std::vector<byte>(token.begin(), token.begin() + identity_size)),
+                   DataTypeId(detail::GetLittleEndian<std::uint32_t>(&token[identity_size])));
+}
+
+std::vector<ChunkStore::NameType> ChunkStore::NameCursor::Next(std::size_t max_count) {
+  if (done_ || max_count == 0)
+    return std::vector<NameType>();
+  auto names(index_.NamesAfter(last_, max_count, kFilter_));
+  done_ = names.size() < max_count;
+  if (!names.empty())
+    last_ = names.back();
+  return names;
+}
+
+std::vector<byte> ChunkStore::NameCursor::Token() const {
+  if (!last_)
+    return std::vector<byte>();
+  std::vector<byte> token(last_->name.string());
+  token.resize(identity_size + 4);
+  detail::PutLittleEndian(last_->type_id.data, &token[identity_size]);
+  return token;
+}
+
+std::error_code ChunkStore::Read(const NameType& name, std::vector<byte>& value) const {
+  auto hashed_name(HashedName(name));
+  if (!Holds(hashed_name)) {
+    value.clear();
+    return make_error_code(CommonErrors::no_such_element);
+  }
+  // The stripe lock is held while decrypting, since the engine's view of the content is only
+  // stable until a Put or Delete of the same chunk.
+  auto lock(LockIdle(hashed_name));
+  try {
+    engine_->Read(hashed_name, [&](const byte* data, std::size_t size) {
+      Decode(name, data, size, value);
+    });
+    return std::error_code();
+  } catch (const maidsafe_error& e) {
+    value.clear();
+    return e.code();
+  } catch (const std::exception&) {
+    value.clear();
+    return make_error_code(CommonErrors::no_such_element);
+  }
+}
+
+std::error_code ChunkStore::Read(const NameType& name, std::uint64_t offset, std::uint64_t length,
+                                 std::vector<byte>& value) const {
+  if (kCompression_ != Compression::kNone) {
+    auto error(Read(name, value));
+    if (error)
+      return error;
+    if (offset > value.size()) {
+      value.clear();
+      return make_error_code(CommonErrors::invalid_argument);
+    }
+    value.erase(value.begin(), value.begin() + static_cast<std::ptrdiff_t>(offset));
+    if (value.size() > length)
+      value.resize(static_cast<std::size_t>(length));
+    return std::error_code();
+  }
+  auto hashed_name(HashedName(name));
+  if (!Holds(hashed_name)) {
+    value.clear();
+    return make_error_code(CommonErrors::no_such_element);
+  }
+  auto lock(LockIdle(hashed_name));
+  try {
+    engine_->Read(hashed_name, [&](const byte* data, std::size_t size) {
+      try {
+        Obfuscator().DeobfuscateRange(name.name, data, size, offset, length, value);
+      } catch (const maidsafe_error& e) {
+        if (e.code() == make_error_code(CommonErrors::invalid_argument))
+          throw;
+        BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+      }
+    });
+    return std::error_code();
+  } catch (const maidsafe_error& e) {
+    value.clear();
+    return e.code();
+  } catch (const std::exception&) {
+    value.clear();
+    return make_error_code(CommonErrors::no_such_element);
+  }
+}
+
+bool ChunkStore::Available() const {
+  boost::system::error_code error_code;
+  return kInMemory_ || fs::exists(kDiskPath_, error_code);
+}
+
+void ChunkStore::RestoreState() {
+  // An in-memory store always starts empty.
+  if (kInMemory_)
+    return;
+  auto checkpoint(ledger_.Take());
+  bool index_loaded(index_.Load());
+  bool clean(index_loaded && checkpoint && checkpoint->clean &&
+             checkpoint->chunk_count == index_.Count());
+  if (clean) {
+    current_disk_usage_ = checkpoint->disk_usage;
+  } else {
+    LOG(kInfo) << kDiskPath_ << " wasn't shut down cleanly; rescanning";
+    auto chunks(engine_->Scan());
+    index_.Rebuild(chunks);
+    std::uint64_t disk_usage(0);
+    for (const auto& chunk : chunks)
+      disk_usage += chunk.size;
+    current_disk_usage_ = disk_usage;
+  }
+
+  // Tombstoned chunks are never in a saved index, but a rescan finds those which hadn't been
+  // reclaimed.  Their space was released when they were deleted, so they're discounted again.
+  // Conversely, a tombstone which the rescan didn't find was reclaimed before the journal caught
+  // up, and is dropped.
+  auto tombstones(journal_.Load());
+  std::uint64_t record_count(journal_.RecordCount());
+  for (const auto& hashed_name : tombstones) {
+    std::uint64_t stored_size(index_.Size(hashed_name));
+    if (stored_size != 0) {
+      index_.Delete(hashed_name);
+      current_disk_usage_ -= stored_size;
+    }
+    if (clean || stored_size != 0)
+      tombstones_.insert(hashed_name);
+  }
+  if (record_count != tombstones_.size())
+    journal_.Rewrite(tombstones_);
+  if (!clean && checkpoint && checkpoint->disk_usage != current_disk_usage_) {
+    LOG(kWarning) << "Disk usage of " << kDiskPath_ << " is " << current_disk_usage_
+                  << " bytes; last checkpoint recorded " << checkpoint->disk_usage;
+  }
+}
+
+void ChunkStore::RebuildFilter() {
+  const std::size_t kPageSize(4096);
+  auto filter(std::make_shared<BloomFilter>(2 * index_.Count()));
+  std::atomic_store(&next_filter_, filter);
+  boost::optional<NameType> last;
   std::vector<NameType> names;
-  fs::directory_iterator end_iter;
-
-  if (fs::exists(kDiskPath_) && fs::is_directory(kDiskPath_)) {
-    for (fs::directory_iterator dir_iter(kDiskPath_); dir_iter != end_iter; ++dir_iter) {
-      if (fs::is_regular_file(dir_iter->status()))
-        names.push_back(detail::GetDataNameAndTypeId(*dir_iter));
-      else
-        GetNames(dir_iter->path(), dir_iter->path().filename().string(), names);
+  do {
+    names = index_.NamesAfter(last, kPageSize, ChunkIndex::Filter());
+    for (const auto& name : names)
+      filter->Add(name);
+    if (!names.empty())
+      last = names.back();
+  } while (names.size() == kPageSize);
+  std::atomic_store(&filter_, filter);
+  std::atomic_store(&next_filter_, std::shared_ptr<BloomFilter>());
+}
+
+void ChunkStore::AddToFilter(const NameType& hashed_name) {
+  // The replacement is loaded first: if none is seen, any rebuild either starts after the index
+  // was updated, so will find the name there, or has already installed its filter as 'filter_'.
+  auto next_filter(std::atomic_load(&next_filter_));
+  std::atomic_load(&filter_)->Add(hashed_name);
+  if (next_filter)
+    next_filter->Add(hashed_name);
+}
+
+bool ChunkStore::MayHold(const NameType& hashed_name) const {
+  return std::atomic_load(&filter_)->MayContain(hashed_name);
+}
+
+bool ChunkStore::Holds(const NameType& hashed_name) const {
+  return MayHold(hashed_name) && index_.Has(hashed_name);
+}
+
+void ChunkStore::MaintenanceLoop() {
+  std::unique_lock<std::mutex> lock(maintenance_mutex_);
+  while (!maintenance_condition_.wait_for(lock, kMaintenanceInterval,
+                                          [this] { return stopping_; })) {
+    // Deleted names stay in the filter until a rebuild, but only cost an index lookup.
+    if (std::atomic_load(&filter_)->Full())
+      RebuildFilter();
+  }
+}
+
+std::uint64_t ChunkStore::TombstoneLocked(const NameType& hashed_name) {
+  std::uint64_t stored_size(index_.Size(hashed_name));
+  if (stored_size == 0) {
+    LOG(kWarning) << "Cannot delete " << hashed_name.name << " since it isn't held";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  }
+  {
+    std::lock_guard<std::mutex> lock(reclaim_mutex_);
+    if (!kInMemory_)
+      journal_.Tombstone(hashed_name);
+    tombstones_.insert(hashed_name);
+  }
+  reclaim_condition_.notify_one();
+  index_.Delete(hashed_name);
+  return stored_size;
+}
+
+void ChunkStore::ClearTombstone(const NameType& hashed_name) {
+  std::lock_guard<std::mutex> lock(reclaim_mutex_);
+  auto itr(tombstones_.find(hashed_name));
+  if (itr == tombstones_.end())
+    return;
+  if (!kInMemory_)
+    journal_.Reinstate(hashed_name);
+  tombstones_.erase(itr);
+}
+
+std::size_t ChunkStore::ReclaimBatch() {
+  std::vector<NameType> batch;
+  {
+    std::lock_guard<std::mutex> lock(reclaim_mutex_);
+    for (auto itr(tombstones_.begin());
+         itr != tombstones_.end() && batch.size() != kReclaimBatch; ++itr) {
+      batch.push_back(*itr);
     }
   }
-  return names;
+  // The batch is in hashed-name order, which is also on-disk directory order.
+  std::size_t reclaimed(0);
+  for (const auto& hashed_name : batch) {
+    auto stripe_lock(LockIdle(hashed_name));
+    {
+      // The chunk may have been stored again, or reclaimed by a concurrent call, since the batch
+      // was taken.
+      std::lock_guard<std::mutex> lock(reclaim_mutex_);
+      if (tombstones_.count(hashed_name) == 0)
+        continue;
+    }
+    try {
+      engine_->Delete(hashed_name);
+    } catch (const std::exception& e) {
+      LOG(kWarning) << "Failed to reclaim " << hashed_name.name << " from " << kDiskPath_ << ": "
+                    << boost::diagnostic_information(e);
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(reclaim_mutex_);
+    tombstones_.erase(hashed_name);
+    ++reclaimed;
+  }
+
+  // The journal is removed once nothing is pending, and otherwise compacted when it has grown
+  // well beyond what is pending.
+  if (kInMemory_ || reclaimed == 0)
+    return reclaimed;
+  std::lock_guard<std::mutex> lock(reclaim_mutex_);
+  if (tombstones_.empty() || journal_.RecordCount() > 2 * tombstones_.size() + kReclaimBatch) {
+    try {
+      journal_.Rewrite(tombstones_);
+    } catch (const std::exception& e) {
+      LOG(kWarning) << "Failed to compact tombstone journal of " << kDiskPath_ << ": "
+                    << boost::diagnostic_information(e);
+    }
+  }
+  return reclaimed;
+}
+
+void ChunkStore::ReclaimLoop() {
+  // Tombstones which couldn't be reclaimed are retried when further chunks are deleted, or
+  // otherwise after kMaintenanceInterval.
+  std::size_t unreclaimed(0);
+  std::unique_lock<std::mutex> lock(reclaim_mutex_);
+  for (;;) {
+    reclaim_condition_.wait_for(lock, kMaintenanceInterval, [&] {
+      return stop_reclaiming_ || tombstones_.size() > unreclaimed;
+    });
+    // The destructor reclaims whatever is left.
+    if (stop_reclaiming_)
+      return;
+    if (tombstones_.empty())
+      continue;
+    // Deletes tend to come in bursts, which are gathered into batches.
+    if (reclaim_condition_.wait_for(lock, kReclaimDelay, [this] { return stop_reclaiming_; }))
+      return;
+    lock.unlock();
+    Reclaim();
+    lock.lock();
+    unreclaimed = tombstones_.size();
+  }
+}
+
+void ChunkStore::ScrubLoop(const NameSource& names, std::uint64_t bytes_per_second,
+                           const CorruptionHandler& on_corrupt,
+                           const ContentValidator& validate) {
+  auto stopping([this] { return stop_scrubbing_; });
+  std::vector<byte> value;
+  std::unique_lock<std::mutex> lock(scrub_mutex_);
+  do {
+    lock.unlock();
+    std::vector<NameType> pass_names;
+    try {
+      pass_names = names();
+    } catch (const std::exception& e) {
+      LOG(kWarning) << "Failed to list chunks to scrub: " << boost::diagnostic_information(e);
+    }
+    auto start(std::chrono::steady_clock::now());
+    std::uint64_t pass_bytes(0);
+    lock.lock();
+    for (const auto& name : pass_names) {
+      // Wait until the bytes read so far this pass are within the budget.
+      auto resume(start + std::chrono::microseconds(pass_bytes * 1000000 / bytes_per_second));
+      if (scrub_condition_.wait_until(lock, resume, stopping))
+        return;
+      lock.unlock();
+      std::uint64_t size(StoredSize(name));
+      bool corrupt(false);
+      if (size != 0) {
+        try {
+          Get(name, value);
+          corrupt = validate && !validate(name, value) && Has(name);
+        } catch (const std::exception&) {
+          // A chunk deleted since it was listed isn't corrupt.
+          corrupt = Has(name);
+        }
+      }
+      if (corrupt) {
+        LOG(kWarning) << "Chunk " << name.name << " in " << kDiskPath_ << " is corrupt";
+        try {
+          on_corrupt(name);
+        } catch (const std::exception& e) {
+          LOG(kError) << "Corruption handler failed: " << boost::diagnostic_information(e);
+        }
+      }
+      lock.lock();
+      if (size != 0) {
+        ++scrub_stats_.chunks;
+        scrub_stats_.bytes += size;
+      }
+      if (corrupt)
+        ++scrub_stats_.corrupt;
+      pass_bytes += size;
+    }
+    ++scrub_stats_.passes;
+  } while (!scrub_condition_.wait_for(lock, kScrubInterval, stopping));
 }
 
-void ChunkStore::GetNames(const boost::filesystem::path& path, std::string prefix,
-                          std::vector<NameType>& names) const {
-  fs::directory_iterator end_iter;
-  for (fs::directory_iterator dir_iter(path); dir_iter != end_iter; ++dir_iter) {
-    if (fs::is_regular_file(dir_iter->status()))
-      names.push_back(ComposeName(prefix + dir_iter->path().filename().string()));
-    else
-      GetNames(dir_iter->path(), prefix + dir_iter->path().filename().string(), names);
+void ChunkStore::StoreLocked(const NameType& name, const NameType& hashed_name,
+                             const std::vector<byte>& content, std::uint64_t reserved) {
+  std::uint64_t value_size(content.size());
+  std::uint64_t stored_size(index_.Size(hashed_name));
+  std::uint64_t required(value_size > stored_size ? value_size - stored_size : 0);
+  if (required > reserved) {
+    if (!ReserveDiskSpace(required - reserved)) {
+      ReleaseDiskSpace(reserved);
+      LOG(kError) << "Cannot store " << name.name << " since the addition of " << required
+                  << " bytes exceeds max of " << max_disk_usage_ << " bytes.";
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+    }
+  } else {
+    ReleaseDiskSpace(reserved - required);
   }
+  try {
+    engine_->Put(hashed_name, content);
+    ClearTombstone(hashed_name);
+  } catch (const std::exception&) {
+    ReleaseDiskSpace(required);
+    throw;
+  }
+  index_.Put(hashed_name, value_size);
+  AddToFilter(hashed_name);
+  if (stored_size > value_size)
+    ReleaseDiskSpace(stored_size - value_size);
 }
 
-ChunkStore::NameType ChunkStore::ComposeName(std::string file_name_str) const {
-  size_t index(file_name_str.rfind('_'));
-  auto type(static_cast<DataTypeId>(std::stoul(file_name_str.substr(index + 1))));
-  Identity id(hex::DecodeToBytes(file_name_str.substr(0, index)));
-  return NameType(id, type);
+void ChunkStore::Encode(const NameType& name, const NonEmptyString& value,
+                        std::vector<byte>& content) const {
+  const auto& plain_text(value.string());
+  if (kCompression_ == Compression::kNone)
+    return Obfuscator().ObfuscateSeekable(name.name, plain_text.data(), plain_text.size(), content);
+  auto& framed(CompressionBuffer());
+  Compressor().Compress(kCompression_ == Compression::kFast ? ChunkCompressor::Level::kFast
+                                                            : ChunkCompressor::Level::kBest,
+                        plain_text.data(), plain_text.size(), framed);
+  Obfuscator().ObfuscateSeekable(name.name, framed.data(), framed.size(), content);
 }
 
-bool ChunkStore::HasDiskSpace(std::uint64_t required_space) const {
-  return current_disk_usage_ + required_space <= max_disk_usage_;
+void ChunkStore::Decode(const NameType& name, const byte* data, std::size_t size,
+                        std::vector<byte>& value) const {
+  try {
+    if (kCompression_ == Compression::kNone)
+      return Obfuscator().Deobfuscate(name.name, data, size, value);
+    auto& framed(CompressionBuffer());
+    Obfuscator().Deobfuscate(name.name, data, size, framed);
+    Compressor().Decompress(framed.data(), framed.size(), value);
+  } catch (const std::exception&) {
+    value.clear();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  }
 }
 
-fs::path ChunkStore::NameToFilePath(NameType name) const {
+std::uint64_t ChunkStore::StoredSizeBound(std::uint64_t value_size) const {
+  return ChunkObfuscator::SeekableSize(
+      value_size + (kCompression_ == Compression::kNone ? 0 : ChunkCompressor::kMaxOverhead));
+}
+
+std::vector<std::size_t> ChunkStore::HashedOrder(const std::vector<NameType>& hashed_names) {
+  std::vector<std::size_t> order(hashed_names.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](std::size_t lhs, std::size_t rhs) {
+    return hashed_names[lhs] < hashed_names[rhs];
+  });
+  return order;
+}
+
+bool ChunkStore::ReserveDiskSpace(std::uint64_t required_space) {
+  std::uint64_t current(current_disk_usage_);
+  do {
+    if (current + required_space > max_disk_usage_)
+      return false;
+  } while (!current_disk_usage_.compare_exchange_weak(current, current + required_space));
+  if (disk_budget_ && required_space != 0 && !disk_budget_->Reserve(required_space)) {
+    current_disk_usage_ -= required_space;
+    return false;
+  }
+  return true;
+}
+
+void ChunkStore::ReleaseDiskSpace(std::uint64_t space) {
+  current_disk_usage_ -= space;
+  if (disk_budget_ && space != 0)
+    disk_budget_->Release(space);
+}
+
+ChunkStore::NameType ChunkStore::HashedName(NameType name) const {
   name.name = crypto::Hash<crypto::SHA512>(name.name);
-  std::string file_name(detail::GetFileName(name).string());
+  return name;
+}
 
-  std::uint32_t directory_depth = kDepth_;
-  if (file_name.size() < directory_depth)
-    directory_depth = static_cast<std::uint32_t>(file_name.size() - 1);
+ChunkStore::Stripe& ChunkStore::StripeFor(const NameType& hashed_name) const {
+  const auto& hash(hashed_name.name.string());
+  return stripes_[((static_cast<std::size_t>(static_cast<byte>(hash[0])) << 8) |
+                   static_cast<byte>(hash[1])) % kLockStripes];
+}
 
-  fs::path disk_path(kDiskPath_);
-  for (std::uint32_t i = 0; i < directory_depth; ++i)
-    disk_path /= file_name.substr(i, 1);
+std::unique_lock<ChunkStore::Stripe> ChunkStore::LockIdle(const NameType& hashed_name) const {
+  Stripe& stripe(StripeFor(hashed_name));
+  std::unique_lock<Stripe> lock(stripe);
+  stripe.WaitIdle(hashed_name);
+  return lock;
+}
 
-  boost::system::error_code ec;
-  fs::create_directories(disk_path, ec);
+void ChunkStore::BeginAsync(const NameType& hashed_name, std::function<void()> start) const {
+  {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    ++pending_async_;
+  }
+  {
+    Stripe& stripe(StripeFor(hashed_name));
+    std::lock_guard<Stripe> lock(stripe);
+    if (!stripe.TryEnter(hashed_name))
+      return stripe.Queue(hashed_name, std::move(start));
+  }
+  start();
+}
 
-  return fs::path(disk_path / file_name.substr(directory_depth));
+void ChunkStore::EndAsync(const NameType& hashed_name,
+                          const std::function<void()>& complete) const {
+  std::function<void()> next;
+  {
+    Stripe& stripe(StripeFor(hashed_name));
+    std::lock_guard<Stripe> lock(stripe);
+    next = stripe.Leave(hashed_name);
+  }
+  try {
+    complete();
+  } catch (const std::exception& e) {
+    LOG(kError) << "ChunkStore completion handler threw: " << boost::diagnostic_information(e);
+  }
+  // The next operation was counted as pending when it was submitted, so the store outlives it.
+  if (next)
+    next();
+  std::lock_guard<std::mutex> lock(async_mutex_);
+  if (--pending_async_ == 0)
+    async_condition_.notify_all();
+}
+
+void ChunkStore::Stripe::lock() { mutex_.lock(); }
+
+void ChunkStore::Stripe::unlock() { mutex_.unlock(); }
+
+void ChunkStore::Stripe::WaitIdle(const NameType& hashed_name) {
+  std::unique_lock<std::mutex> lock(mutex_, std::adopt_lock);
+  idle_.wait(lock, [&] { return busy_.count(hashed_name) == 0; });
+  lock.release();
+}
+
+bool ChunkStore::Stripe::TryEnter(const NameType& hashed_name) {
+  return busy_.emplace(hashed_name, std::deque<std::function<void()>>()).second;
+}
+
+void ChunkStore::Stripe::Queue(const NameType& hashed_name, std::function<void()> start) {
+  busy_[hashed_name].push_back(std::move(start));
+}
+
+std::function<void()> ChunkStore::Stripe::Leave(const NameType& hashed_name) {
+  auto itr(busy_.find(hashed_name));
+  if (itr == busy_.end())
+    return std::function<void()>();
+  if (itr->second.empty()) {
+    busy_.erase(itr);
+    idle_.notify_all();
+    return std::function<void()>();
+  }
+  auto next(std::move(itr->second.front()));
+  itr->second.pop_front();
+  return next;
 }
 
 }  // namespace vault
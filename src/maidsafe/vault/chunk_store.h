@@ -19,10 +19,21 @@
 #ifndef MAIDSAFE_VAULT_CHUNK_STORE_H_
 #define MAIDSAFE_VAULT_CHUNK_STORE_H_
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <functional>
 #include <set>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "boost/filesystem/path.hpp"
@@ -37,6 +48,14 @@
 #include "maidsafe/common/data_types/mutable_data.h"
 #include "maidsafe/passport/types.h"
 
+#include "maidsafe/vault/bloom_filter.h"
+#include "maidsafe/vault/chunk_index.h"
+#include "maidsafe/vault/chunk_store_engine.h"
+#include "maidsafe/vault/disk_budget.h"
+#include "maidsafe/vault/file_chunk_engine.h"
+#include "maidsafe/vault/tombstone_journal.h"
+#include "maidsafe/vault/usage_ledger.h"
+
 
 namespace maidsafe {
 
@@ -46,7 +65,62 @@ class ChunkStore {
  public:
   using NameType = Data::NameAndTypeId;
 
-  ChunkStore(const boost::filesystem::path& disk_path, DiskUsage max_disk_usage);
+  // kFilePerChunk writes every chunk to its own file; kPackFile appends chunks to large segment
+  // files which are compacted in the background.  The two on-disk formats are not interchangeable.
+  // kMemory holds chunks in memory only (see MemoryChunkEngine), under the same quota: nothing is
+  // read from or written to 'disk_path', which only names the store, and the durability setting
+  // has no effect.  Its content is lost when the store is destroyed.
+  enum class Engine { kFilePerChunk, kPackFile, kMemory };
+  // kBuffered leaves writes in the OS page cache, so a Put which has returned can be lost if the
+  // machine crashes.  kGroupCommit makes every Put, PutAsync and PutMany durable before it returns
+  // (or before its handler runs): writes arriving within 'commit_window' of each other share a
+  // single flush, trading up to that much latency for far fewer flushes than syncing each write
+  // alone.  kBuffered ignores the window.  A Mode converts to a Durability with the default window.
+  static const std::chrono::microseconds kDefaultCommitWindow;
+  struct Durability {
+    enum Mode { kBuffered, kGroupCommit };
+    Durability(Mode mode_in = kBuffered,
+               std::chrono::microseconds commit_window_in = kDefaultCommitWindow)
+        : mode(mode_in), commit_window(commit_window_in) {}
+    Mode mode;
+    std::chrono::microseconds commit_window;
+  };
+  // Chunks are compressed before obfuscation unless this is kNone; kFast favours speed and kBest
+  // favours ratio.  Usage is charged at the compressed size.  Content which doesn't compress is
+  // stored as is, at a cost of one byte per chunk.  Compressed chunks are framed, so a store must
+  // always be opened with compression either off or on (the level may change).
+  enum class Compression { kNone, kFast, kBest };
+  // A directory on faster storage (e.g. an SSD) holding new and frequently read chunks, while
+  // 'disk_path' holds the rest (see TieredChunkEngine).  Each has its own limit, and the store's
+  // limit is their sum.  Both use the same engine and the same settings.
+  struct FastTier {
+    boost::filesystem::path path;
+    DiskUsage max_disk_usage;
+  };
+  // Lets large chunks bypass the OS page cache, so that they don't evict the small, frequently
+  // read ones.  Only the file-per-chunk engine supports this; see FileChunkEngine::CacheBypass.
+  using CacheBypass = FileChunkEngine::CacheBypass;
+  // The fan-out of the file-per-chunk engine's directories, which is migrated in the background if
+  // the store was written with a different one; see FileChunkEngine::Layout.  Other engines ignore
+  // it.
+  using Layout = FileChunkEngine::Layout;
+
+  // If 'disk_budget' is given, space is reserved from it as well as within 'max_disk_usage', and
+  // it's charged with the store's existing usage on opening (see DiskBudget).
+  ChunkStore(const boost::filesystem::path& disk_path, DiskUsage max_disk_usage,
+             Engine engine = Engine::kFilePerChunk,
+             Durability durability = Durability::kBuffered,
+             Compression compression = Compression::kNone,
+             CacheBypass cache_bypass = CacheBypass{CacheBypass::Mode::kNone, 0},
+             std::shared_ptr<DiskBudget::Account> disk_budget = nullptr,
+             Layout layout = Layout{5, 1});
+  ChunkStore(const boost::filesystem::path& disk_path, DiskUsage max_disk_usage,
+             const FastTier& fast_tier, Engine engine = Engine::kFilePerChunk,
+             Durability durability = Durability::kBuffered,
+             Compression compression = Compression::kNone,
+             CacheBypass cache_bypass = CacheBypass{CacheBypass::Mode::kNone, 0},
+             std::shared_ptr<DiskBudget::Account> disk_budget = nullptr,
+             Layout layout = Layout{5, 1});
   ~ChunkStore();
   ChunkStore(const ChunkStore&) = delete;
   ChunkStore(ChunkStore&&) = delete;
@@ -54,27 +128,277 @@ class ChunkStore {
   ChunkStore& operator=(ChunkStore&&) = delete;
 
   void Put(const NameType& name, const NonEmptyString& value);
+  // Removes the chunk from the index and releases its space at once, but leaves the engine's copy
+  // to be reclaimed in the background (see Reclaim).  Throws CommonErrors::no_such_element if the
+  // chunk isn't held.
   void Delete(const NameType& name);
   NonEmptyString Get(const NameType& name) const;
+  // Decrypts the chunk straight from the engine's mapping of it into 'value', which is resized to
+  // fit.  The existing capacity of 'value' is reused, so a caller which keeps one buffer across
+  // Gets doesn't allocate per chunk.  On failure 'value' is left empty.
+  void Get(const NameType& name, std::vector<byte>& value) const;
+  // Reads up to 'length' bytes of the chunk's content from 'offset' into 'value', fewer if the
+  // chunk ends first.  Chunks over ChunkObfuscator::kBlockSize are written in a seekable format,
+  // of which only the blocks covering the range are read and decrypted; other chunks (including
+  // those written before the format existed, and all compressed ones) are decrypted in full.
+  // Throws CommonErrors::invalid_argument if 'offset' is beyond the end of the chunk.
+  void Get(const NameType& name, std::uint64_t offset, std::uint64_t length,
+           std::vector<byte>& value) const;
+  // As the Gets above, but failures are returned rather than thrown.  A chunk which isn't held is
+  // reported as CommonErrors::no_such_element after no more than an index probe, and without any
+  // exception being raised, so these suit callers for which misses are routine.
+  using GetResult = boost::expected<std::vector<byte>, maidsafe_error>;
+  GetResult TryGet(const NameType& name) const;
+  GetResult TryGet(const NameType& name, std::uint64_t offset, std::uint64_t length) const;
+
+  // Batch forms for bursts such as account transfer and re-replication.  Each returns one result
+  // per item in input order, where a default-constructed error_code means success.  PutMany
+  // reserves space for the whole batch in one step (falling back to reserving per chunk if it
+  // doesn't all fit), writes in hashed-name order, which is also on-disk directory order, and
+  // obfuscates ahead of the writes on a separate thread.  GetMany resizes 'values' to match
+  // 'names', reusing the capacity of existing elements.
+  std::vector<std::error_code> PutMany(
+      const std::vector<std::pair<NameType, NonEmptyString>>& chunks);
+  std::vector<std::error_code> GetMany(const std::vector<NameType>& names,
+                                       std::vector<std::vector<byte>>& values) const;
+  std::vector<std::error_code> DeleteMany(const std::vector<NameType>& names);
+
+  // Asynchronous forms of Put, Get and Delete.  Failures are reported to 'handler' with the code
+  // the synchronous call would have thrown; nothing is thrown.  Obfuscation is done on the calling
+  // thread.  With the file-per-chunk engine on a kernel supporting io_uring, many Puts and Gets
+  // can be in flight at once and handlers run on the engine's completion thread (with
+  // kGroupCommit, the committer's, which is free to wait for commits), so they should be brief.
+  // Otherwise the I/O is done synchronously, as it always is for DeleteAsync since a Delete
+  // doesn't wait for the engine.
+  // A call never waits for other operations on the same chunk.  It's queued behind any still
+  // outstanding, and started by whichever thread finishes the last of them, so handlers for one
+  // chunk run in submission order.  Handlers may start further asynchronous operations, but
+  // mustn't make synchronous calls on a chunk with asynchronous operations outstanding, since those
+  // would wait for completions which the handler is holding up.  The ChunkStore must outlive all
+  // handlers; its destructor waits for them.
+  using Completion = std::function<void(std::error_code error)>;
+  using GetCompletion = std::function<void(std::error_code error, std::vector<byte> value)>;
+  void PutAsync(const NameType& name, const NonEmptyString& value, Completion handler);
+  void GetAsync(const NameType& name, GetCompletion handler) const;
+  void DeleteAsync(const NameType& name, Completion handler);
 
+  // Background integrity checking.  Chunks are held under hashed names but obfuscated with their
+  // real names, so the store can't list what it holds in a form it can decrypt: each pass starts
+  // by calling 'names' for the real names of the chunks to verify.  Every one still held is read
+  // and decrypted, which detects any change to its stored bytes since the obfuscation is
+  // authenticated.  If given, 'validate' is then passed the decrypted value, and a chunk it
+  // rejects (or throws for) is corrupt too.  Failures are reported to 'on_corrupt' on the
+  // scrubbing thread, and the chunk is left in place.  Reads are paced to at most
+  // 'bytes_per_second' so that scrubbing doesn't compete with foreground Gets, and a new pass
+  // starts kScrubInterval after the last one ends.  Starting again replaces the running scrubber.
+  // Throws CommonErrors::invalid_argument if 'bytes_per_second' is 0.
+  using NameSource = std::function<std::vector<NameType>()>;
+  using CorruptionHandler = std::function<void(const NameType& name)>;
+  using ContentValidator =
+      std::function<bool(const NameType& name, const std::vector<byte>& value)>;
+  struct ScrubStats {
+    std::uint64_t passes, chunks, bytes, corrupt;
+  };
+  static const std::chrono::seconds kScrubInterval;
+  void StartScrubbing(NameSource names, std::uint64_t bytes_per_second,
+                      CorruptionHandler on_corrupt, ContentValidator validate = nullptr);
+  void StopScrubbing();
+  ScrubStats GetScrubStats() const;
+
+  // Deleted chunks are tombstoned and removed from the engine by a background reclaimer, in
+  // batches gathered over kReclaimDelay.  Tombstones are journalled under the store's metadata, so
+  // a chunk whose space was released but which is still held by the engine when the process dies
+  // is neither counted nor resurrected on restart.  Reclaim removes every tombstoned chunk it can
+  // before returning; the destructor does the same.  A chunk which the engine fails to remove
+  // stays tombstoned and is retried later.
+  static const std::chrono::milliseconds kReclaimDelay;
+  void Reclaim();
+  std::size_t PendingReclaims() const;
+
+  // Moves every chunk held by 'source' into this store, charging it against this store's limit
+  // and removing it from 'source'.  Chunks are copied as stored, without being decrypted, so the
+  // two stores must agree on whether chunks are compressed; otherwise this throws
+  // CommonErrors::invalid_argument.  A chunk already held here is just removed from 'source', and
+  // one which can't be read from 'source' is left there.  Throws if a chunk can't be stored, having
+  // moved those before it.
+  void Import(ChunkStore& source);
+
+  // For a tiered store this sets the overall limit; the limit of each tier is unchanged.
   void SetMaxDiskUsage(DiskUsage max_disk_usage);
 
-  DiskUsage MaxDiskUsage() const { return max_disk_usage_; }
-  DiskUsage CurrentDiskUsage() const { return current_disk_usage_; }
+  DiskUsage MaxDiskUsage() const { return DiskUsage(max_disk_usage_); }
+  DiskUsage CurrentDiskUsage() const { return DiskUsage(current_disk_usage_); }
   boost::filesystem::path DiskPath() const { return kDiskPath_; }
+
+  // These are answered from the in-memory index without touching the disk.  Names() returns the
+  // hashed names under which chunks are stored, in ascending order.  Gets of chunks which aren't
+  // held are likewise failed from memory, most of them by a Bloom filter over the index before
+  // even the index is consulted.
+  bool Has(const NameType& name) const;
+  // Returns the size of the chunk as stored on disk, or 0 if it isn't held.
+  std::uint64_t StoredSize(const NameType& name) const;
+  std::size_t Count() const { return index_.Count(); }
   std::vector<NameType> Names() const;
 
+  // Streams the same names as Names() a page at a time, so that a large store can be enumerated
+  // in bounded memory.  Names are yielded in ascending order, optionally only those matching a
+  // filter (note that a prefix applies to the hashed name).  A chunk stored or deleted while the
+  // cursor is in use is seen if it sorts after the cursor's position, and no name is yielded
+  // twice.  The cursor reads the store's index, so the store must outlive it.
+  using NameFilter = ChunkIndex::Filter;
+  class NameCursor {
+   public:
+    // Continues from 'token' (see Token()), or starts from the first name if it's empty.  Throws
+    // CommonErrors::invalid_argument if 'token' is malformed.
+    NameCursor(const ChunkStore& chunk_store, NameFilter filter,
+               const std::vector<byte>& token = std::vector<byte>());
+
+    // Returns up to 'max_count' further names, fewer only once the listing is exhausted.
+    std::vector<NameType> Next(std::size_t max_count);
+    bool Done() const { return done_; }
+    // Records the position after the last name returned, for resuming with a new cursor
+    // (possibly after the store has been restarted).
+    std::vector<byte> Token() const;
+
+   private:
+    const ChunkIndex& index_;
+    const NameFilter kFilter_;
+    boost::optional<NameType> last_;
+    bool done_;
+  };
+
  private:
-  bool HasDiskSpace(std::uint64_t required_space) const;
-  boost::filesystem::path NameToFilePath(NameType name) const;
-  void GetNames(const boost::filesystem::path& path, std::string prefix,
-                std::vector<NameType>& names) const;
-  NameType ComposeName(std::string file_name_str) const;
+  // Operations on chunks whose hashed names map to different stripes never contend.  Disk usage
+  // is tracked atomically; space is reserved before a write and released if the write fails.
+  static const std::size_t kLockStripes = 256;
+
+  // Serialises operations on the chunks whose hashed names map to it.  Synchronous operations
+  // hold the lock throughout.  Asynchronous ones only hold it while starting and finishing, and
+  // in between mark their chunk as busy: a synchronous operation on a busy chunk waits for it to
+  // become idle, while an asynchronous one is queued behind those already submitted, so that no
+  // caller waits for the I/O of another.  Meets BasicLockable.
+  class Stripe {
+   public:
+    Stripe() : mutex_(), idle_(), busy_() {}
+    void lock();
+    void unlock();
+    // The following must be called with the lock held.  WaitIdle releases it while waiting.
+    void WaitIdle(const NameType& hashed_name);
+    // Marks the chunk busy and returns true if it was idle.
+    bool TryEnter(const NameType& hashed_name);
+    // Queues 'start' to be run once the operations on the busy chunk ahead of it have finished.
+    void Queue(const NameType& hashed_name, std::function<void()> start);
+    // Called as an asynchronous operation finishes.  Returns the next operation queued on the
+    // chunk, which it stays busy for, or else marks it idle and returns an empty function.
+    std::function<void()> Leave(const NameType& hashed_name);
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable idle_;
+    std::map<NameType, std::deque<std::function<void()>>> busy_;
+  };
+
+  static const std::chrono::seconds kMaintenanceInterval;
+  // How many chunks PutMany may obfuscate ahead of the one being written.
+  static const std::size_t kBatchLookahead = 8;
+  // How many tombstoned chunks the reclaimer removes between looking for new ones.
+  static const std::size_t kReclaimBatch = 256;
+  // How many names Import reads from its source at a time.
+  static const std::size_t kImportBatch = 256;
+
+  // Implement the Gets, returning the code which Get throws, or success.  'value' is left empty on
+  // failure.
+  std::error_code Read(const NameType& name, std::vector<byte>& value) const;
+  std::error_code Read(const NameType& name, std::uint64_t offset, std::uint64_t length,
+                       std::vector<byte>& value) const;
+  // False if the store's directory has been removed from under it.
+  bool Available() const;
+  // Restores the index and disk usage from the last clean shutdown, or rebuilds both with a full
+  // scan of the engine if there wasn't one.  Only a clean shutdown makes opening O(1): nothing is
+  // checkpointed while the store runs, since the index changes with every Put and Delete.
+  void RestoreState();
+  // Replaces the Bloom filter with one built from the index and sized for twice its count.  Names
+  // added while this runs go into both filters, so none is missing from the replacement.
+  void RebuildFilter();
+  // Records 'hashed_name', which has just been added to the index, in the filter(s).
+  void AddToFilter(const NameType& hashed_name);
+  // False only if 'hashed_name' definitely isn't held.  Doesn't lock.
+  bool MayHold(const NameType& hashed_name) const;
+  // Exact, from the filter and then the index.
+  bool Holds(const NameType& hashed_name) const;
+  // Checks every kMaintenanceInterval whether the Bloom filter is full, and rebuilds it if so.
+  void MaintenanceLoop();
+  // Tombstones 'hashed_name', whose stripe must be held, and removes it from the index, returning
+  // its stored size for the caller to release.  Throws CommonErrors::no_such_element if it isn't
+  // held, leaving everything unchanged.
+  std::uint64_t TombstoneLocked(const NameType& hashed_name);
+  // Lifts any tombstone on 'hashed_name', whose stripe must be held and which has just been stored
+  // again, so that the reclaimer leaves it alone.  If this throws, the tombstone remains.
+  void ClearTombstone(const NameType& hashed_name);
+  // Removes up to kReclaimBatch tombstoned chunks from the engine, returning how many were removed.
+  std::size_t ReclaimBatch();
+  void ReclaimLoop();
+  void ScrubLoop(const NameSource& names, std::uint64_t bytes_per_second,
+                 const CorruptionHandler& on_corrupt, const ContentValidator& validate);
+  // Stores 'content' for 'name', whose stripe must be held.  'reserved' bytes have been reserved
+  // for it in advance; the reservation is corrected to the actual growth in usage, or released
+  // entirely if the chunk isn't stored.
+  void StoreLocked(const NameType& name, const NameType& hashed_name,
+                   const std::vector<byte>& content, std::uint64_t reserved);
+  // Compresses (if enabled) and obfuscates 'value' into 'content', and the reverse.  Decode
+  // throws CommonErrors::no_such_element if 'data' isn't a valid chunk for 'name'.
+  void Encode(const NameType& name, const NonEmptyString& value, std::vector<byte>& content) const;
+  void Decode(const NameType& name, const byte* data, std::size_t size,
+              std::vector<byte>& value) const;
+  // The most space that storing a 'value_size' byte chunk can take.
+  std::uint64_t StoredSizeBound(std::uint64_t value_size) const;
+  // Returns the indices of 'hashed_names' sorted by name.
+  static std::vector<std::size_t> HashedOrder(const std::vector<NameType>& hashed_names);
+  bool ReserveDiskSpace(std::uint64_t required_space);
+  void ReleaseDiskSpace(std::uint64_t space);
+  NameType HashedName(NameType name) const;
+  Stripe& StripeFor(const NameType& hashed_name) const;
+  // Takes the stripe of 'hashed_name' once no asynchronous operation on it is outstanding.
+  std::unique_lock<Stripe> LockIdle(const NameType& hashed_name) const;
+  // Runs 'start', which begins an asynchronous operation on 'hashed_name', at once if the chunk is
+  // idle, or otherwise once the operations on it ahead of this one have finished.  The operation
+  // must end with a call to EndAsync.
+  void BeginAsync(const NameType& hashed_name, std::function<void()> start) const;
+  // Runs 'complete' (which calls the user's handler), then starts the next operation queued on
+  // 'hashed_name', and marks this one finished.
+  void EndAsync(const NameType& hashed_name, const std::function<void()>& complete) const;
 
   const boost::filesystem::path kDiskPath_;
-  DiskUsage max_disk_usage_, current_disk_usage_;
-  const std::uint32_t kDepth_;
-  mutable std::mutex mutex_;
+  const bool kInMemory_;
+  const Compression kCompression_;
+  std::unique_ptr<ChunkStoreEngine> engine_;
+  ChunkIndex index_;
+  // Accessed with the atomic shared_ptr functions.  'next_filter_' is only set during a rebuild.
+  std::shared_ptr<BloomFilter> filter_, next_filter_;
+  UsageLedger ledger_;
+  std::atomic<std::uint64_t> max_disk_usage_, current_disk_usage_;
+  const std::shared_ptr<DiskBudget::Account> disk_budget_;
+  mutable std::array<Stripe, kLockStripes> stripes_;
+  std::mutex maintenance_mutex_;
+  std::condition_variable maintenance_condition_;
+  bool stopping_;
+  std::thread maintenance_thread_;
+  mutable std::mutex async_mutex_;
+  mutable std::condition_variable async_condition_;
+  mutable std::size_t pending_async_;
+  mutable std::mutex scrub_mutex_;
+  std::condition_variable scrub_condition_;
+  bool stop_scrubbing_;
+  ScrubStats scrub_stats_;
+  std::thread scrub_thread_;
+  // 'journal_' is only accessed under 'reclaim_mutex_', and only for a store on disk.
+  mutable std::mutex reclaim_mutex_;
+  std::condition_variable reclaim_condition_;
+  std::set<NameType> tombstones_;
+  TombstoneJournal journal_;
+  bool stop_reclaiming_;
+  std::thread reclaim_thread_;
+  const std::uint64_t kGeneration_;
 };
 
 }  // namespace vault
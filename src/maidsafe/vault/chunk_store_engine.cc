@@ -0,0 +1,58 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store_engine.h"
+
+#include <utility>
+
+#include "maidsafe/common/error.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+void ChunkStoreEngine::PutAsync(const NameType& name, const std::vector<byte>& content,
+                                Completion handler) {
+  std::error_code error;
+  try {
+    Put(name, content);
+  } catch (const maidsafe_error& e) {
+    error = e.code();
+  } catch (const std::exception&) {
+    error = make_error_code(CommonErrors::filesystem_io_error);
+  }
+  handler(error);
+}
+
+void ChunkStoreEngine::GetAsync(const NameType& name, std::uint64_t /*size*/,
+                                ReadCompletion handler) const {
+  std::error_code error;
+  std::vector<byte> content;
+  try {
+    content = Get(name);
+  } catch (const maidsafe_error& e) {
+    error = e.code();
+  } catch (const std::exception&) {
+    error = make_error_code(CommonErrors::filesystem_io_error);
+  }
+  handler(error, std::move(content));
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
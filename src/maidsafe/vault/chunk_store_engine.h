@@ -0,0 +1,95 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_ENGINE_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_ENGINE_H_
+
+#include <cstdint>
+#include <functional>
+#include <system_error>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/data.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Storage engine underneath ChunkStore.  Engines only ever see hashed names and obfuscated
+// content; quota accounting, encryption and per-name locking are done by ChunkStore, which
+// guarantees that no two calls for the same name run concurrently.  Calls for different names
+// may run concurrently.  Failures are reported by throwing a maidsafe_error.  The directory
+// returned by MetadataDirectory() belongs to ChunkStore and must be ignored by engines.
+class ChunkStoreEngine {
+ public:
+  using NameType = Data::NameAndTypeId;
+  struct StoredChunk {
+    NameType name;
+    std::uint64_t size;
+  };
+  // Receives a view of a chunk's stored content which is only valid for the duration of the call.
+  using Reader = std::function<void(const byte* data, std::size_t size)>;
+  using Completion = std::function<void(std::error_code error)>;
+  using ReadCompletion = std::function<void(std::error_code error, std::vector<byte> content)>;
+
+  static boost::filesystem::path MetadataDirectory(const boost::filesystem::path& disk_path) {
+    return disk_path / "metadata";
+  }
+
+  virtual ~ChunkStoreEngine() {}
+
+  // Prepares the store on disk.  Called once, before any other member function.
+  virtual void Initialise() = 0;
+  virtual void Put(const NameType& name, const std::vector<byte>& content) = 0;
+  // Throws CommonErrors::no_such_element if 'name' isn't held.
+  virtual std::vector<byte> Get(const NameType& name) const = 0;
+  // As Get, but hands the content to 'reader' in place rather than copying it out.  Engines which
+  // can map their files should override this; the default reads a copy.
+  virtual void Read(const NameType& name, const Reader& reader) const {
+    auto content(Get(name));
+    reader(content.data(), content.size());
+  }
+  // Returns the number of bytes freed.
+  virtual std::uint64_t Delete(const NameType& name) = 0;
+  // Enumerates everything held by reading the engine's own on-disk structures.  This can be slow;
+  // it is only used to rebuild ChunkStore's index.
+  virtual std::vector<StoredChunk> Scan() const = 0;
+  // Records whatever the engine keeps in memory and would otherwise rebuild on Initialise.
+  // ChunkStore calls it on clean shutdown only, along with saving its own index, and makes no
+  // further calls afterwards.  An engine must cope with its saved state being missing (e.g. after
+  // a crash) or stale, so should consume it on loading.
+  virtual void SaveState() {}
+
+  // Asynchronous forms of Put and Get, which report failures to 'handler' rather than
+  // throwing.  The ChunkStore guarantee against concurrent calls for one name extends until
+  // 'handler' has run.  'content' must stay alive and unchanged until then, and 'size' is the
+  // stored size of the chunk as recorded in ChunkStore's index.  Engines with native asynchronous
+  // I/O override these; the defaults make the synchronous call and run 'handler' before returning.
+  virtual void PutAsync(const NameType& name, const std::vector<byte>& content,
+                        Completion handler);
+  virtual void GetAsync(const NameType& name, std::uint64_t size, ReadCompletion handler) const;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_ENGINE_H_
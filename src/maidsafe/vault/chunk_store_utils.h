@@ -0,0 +1,84 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_UTILS_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_UTILS_H_
+
+#include <cstdint>
+#include <exception>
+
+#include "boost/filesystem/path.hpp"
+#include "boost/interprocess/file_mapping.hpp"
+#include "boost/interprocess/mapped_region.hpp"
+
+#include "maidsafe/common/types.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace detail {
+
+// Fixed-width little-endian encoding used by the ChunkStore's on-disk metadata formats.
+template <typename Integer>
+void PutLittleEndian(Integer value, byte* out) {
+  for (std::size_t i(0); i != sizeof(Integer); ++i)
+    out[i] = static_cast<byte>(static_cast<std::uint64_t>(value) >> (8 * i));
+}
+
+template <typename Integer>
+Integer GetLittleEndian(const byte* in) {
+  std::uint64_t value(0);
+  for (std::size_t i(0); i != sizeof(Integer); ++i)
+    value |= static_cast<std::uint64_t>(in[i]) << (8 * i);
+  return static_cast<Integer>(value);
+}
+
+// Maps 'length' bytes of the file at 'path' starting at 'offset' (a length of 0 maps to the end of
+// the file) read-only and passes them to 'reader'.  Returns false if the file can't be mapped, in
+// which case 'reader' isn't called.  Exceptions thrown by 'reader' propagate.
+template <typename Reader>
+bool ReadMappedFile(const char* path, std::uint64_t offset, std::size_t length,
+                    const Reader& reader) {
+  namespace ip = boost::interprocess;
+  ip::mapped_region region;
+  try {
+    ip::file_mapping mapping(path, ip::read_only);
+    ip::mapped_region(mapping, ip::read_only, static_cast<ip::offset_t>(offset), length)
+        .swap(region);
+  } catch (const std::exception&) {
+    return false;
+  }
+  // The mapping itself may be closed once the region exists.
+  reader(static_cast<const byte*>(region.get_address()), region.get_size());
+  return true;
+}
+
+template <typename Reader>
+bool ReadMappedFile(const boost::filesystem::path& path, std::uint64_t offset, std::size_t length,
+                    const Reader& reader) {
+  return ReadMappedFile(path.string().c_str(), offset, length, reader);
+}
+
+}  // namespace detail
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_UTILS_H_
@@ -0,0 +1,122 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/disk_budget.h"
+
+#include <utility>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+bool DiskBudget::Pool::Commit(std::uint64_t bytes) {
+  std::uint64_t current(committed);
+  do {
+    if (bytes > capacity || current > capacity - bytes)
+      return false;
+  } while (!committed.compare_exchange_weak(current, current + bytes));
+  return true;
+}
+
+DiskBudget::Account::Account(std::shared_ptr<Pool> pool, std::string name, Limits limits)
+    : pool_(std::move(pool)),
+      kName_(std::move(name)),
+      kSoft_(limits.soft.data),
+      kHard_(limits.hard.data),
+      used_(0) {}
+
+DiskBudget::Account::~Account() {
+  pool_->committed -= kSoft_ + Borrowed(used_);
+  pool_->used -= used_;
+}
+
+bool DiskBudget::Account::Reserve(std::uint64_t bytes) {
+  std::uint64_t used(used_);
+  for (;;) {
+    if (bytes > kHard_ || used > kHard_ - bytes)
+      return false;
+    // What's borrowed is committed before the account's usage grows, so the pool's view of the
+    // commitment is never less than the truth.
+    std::uint64_t borrow(Borrowed(used + bytes) - Borrowed(used));
+    if (borrow != 0 && !pool_->Commit(borrow))
+      return false;
+    if (used_.compare_exchange_weak(used, used + bytes))
+      break;
+    pool_->committed -= borrow;
+  }
+  pool_->used += bytes;
+  return true;
+}
+
+void DiskBudget::Account::Release(std::uint64_t bytes) {
+  std::uint64_t used(used_), remaining;
+  do {
+    remaining = used > bytes ? used - bytes : 0;
+  } while (!used_.compare_exchange_weak(used, remaining));
+  pool_->committed -= Borrowed(used) - Borrowed(remaining);
+  pool_->used -= used - remaining;
+}
+
+void DiskBudget::Account::Charge(std::uint64_t bytes) {
+  std::uint64_t used(used_);
+  for (;;) {
+    std::uint64_t borrow(Borrowed(used + bytes) - Borrowed(used));
+    pool_->committed += borrow;
+    if (used_.compare_exchange_weak(used, used + bytes))
+      break;
+    pool_->committed -= borrow;
+  }
+  pool_->used += bytes;
+  if (used + bytes > kHard_) {
+    LOG(kWarning) << "Disk budget account " << kName_ << " is charged " << used + bytes
+                  << " bytes, beyond its hard limit of " << kHard_;
+  }
+}
+
+DiskBudget::DiskBudget(DiskUsage capacity) : pool_(std::make_shared<Pool>(capacity.data)) {}
+
+std::shared_ptr<DiskBudget::Account> DiskBudget::AddAccount(std::string name, Limits limits) {
+  if (limits.soft.data > limits.hard.data || limits.hard.data > pool_->capacity) {
+    LOG(kError) << "Invalid limits for disk budget account " << name << ": soft "
+                << limits.soft.data << ", hard " << limits.hard.data << ", capacity "
+                << pool_->capacity;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  if (!pool_->Commit(limits.soft.data)) {
+    LOG(kError) << "Cannot guarantee " << limits.soft.data << " bytes to disk budget account "
+                << name << "; only " << Unallocated().data << " bytes are unallocated";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+  }
+  return std::shared_ptr<Account>(new Account(pool_, std::move(name), limits));
+}
+
+DiskUsage DiskBudget::Capacity() const { return DiskUsage(pool_->capacity); }
+
+DiskUsage DiskBudget::Used() const { return DiskUsage(pool_->used); }
+
+DiskUsage DiskBudget::Unallocated() const {
+  std::uint64_t committed(pool_->committed);
+  return DiskUsage(committed < pool_->capacity ? pool_->capacity - committed : 0);
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,116 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_DISK_BUDGET_H_
+#define MAIDSAFE_VAULT_DISK_BUDGET_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "maidsafe/common/types.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Divides the disk provisioned for a vault between the stores of its personas, each of which
+// reserves space from its own Account before writing and releases it after deleting.  An account
+// is guaranteed its soft limit: that much is set aside for it however much the others use.  Above
+// its soft limit it borrows from the capacity which isn't guaranteed to any account, on a first
+// come basis, up to its hard limit; borrowed space returns to the pool as soon as it's released,
+// so the split follows whichever personas are growing.  The total reserved never exceeds the
+// capacity.  Reservations are lock-free.  Accounts may outlive the DiskBudget which issued them.
+class DiskBudget {
+ public:
+  struct Limits {
+    DiskUsage soft, hard;
+  };
+
+ private:
+  struct Pool;
+
+ public:
+  class Account {
+   public:
+    ~Account();
+    Account(const Account&) = delete;
+    Account(Account&&) = delete;
+    Account& operator=(const Account&) = delete;
+    Account& operator=(Account&&) = delete;
+
+    // Returns false, reserving nothing, if 'bytes' would take the account beyond its hard limit,
+    // or beyond its soft limit by more than the pool has left.
+    bool Reserve(std::uint64_t bytes);
+    void Release(std::uint64_t bytes);
+    // Records 'bytes' as used regardless of the limits, e.g. for what a store finds on disk when
+    // it's opened.  Borrowing beyond what the pool has is repaid before anything more is lent.
+    void Charge(std::uint64_t bytes);
+
+    const std::string& Name() const { return kName_; }
+    Limits GetLimits() const { return Limits{DiskUsage(kSoft_), DiskUsage(kHard_)}; }
+    std::uint64_t Used() const { return used_; }
+
+   private:
+    friend class DiskBudget;
+    Account(std::shared_ptr<Pool> pool, std::string name, Limits limits);
+    // The part of 'used' beyond the soft limit, which is borrowed from the pool.
+    std::uint64_t Borrowed(std::uint64_t used) const { return used > kSoft_ ? used - kSoft_ : 0; }
+
+    const std::shared_ptr<Pool> pool_;
+    const std::string kName_;
+    const std::uint64_t kSoft_, kHard_;
+    std::atomic<std::uint64_t> used_;
+  };
+
+  explicit DiskBudget(DiskUsage capacity);
+  DiskBudget(const DiskBudget&) = delete;
+  DiskBudget(DiskBudget&&) = delete;
+  DiskBudget& operator=(const DiskBudget&) = delete;
+  DiskBudget& operator=(DiskBudget&&) = delete;
+
+  // Throws CommonErrors::invalid_argument if the soft limit exceeds the hard one or the hard one
+  // exceeds the capacity, and CommonErrors::cannot_exceed_limit if the soft limit can't be
+  // guaranteed alongside what's already guaranteed or borrowed.
+  std::shared_ptr<Account> AddAccount(std::string name, Limits limits);
+
+  DiskUsage Capacity() const;
+  // The total used by all accounts.
+  DiskUsage Used() const;
+  // What's neither guaranteed to an account nor borrowed by one.
+  DiskUsage Unallocated() const;
+
+ private:
+  // 'committed' is the sum of the soft limits of all accounts plus what they've borrowed, and is
+  // the only value whose bound the reservations have to agree on.
+  struct Pool {
+    explicit Pool(std::uint64_t capacity_in) : capacity(capacity_in), committed(0), used(0) {}
+    bool Commit(std::uint64_t bytes);
+    const std::uint64_t capacity;
+    std::atomic<std::uint64_t> committed, used;
+  };
+
+  const std::shared_ptr<Pool> pool_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_DISK_BUDGET_H_
@@ -0,0 +1,746 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/file_chunk_engine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/chunk_store_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Upper bound on the number of threads used to scan the fan-out directories.
+const unsigned kMaxScanThreads(16);
+// Suffix of files being written in durable mode, before they're renamed into place.
+const char kTempExtension[] = ".tmp";
+
+fs::path TempPath(const fs::path& path) { return fs::path(path.string() + kTempExtension); }
+
+// Number of hex characters in a hashed name.
+const std::uint32_t kHashedNameDigits(2 * 64);
+// Longest file name given to a chunk: the hex-encoded hashed name, '_' and the decimal type id.
+const std::size_t kMaxFileNameSize(kHashedNameDigits + 1 + 10);
+
+// File in the store root recording the layouts in use, one "<depth> <width>" line each, starting
+// with the current one.
+const char kManifestName[] = "layout";
+// The layout of stores written before the manifest existed.
+const FileChunkEngine::Layout kOriginalLayout{5, 1};
+// Widest fan-out directory name, giving 65536-way directories.
+const std::uint32_t kMaxLayoutWidth(4);
+
+bool ValidLayout(const FileChunkEngine::Layout& layout) {
+  return layout.depth != 0 && layout.width != 0 && layout.width <= kMaxLayoutWidth &&
+         layout.depth * layout.width <= kHashedNameDigits;
+}
+
+// Creates 'directory' along with any missing parents.  Those which were missing are appended to
+// 'created' if it's given, outermost first, so that the committer can flush their parents.
+bool CreateDirectories(const fs::path& directory, std::vector<fs::path>* created = nullptr) {
+  boost::system::error_code error_code;
+  std::vector<fs::path> missing;
+  for (auto path(directory); !path.empty() && !fs::exists(path, error_code);
+       path = path.parent_path()) {
+    missing.push_back(path);
+  }
+  fs::create_directories(directory, error_code);
+  if (error_code) {
+    LOG(kError) << "Can't create " << directory << ": " << error_code.message();
+    return false;
+  }
+  if (created)
+    created->insert(created->end(), missing.rbegin(), missing.rend());
+  return true;
+}
+
+// Largest single read or write submitted to io_uring.
+const std::uint64_t kMaxTransferSize(1 << 30);
+
+std::error_code ErrorFromResult(int result) {
+  return make_error_code(result == -ENOENT ? CommonErrors::no_such_element
+                                           : CommonErrors::filesystem_io_error);
+}
+
+void CloseAndComplete(UringQueue* uring, int fd, std::error_code error,
+                      ChunkStoreEngine::Completion handler) {
+  uring->Close(fd, [error, handler](int result) {
+    handler(error ? error : (result < 0 ? ErrorFromResult(result) : std::error_code()));
+  });
+}
+
+// Writes [data, data + size) to 'fd' at 'offset', resubmitting after short writes, then closes it.
+void WriteAndClose(UringQueue* uring, int fd, const byte* data, std::uint64_t size,
+                   std::uint64_t offset, ChunkStoreEngine::Completion handler) {
+  if (size == 0)
+    return CloseAndComplete(uring, fd, std::error_code(), handler);
+  uring->Write(fd, data, static_cast<std::uint32_t>(std::min(size, kMaxTransferSize)), offset,
+               [=](int result) {
+    if (result <= 0)
+      return CloseAndComplete(uring, fd, ErrorFromResult(result == 0 ? -EIO : result), handler);
+    WriteAndClose(uring, fd, data + result, size - result, offset + result, handler);
+  });
+}
+
+// Fills [buffer, buffer + size) from 'fd' at 'offset', then closes it.  Reaching the end of the
+// file first is an error.
+void ReadAndClose(UringQueue* uring, int fd, byte* buffer, std::uint64_t size,
+                  std::uint64_t offset, ChunkStoreEngine::Completion handler) {
+  if (size == 0)
+    return CloseAndComplete(uring, fd, std::error_code(), handler);
+  uring->Read(fd, buffer, static_cast<std::uint32_t>(std::min(size, kMaxTransferSize)), offset,
+              [=](int result) {
+    if (result <= 0)
+      return CloseAndComplete(uring, fd, ErrorFromResult(result == 0 ? -EIO : result), handler);
+    ReadAndClose(uring, fd, buffer + result, size - result, offset + result, handler);
+  });
+}
+
+#ifdef __linux__
+
+// How many released buffers are kept for reuse by uncached reads and writes.
+const std::size_t kPooledBuffers(16);
+
+std::size_t RoundUpToBlock(std::size_t size) {
+  const std::size_t kBlock(AlignedBufferPool::kAlignment);
+  return (size + kBlock - 1) / kBlock * kBlock;
+}
+
+// Writes all of [data, data + size) to 'fd'.  Returns 0, or a negated errno value on failure.
+int WriteAll(int fd, const byte* data, std::size_t size) {
+  while (size != 0) {
+    ssize_t result(write(fd, data, size));
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0)
+      return result == 0 ? -EIO : -errno;
+    data += result;
+    size -= static_cast<std::size_t>(result);
+  }
+  return 0;
+}
+
+// Reads the first 'size' bytes of the file into 'buffer', asking for up to 'request' bytes at a
+// time so that direct reads can cover whole blocks.  Returns 0, or a negated errno value on
+// failure, including reaching the end of the file first.
+int ReadAll(int fd, byte* buffer, std::size_t size, std::size_t request) {
+  std::size_t done(0);
+  while (done < size) {
+    ssize_t result(pread(fd, buffer + done, request - done, static_cast<off_t>(done)));
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0)
+      return result == 0 ? -EIO : -errno;
+    done += static_cast<std::size_t>(result);
+  }
+  return 0;
+}
+
+void DisableDirectIo(std::atomic<bool>& direct_io, const fs::path& disk_path) {
+  if (direct_io.exchange(false))
+    LOG(kWarning) << disk_path << " doesn't support O_DIRECT; dropping cached pages instead";
+}
+
+#else
+
+const std::size_t kPooledBuffers(0);
+
+#endif
+
+}  // unnamed namespace
+
+FileChunkEngine::FileChunkEngine(const fs::path& disk_path,
+                                 std::shared_ptr<GroupCommitter> committer,
+                                 CacheBypass cache_bypass, Layout layout)
+    : kDiskPath_(disk_path),
+      kDiskPathString_(disk_path.string()),
+      kLayout_(layout),
+      committer_(std::move(committer)),
+      kCacheBypass_(cache_bypass),
+      direct_io_(cache_bypass.mode == CacheBypass::Mode::kDirect),
+      buffers_(kPooledBuffers),
+      uring_flag_(),
+      uring_(),
+      earlier_layouts_(),
+      migrating_(false),
+      stripes_(),
+      walk_mutex_(),
+      stop_migrating_(false),
+      migrator_() {}
+
+FileChunkEngine::~FileChunkEngine() {
+  stop_migrating_ = true;
+  if (migrator_.joinable())
+    migrator_.join();
+}
+
+void FileChunkEngine::Initialise() {
+  boost::system::error_code error_code;
+  if (!fs::exists(kDiskPath_, error_code)) {
+    if (!fs::create_directories(kDiskPath_, error_code)) {
+      LOG(kError) << "Can't create disk root at " << kDiskPath_ << ": " << error_code.message();
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::uninitialised));
+    }
+  } else if (!fs::is_directory(kDiskPath_, error_code)) {
+    LOG(kError) << kDiskPath_ << " is not a directory";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::not_a_directory));
+  }
+  if (!ValidLayout(kLayout_)) {
+    LOG(kError) << "Invalid layout of " << kLayout_.depth << " levels of width " << kLayout_.width;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  auto layouts(UpdateManifest());
+  // Paths are built in a fixed-size buffer for each layout still in use, so it must fit the one
+  // with the most separators.
+  std::uint32_t max_depth(0);
+  for (const auto& layout : layouts)
+    max_depth = std::max(max_depth, layout.depth);
+  if (kDiskPathString_.size() + max_depth + 1 + kMaxFileNameSize >= kMaxPathSize) {
+    LOG(kError) << "Disk root " << kDiskPath_ << " is too long";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  earlier_layouts_.assign(layouts.begin() + 1, layouts.end());
+  if (!earlier_layouts_.empty()) {
+    LOG(kInfo) << "Migrating " << kDiskPath_ << " to " << kLayout_.depth << " levels of width "
+               << kLayout_.width;
+    migrating_ = true;
+    migrator_ = std::thread([this] { Migrate(); });
+  }
+}
+
+void FileChunkEngine::Put(const NameType& name, const std::vector<byte>& content) {
+  auto lock(LockIfMigrating(name));
+  ChunkPath chunk_path(*this, name);
+  auto path(chunk_path.path());
+  auto write_path(committer_ ? TempPath(path) : path);
+  auto write([&] {
+    return Bypasses(content.size()) ? WriteUncached(write_path, content)
+                                    : WriteFile(write_path, content);
+  });
+  // A failed write is retried once its directories have been created.
+  std::vector<fs::path> created_directories;
+  if (!write() && !(CreateDirectories(chunk_path.Directory(), &created_directories) && write())) {
+    LOG(kError) << "Failed to write " << name.name << " to disk.";
+    if (committer_) {
+      boost::system::error_code error_code;
+      fs::remove(write_path, error_code);
+    }
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  if (committer_)
+    committer_->Commit(write_path, path, created_directories);
+  if (lock.owns_lock())
+    RemoveFromEarlierLayouts(name);
+}
+
+std::vector<byte> FileChunkEngine::Get(const NameType& name) const {
+  if (kCacheBypass_.mode != CacheBypass::Mode::kNone) {
+    std::vector<byte> content;
+    Read(name, [&](const byte* data, std::size_t size) { content.assign(data, data + size); });
+    return content;
+  }
+  auto lock(LockIfMigrating(name));
+  auto content(ReadFile(Locate(name, lock.owns_lock()).path()));
+  if (!content)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  return std::move(*content);
+}
+
+void FileChunkEngine::Read(const NameType& name, const Reader& reader) const {
+  auto lock(LockIfMigrating(name));
+  auto chunk_path(Locate(name, lock.owns_lock()));
+  bool read(kCacheBypass_.mode == CacheBypass::Mode::kNone
+                ? detail::ReadMappedFile(chunk_path.c_str(), 0, 0, reader)
+                : ReadUncached(chunk_path.c_str(), reader));
+  if (!read)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+}
+
+std::uint64_t FileChunkEngine::Delete(const NameType& name) {
+  auto lock(LockIfMigrating(name));
+  auto path(Locate(name, lock.owns_lock()).path());
+  boost::system::error_code error_code;
+  std::uint64_t file_size(fs::file_size(path, error_code));
+  if (error_code) {
+    LOG(kError) << "Error getting file size of " << path << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  if (!fs::remove(path, error_code) || error_code) {
+    LOG(kError) << "Error removing " << path << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  // A crash between writing a chunk and removing its earlier copy can leave both.
+  if (lock.owns_lock())
+    RemoveFromEarlierLayouts(name);
+  return file_size;
+}
+
+void FileChunkEngine::PutAsync(const NameType& name, const std::vector<byte>& content,
+                               Completion handler) {
+  auto uring(Uring());
+  if (!uring || Bypasses(content.size()) || migrating_)
+    return ChunkStoreEngine::PutAsync(name, content, std::move(handler));
+  const byte* data(content.data());
+  std::uint64_t size(content.size());
+  ChunkPath chunk_path(*this, name);
+  auto path(chunk_path.path());
+  auto write_path(committer_ ? TempPath(path) : path);
+  auto directory(chunk_path.Directory());
+  auto committer(committer_);
+  auto created_directories(std::make_shared<std::vector<fs::path>>());
+  auto on_written([=](std::error_code error) {
+    if (!committer)
+      return handler(error);
+    if (error) {
+      boost::system::error_code error_code;
+      fs::remove(write_path, error_code);
+      return handler(error);
+    }
+    committer->CommitAsync(write_path, path, *created_directories, handler);
+  });
+  auto on_opened([=](int fd) {
+    if (fd < 0) {
+      LOG(kError) << "Failed to open " << name.name << " for writing: " << -fd;
+      return on_written(ErrorFromResult(fd));
+    }
+    WriteAndClose(uring, fd, data, size, 0, on_written);
+  });
+  uring->OpenForWrite(write_path.string(), [=](int fd) {
+    if (fd == -ENOENT && CreateDirectories(directory, created_directories.get()))
+      return uring->OpenForWrite(write_path.string(), on_opened);
+    on_opened(fd);
+  });
+}
+
+void FileChunkEngine::GetAsync(const NameType& name, std::uint64_t size,
+                               ReadCompletion handler) const {
+  auto uring(Uring());
+  if (!uring || Bypasses(size) || migrating_)
+    return ChunkStoreEngine::GetAsync(name, size, std::move(handler));
+  auto content(std::make_shared<std::vector<byte>>(size));
+  auto on_read([content, handler](std::error_code error) {
+    if (error)
+      content->clear();
+    handler(error, std::move(*content));
+  });
+  uring->OpenForRead(ChunkPath(*this, name).c_str(), [=](int fd) {
+    if (fd < 0)
+      return on_read(ErrorFromResult(fd));
+    ReadAndClose(uring, fd, content->data(), content->size(), 0, on_read);
+  });
+}
+
+std::vector<FileChunkEngine::StoredChunk> FileChunkEngine::Scan() const {
+  std::lock_guard<std::mutex> lock(walk_mutex_);
+  std::vector<StoredChunk> chunks;
+  std::vector<fs::path> directories;
+  fs::directory_iterator end_iter;
+  if (!fs::exists(kDiskPath_) || !fs::is_directory(kDiskPath_))
+    return chunks;
+  for (fs::directory_iterator dir_iter(kDiskPath_); dir_iter != end_iter; ++dir_iter) {
+    // The stem also matches the manifest's temporary file.
+    if (dir_iter->path() == MetadataDirectory(kDiskPath_) ||
+        dir_iter->path().stem() == kManifestName) {
+      continue;
+    }
+    if (fs::is_regular_file(dir_iter->status()))
+      chunks.push_back(StoredChunk{maidsafe::detail::GetDataNameAndTypeId(*dir_iter),
+                                   fs::file_size(*dir_iter)});
+    else
+      directories.push_back(dir_iter->path());
+  }
+
+  // Each top-level fan-out directory is walked in full by one of a bounded set of workers.
+  std::atomic<std::size_t> next_directory(0);
+  std::mutex chunks_mutex;
+  auto scan_directories([&] {
+    std::vector<StoredChunk> found;
+    for (auto i(next_directory++); i < directories.size(); i = next_directory++)
+      ScanDirectory(directories[i], directories[i].filename().string(), found);
+    std::lock_guard<std::mutex> lock(chunks_mutex);
+    std::move(found.begin(), found.end(), std::back_inserter(chunks));
+  });
+  auto thread_count(std::min<std::size_t>(
+      directories.size(),
+      std::max(1U, std::min(kMaxScanThreads, std::thread::hardware_concurrency()))));
+  std::vector<std::future<void>> futures;
+  for (std::size_t i(0); i < thread_count; ++i)
+    futures.push_back(std::async(std::launch::async, scan_directories));
+  try {
+    for (auto& future : futures)
+      future.get();
+  } catch (const std::exception& e) {
+    LOG(kError) << "Failed to scan " << kDiskPath_ << ": " << boost::diagnostic_information(e);
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  return chunks;
+}
+
+void FileChunkEngine::ScanDirectory(const fs::path& path, std::string prefix,
+                                    std::vector<StoredChunk>& chunks) const {
+  fs::directory_iterator end_iter;
+  for (fs::directory_iterator dir_iter(path); dir_iter != end_iter; ++dir_iter) {
+    if (dir_iter->path().extension() == kTempExtension) {
+      // Left by a crash before the chunk was committed.
+      boost::system::error_code error_code;
+      fs::remove(dir_iter->path(), error_code);
+      continue;
+    }
+    if (fs::is_regular_file(dir_iter->status()))
+      chunks.push_back(StoredChunk{ComposeName(prefix + dir_iter->path().filename().string()),
+                                   fs::file_size(*dir_iter)});
+    else
+      ScanDirectory(dir_iter->path(), prefix + dir_iter->path().filename().string(), chunks);
+  }
+}
+
+FileChunkEngine::NameType FileChunkEngine::ComposeName(std::string file_name_str) const {
+  size_t index(file_name_str.rfind('_'));
+  auto type(static_cast<DataTypeId>(std::stoul(file_name_str.substr(index + 1))));
+  Identity id(hex::DecodeToBytes(file_name_str.substr(0, index)));
+  return NameType(id, type);
+}
+
+std::vector<FileChunkEngine::Layout> FileChunkEngine::UpdateManifest() const {
+  auto manifest_path(kDiskPath_ / kManifestName);
+  std::vector<Layout> layouts;
+  if (fs::exists(manifest_path)) {
+    auto content(ReadFile(manifest_path));
+    std::istringstream stream(content ? std::string(content->begin(), content->end())
+                                      : std::string());
+    Layout layout;
+    while (stream >> layout.depth >> layout.width)
+      layouts.push_back(layout);
+    if (!content || !stream.eof() || layouts.empty() ||
+        !std::all_of(layouts.begin(), layouts.end(), ValidLayout)) {
+      LOG(kError) << "Can't parse layout manifest " << manifest_path;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::parsing_error));
+    }
+  } else {
+    // Chunks already in a store without a manifest are in the original layout.
+    fs::directory_iterator end_iter;
+    for (fs::directory_iterator dir_iter(kDiskPath_); dir_iter != end_iter; ++dir_iter) {
+      if (dir_iter->path() != MetadataDirectory(kDiskPath_)) {
+        layouts.push_back(kOriginalLayout);
+        break;
+      }
+    }
+  }
+
+  std::vector<Layout> in_use(1, kLayout_);
+  for (const auto& layout : layouts) {
+    if (std::find(in_use.begin(), in_use.end(), layout) == in_use.end())
+      in_use.push_back(layout);
+  }
+  if (layouts != in_use)
+    WriteManifest(in_use);
+  return in_use;
+}
+
+void FileChunkEngine::WriteManifest(const std::vector<Layout>& layouts) const {
+  std::string content;
+  for (const auto& layout : layouts)
+    content += std::to_string(layout.depth) + ' ' + std::to_string(layout.width) + '\n';
+  auto manifest_path(kDiskPath_ / kManifestName);
+  auto temp_path(TempPath(manifest_path));
+  boost::system::error_code error_code;
+  if (WriteFile(temp_path, content))
+    fs::rename(temp_path, manifest_path, error_code);
+  else
+    error_code = make_error_code(boost::system::errc::io_error);
+  if (error_code) {
+    LOG(kError) << "Failed to write layout manifest " << manifest_path << ": "
+                << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+}
+
+std::unique_lock<std::mutex> FileChunkEngine::LockIfMigrating(const NameType& name) const {
+  if (!migrating_)
+    return std::unique_lock<std::mutex>();
+  return std::unique_lock<std::mutex>(StripeFor(name));
+}
+
+std::mutex& FileChunkEngine::StripeFor(const NameType& name) const {
+  return stripes_[static_cast<unsigned char>(name.name.string()[0]) % kLockStripes];
+}
+
+FileChunkEngine::ChunkPath FileChunkEngine::Locate(const NameType& name, bool migrating) const {
+  ChunkPath chunk_path(*this, name);
+  boost::system::error_code error_code;
+  if (!migrating || fs::exists(chunk_path.path(), error_code))
+    return chunk_path;
+  for (const auto& layout : earlier_layouts_) {
+    ChunkPath earlier_path(*this, name, layout);
+    if (fs::exists(earlier_path.path(), error_code))
+      return earlier_path;
+  }
+  return chunk_path;
+}
+
+void FileChunkEngine::RemoveFromEarlierLayouts(const NameType& name) const {
+  for (const auto& layout : earlier_layouts_) {
+    boost::system::error_code error_code;
+    fs::remove(ChunkPath(*this, name, layout).path(), error_code);
+  }
+}
+
+void FileChunkEngine::Migrate() {
+  bool migrated(false);
+  try {
+    migrated = MigrateDirectory(kDiskPath_, std::string(), 0, true);
+    if (migrated) {
+      WriteManifest(std::vector<Layout>(1, kLayout_));
+      migrating_ = false;
+      LOG(kInfo) << "Finished migrating " << kDiskPath_;
+    }
+  } catch (const std::exception& e) {
+    LOG(kError) << "Failed migrating " << kDiskPath_ << ": " << boost::diagnostic_information(e);
+    migrated = false;
+  }
+  if (!migrated && !stop_migrating_)
+    LOG(kWarning) << "Migration of " << kDiskPath_ << " will resume when it's next opened";
+}
+
+bool FileChunkEngine::MigrateDirectory(const fs::path& directory, const std::string& prefix,
+                                       std::uint32_t depth, bool in_layout) {
+  bool migrated(true);
+  std::vector<fs::path> subdirectories;
+  {
+    std::lock_guard<std::mutex> lock(walk_mutex_);
+    std::vector<fs::path> files;
+    fs::directory_iterator end_iter;
+    for (fs::directory_iterator dir_iter(directory); dir_iter != end_iter; ++dir_iter) {
+      if (fs::is_directory(dir_iter->status())) {
+        if (dir_iter->path() != MetadataDirectory(kDiskPath_))
+          subdirectories.push_back(dir_iter->path());
+      } else if (depth != 0 && dir_iter->path().extension() != kTempExtension) {
+        files.push_back(dir_iter->path());
+      }
+    }
+    // Chunks already in place are left alone.
+    if (in_layout && depth == kLayout_.depth)
+      files.clear();
+    for (const auto& path : files) {
+      if (stop_migrating_)
+        return false;
+      bool moved(true);
+      try {
+        moved = MigrateChunk(path, ComposeName(prefix + path.filename().string()));
+      } catch (const std::exception&) {
+        LOG(kWarning) << "Ignoring " << path << ", which isn't a chunk";
+      }
+      migrated = moved && migrated;
+    }
+  }
+  for (const auto& subdirectory : subdirectories) {
+    if (stop_migrating_)
+      return false;
+    auto name(subdirectory.filename().string());
+    migrated = MigrateDirectory(subdirectory, prefix + name, depth + 1,
+                                in_layout && depth < kLayout_.depth &&
+                                    name.size() == kLayout_.width) &&
+               migrated;
+  }
+  // Only succeeds once the directory is empty.
+  if (!in_layout) {
+    std::lock_guard<std::mutex> lock(walk_mutex_);
+    boost::system::error_code error_code;
+    fs::remove(directory, error_code);
+  }
+  return migrated;
+}
+
+bool FileChunkEngine::MigrateChunk(const fs::path& path, const NameType& name) {
+  std::lock_guard<std::mutex> lock(StripeFor(name));
+  ChunkPath chunk_path(*this, name);
+  boost::system::error_code error_code;
+  // Since being listed, the chunk may have been deleted, or rewritten in the current layout.
+  if (!fs::exists(path, error_code))
+    return true;
+  if (fs::exists(chunk_path.path(), error_code)) {
+    fs::remove(path, error_code);
+  } else {
+    fs::rename(path, chunk_path.path(), error_code);
+    if (error_code && CreateDirectories(chunk_path.Directory()))
+      fs::rename(path, chunk_path.path(), error_code);
+  }
+  if (error_code) {
+    LOG(kError) << "Failed to move " << path << " to " << chunk_path.c_str() << ": "
+                << error_code.message();
+  }
+  return !error_code;
+}
+
+bool FileChunkEngine::Bypasses(std::uint64_t size) const {
+#ifdef __linux__
+  return kCacheBypass_.mode != CacheBypass::Mode::kNone && size >= kCacheBypass_.threshold;
+#else
+  static_cast<void>(size);
+  return false;
+#endif
+}
+
+bool FileChunkEngine::WriteUncached(const fs::path& path, const std::vector<byte>& content) const {
+#ifdef __linux__
+  bool direct(direct_io_);
+  int fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (direct ? O_DIRECT : 0),
+              0666));
+  if (fd < 0) {
+    if (errno != EINVAL || !direct)
+      return false;
+    DisableDirectIo(direct_io_, kDiskPath_);
+    return WriteUncached(path, content);
+  }
+  int result(0);
+  if (direct) {
+    // Direct transfers must be whole blocks from aligned memory, so the content is padded to a
+    // block boundary and the file is truncated back to size afterwards.
+    std::size_t padded_size(RoundUpToBlock(content.size()));
+    auto buffer(buffers_.Acquire(padded_size));
+    std::copy(content.begin(), content.end(), buffer.data());
+    std::fill(buffer.data() + content.size(), buffer.data() + padded_size, byte(0));
+    result = WriteAll(fd, buffer.data(), padded_size);
+    if (result == 0 && ftruncate(fd, static_cast<off_t>(content.size())) != 0)
+      result = -errno;
+  } else {
+    result = WriteAll(fd, content.data(), content.size());
+    // Dirty pages can't be dropped, so they're written back first.
+    if (result == 0 &&
+        sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                                      SYNC_FILE_RANGE_WAIT_AFTER) != 0) {
+      result = -errno;
+    }
+    if (result == 0)
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+  if (close(fd) != 0 && result == 0)
+    result = -errno;
+  if (result == -EINVAL && direct) {
+    DisableDirectIo(direct_io_, kDiskPath_);
+    return WriteUncached(path, content);
+  }
+  return result == 0;
+#else
+  return WriteFile(path, content);
+#endif
+}
+
+bool FileChunkEngine::ReadUncached(const char* path, const Reader& reader) const {
+#ifdef __linux__
+  int fd(open(path, O_RDONLY | O_CLOEXEC));
+  if (fd < 0)
+    return false;
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    close(fd);
+    return false;
+  }
+  std::size_t size(static_cast<std::size_t>(status.st_size));
+  if (!Bypasses(size)) {
+    close(fd);
+    return detail::ReadMappedFile(path, 0, 0, reader);
+  }
+  bool direct(direct_io_);
+  if (direct && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) != 0) {
+    DisableDirectIo(direct_io_, kDiskPath_);
+    direct = false;
+  }
+  auto buffer(buffers_.Acquire(RoundUpToBlock(size)));
+  int result(ReadAll(fd, buffer.data(), size, direct ? RoundUpToBlock(size) : size));
+  if (result == -EINVAL && direct) {
+    DisableDirectIo(direct_io_, kDiskPath_);
+    direct = false;
+    result = fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT) == 0
+                 ? ReadAll(fd, buffer.data(), size, size)
+                 : -errno;
+  }
+  if (!direct)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+  if (result != 0)
+    return false;
+  reader(buffer.data(), size);
+  return true;
+#else
+  return detail::ReadMappedFile(path, 0, 0, reader);
+#endif
+}
+
+UringQueue* FileChunkEngine::Uring() const {
+  std::call_once(uring_flag_, [this] { uring_ = UringQueue::Create(); });
+  return uring_.get();
+}
+
+FileChunkEngine::ChunkPath::ChunkPath(const FileChunkEngine& engine, const NameType& name)
+    : ChunkPath(engine, name, engine.kLayout_) {}
+
+FileChunkEngine::ChunkPath::ChunkPath(const FileChunkEngine& engine, const NameType& name,
+                                      Layout layout)
+    : buffer_(), directory_size_(0) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  // Matches the layout of detail::GetFileName split over the fan-out directories.
+  const std::size_t kDirectoryDigits(layout.depth * layout.width);
+  char* out(std::copy(engine.kDiskPathString_.begin(), engine.kDiskPathString_.end(),
+                      buffer_.data()));
+  const auto& id(name.name.string());
+  for (std::size_t i(0); i != 2 * id.size(); ++i) {
+    if (i == kDirectoryDigits)
+      directory_size_ = static_cast<std::size_t>(out - buffer_.data());
+    if (i <= kDirectoryDigits && i % layout.width == 0)
+      *out++ = '/';
+    *out++ = kHexDigits[i % 2 == 0 ? id[i / 2] >> 4 : id[i / 2] & 0x0f];
+  }
+  std::snprintf(out, static_cast<std::size_t>(buffer_.data() + buffer_.size() - out), "_%u",
+                static_cast<unsigned>(name.type_id.data));
+}
+
+fs::path FileChunkEngine::ChunkPath::Directory() const {
+  return fs::path(buffer_.data(), buffer_.data() + directory_size_);
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
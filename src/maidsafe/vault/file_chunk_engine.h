@@ -0,0 +1,180 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_FILE_CHUNK_ENGINE_H_
+#define MAIDSAFE_VAULT_FILE_CHUNK_ENGINE_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/vault/aligned_buffer_pool.h"
+#include "maidsafe/vault/chunk_store_engine.h"
+#include "maidsafe/vault/group_committer.h"
+#include "maidsafe/vault/uring_queue.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Stores each chunk as its own file, fanned out over directories named by successive hex characters
+// from the start of the hashed name, as given by its Layout.  Fan-out directories are created by
+// the first write which finds them missing, so reads and deletes never create directories.  The
+// asynchronous operations use io_uring where the kernel supports it (set up on first use) and
+// otherwise fall back to the synchronous ones.  If a committer is given, chunks are written to a
+// temporary file alongside their final path, then flushed and renamed into place by the committer
+// before the Put completes.
+class FileChunkEngine : public ChunkStoreEngine {
+ public:
+  // Large chunks passing through the OS page cache evict the small, frequently read ones (account
+  // chunks, MutableData) which benefit from it.  Chunks of at least 'threshold' bytes can bypass
+  // the cache: kDirect writes and reads them with O_DIRECT through pooled aligned buffers, and
+  // kDropCache uses ordinary I/O and then has the kernel write back and drop the file's pages.
+  // kDirect falls back to kDropCache on filesystems without O_DIRECT support.  Asynchronous
+  // operations on such chunks are done synchronously.  Only supported on Linux; elsewhere every
+  // mode behaves as kNone.
+  struct CacheBypass {
+    enum class Mode { kNone, kDirect, kDropCache };
+    Mode mode;
+    std::uint64_t threshold;
+  };
+
+  // The fan-out: 'depth' levels of directories, each named by 'width' hex characters and so up to
+  // 16^width-way.  {5, 1}, the layout of stores which predate the choice, suits small stores;
+  // {2, 2} (2 x 256-way) and {3, 3} (3 x 4096-way) need fewer lookups per path on large ones.
+  // The layout in use is recorded in a manifest in the store root.  Opening a store with a
+  // different layout starts a background migration of its chunks into the new one, during which
+  // every operation also finds chunks still in the old layout.  An interrupted migration resumes
+  // the next time the store is opened.
+  struct Layout {
+    std::uint32_t depth;
+    std::uint32_t width;
+    bool operator==(const Layout& other) const {
+      return depth == other.depth && width == other.width;
+    }
+    bool operator!=(const Layout& other) const { return !(*this == other); }
+  };
+
+  explicit FileChunkEngine(const boost::filesystem::path& disk_path,
+                           std::shared_ptr<GroupCommitter> committer = nullptr,
+                           CacheBypass cache_bypass = CacheBypass{CacheBypass::Mode::kNone, 0},
+                           Layout layout = Layout{5, 1});
+  ~FileChunkEngine() override;
+  FileChunkEngine(const FileChunkEngine&) = delete;
+  FileChunkEngine(FileChunkEngine&&) = delete;
+  FileChunkEngine& operator=(const FileChunkEngine&) = delete;
+  FileChunkEngine& operator=(FileChunkEngine&&) = delete;
+
+  void Initialise() override;
+  void Put(const NameType& name, const std::vector<byte>& content) override;
+  std::vector<byte> Get(const NameType& name) const override;
+  // Maps the chunk's file rather than reading it, unless it bypasses the page cache.
+  void Read(const NameType& name, const Reader& reader) const override;
+  std::uint64_t Delete(const NameType& name) override;
+  std::vector<StoredChunk> Scan() const override;
+
+  void PutAsync(const NameType& name, const std::vector<byte>& content,
+                Completion handler) override;
+  void GetAsync(const NameType& name, std::uint64_t size, ReadCompletion handler) const override;
+
+  // Whether the asynchronous operations are backed by io_uring.  They aren't used while migrating.
+  bool HasNativeAsyncIo() const { return Uring() != nullptr; }
+  // Whether chunks are still being moved from an earlier layout.
+  bool Migrating() const { return migrating_; }
+
+ private:
+  static const std::size_t kMaxPathSize = 4096;
+  static const std::size_t kLockStripes = 64;
+
+  // Path of a chunk's file, built in a fixed-size buffer without allocating.  Each operation
+  // resolves the path once and reuses it for every access to the file.
+  class ChunkPath {
+   public:
+    ChunkPath(const FileChunkEngine& engine, const NameType& name);
+    ChunkPath(const FileChunkEngine& engine, const NameType& name, Layout layout);
+    const char* c_str() const { return buffer_.data(); }
+    boost::filesystem::path path() const { return boost::filesystem::path(c_str()); }
+    // The innermost fan-out directory, which holds the file.
+    boost::filesystem::path Directory() const;
+
+   private:
+    std::array<char, kMaxPathSize> buffer_;
+    std::size_t directory_size_;
+  };
+
+  // Reads the manifest, returning the layouts still in use with the current one first, and records
+  // this engine's layout in it.
+  std::vector<Layout> UpdateManifest() const;
+  void WriteManifest(const std::vector<Layout>& layouts) const;
+  // While migrating, operations on a chunk hold a lock shared with the migrator, and look for it
+  // in the earlier layouts if it isn't in the current one.  Otherwise the returned lock is empty.
+  std::unique_lock<std::mutex> LockIfMigrating(const NameType& name) const;
+  std::mutex& StripeFor(const NameType& name) const;
+  ChunkPath Locate(const NameType& name, bool migrating) const;
+  void RemoveFromEarlierLayouts(const NameType& name) const;
+  void Migrate();
+  // Moves the chunks in 'directory' into place, then those beneath it, and removes it if it isn't
+  // part of the current layout and is left empty.  Returns false if interrupted or if anything
+  // couldn't be moved.  'in_layout' is whether 'directory' is one of the current layout's.
+  bool MigrateDirectory(const boost::filesystem::path& directory, const std::string& prefix,
+                        std::uint32_t depth, bool in_layout);
+  bool MigrateChunk(const boost::filesystem::path& path, const NameType& name);
+  // Whether a chunk of 'size' bytes bypasses the page cache.
+  bool Bypasses(std::uint64_t size) const;
+  // Write and read a file without leaving its content in the page cache, returning false on
+  // failure.  A file found to be below the bypass threshold is read through a mapping instead.
+  bool WriteUncached(const boost::filesystem::path& path, const std::vector<byte>& content) const;
+  bool ReadUncached(const char* path, const Reader& reader) const;
+  UringQueue* Uring() const;
+  void ScanDirectory(const boost::filesystem::path& path, std::string prefix,
+                     std::vector<StoredChunk>& chunks) const;
+  NameType ComposeName(std::string file_name_str) const;
+
+  const boost::filesystem::path kDiskPath_;
+  const std::string kDiskPathString_;
+  const Layout kLayout_;
+  const std::shared_ptr<GroupCommitter> committer_;
+  const CacheBypass kCacheBypass_;
+  // Cleared on finding that the filesystem doesn't support O_DIRECT.
+  mutable std::atomic<bool> direct_io_;
+  mutable AlignedBufferPool buffers_;
+  mutable std::once_flag uring_flag_;
+  mutable std::unique_ptr<UringQueue> uring_;
+  // Layouts which may still hold chunks, most recent first; set by Initialise.
+  std::vector<Layout> earlier_layouts_;
+  std::atomic<bool> migrating_;
+  mutable std::array<std::mutex, kLockStripes> stripes_;
+  // Held by Scan throughout, and by the migrator while it moves the chunks of one directory, so
+  // that a scan sees each chunk once.
+  mutable std::mutex walk_mutex_;
+  std::atomic<bool> stop_migrating_;
+  std::thread migrator_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_FILE_CHUNK_ENGINE_H_
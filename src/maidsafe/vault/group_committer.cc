@@ -0,0 +1,242 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/group_committer.h"
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <utility>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+#ifdef _WIN32
+
+bool SyncFile(const fs::path& path) {
+  int fd(_wopen(path.c_str(), _O_RDWR | _O_BINARY));
+  if (fd < 0)
+    return false;
+  bool synced(_commit(fd) == 0);
+  return _close(fd) == 0 && synced;
+}
+
+// NTFS journals directory changes itself; there's no way to flush a directory handle.
+bool SyncDirectory(const fs::path& /*path*/) { return true; }
+
+#else
+
+bool Sync(const fs::path& path, int flags, bool data_only) {
+  int fd(open(path.c_str(), O_RDONLY | O_CLOEXEC | flags));
+  if (fd < 0)
+    return false;
+#ifdef __linux__
+  bool synced((data_only ? fdatasync(fd) : fsync(fd)) == 0);
+#else
+  static_cast<void>(data_only);
+  bool synced(fsync(fd) == 0);
+#endif
+  return close(fd) == 0 && synced;
+}
+
+bool SyncFile(const fs::path& path) { return Sync(path, 0, true); }
+
+bool SyncDirectory(const fs::path& path) { return Sync(path, O_DIRECTORY, false); }
+
+#endif
+
+}  // unnamed namespace
+
+GroupCommitter::GroupCommitter(std::chrono::microseconds commit_window)
+    : kCommitWindow_(commit_window),
+      mutex_(),
+      condition_(),
+      completion_condition_(),
+      pending_(),
+      completions_(),
+      group_count_(0),
+      stopping_(false),
+      commits_done_(false),
+      commit_thread_([this] { CommitLoop(); }),
+      completion_thread_([this] { CompletionLoop(); }) {}
+
+GroupCommitter::~GroupCommitter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  condition_.notify_all();
+  commit_thread_.join();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    commits_done_ = true;
+  }
+  completion_condition_.notify_all();
+  completion_thread_.join();
+}
+
+void GroupCommitter::Commit(const fs::path& file, const fs::path& target,
+                            const std::vector<fs::path>& created_directories) {
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool done(false);
+  std::error_code result;
+  auto wake([&](std::error_code error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    result = error;
+    done = true;
+    condition.notify_one();
+  });
+  Submit(Entry{file, target, created_directories, wake,
+               std::this_thread::get_id() == completion_thread_.get_id()});
+  std::unique_lock<std::mutex> lock(mutex);
+  condition.wait(lock, [&] { return done; });
+  if (result)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+}
+
+void GroupCommitter::CommitAsync(const fs::path& file, const fs::path& target,
+                                 const std::vector<fs::path>& created_directories,
+                                 Completion handler) {
+  Submit(Entry{file, target, created_directories, std::move(handler), false});
+}
+
+void GroupCommitter::Submit(Entry entry) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(std::move(entry));
+  }
+  condition_.notify_all();
+}
+
+std::uint64_t GroupCommitter::GroupCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return group_count_;
+}
+
+void GroupCommitter::CommitLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    condition_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+    if (pending_.empty())
+      return;
+    // Let the group fill for up to the commit window.
+    if (!stopping_)
+      condition_.wait_for(lock, kCommitWindow_, [this] { return stopping_; });
+    std::deque<Entry> group;
+    group.swap(pending_);
+    lock.unlock();
+
+    auto errors(CommitGroup(group));
+    std::deque<std::function<void()>> completions;
+    for (std::size_t i(0); i != group.size(); ++i) {
+      if (group[i].on_commit_thread)
+        group[i].handler(errors[i]);
+      else
+        completions.emplace_back(std::bind(std::move(group[i].handler), errors[i]));
+    }
+    lock.lock();
+    ++group_count_;
+    if (!completions.empty()) {
+      std::move(completions.begin(), completions.end(), std::back_inserter(completions_));
+      completion_condition_.notify_one();
+    }
+  }
+}
+
+void GroupCommitter::CompletionLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    completion_condition_.wait(lock, [this] { return commits_done_ || !completions_.empty(); });
+    if (completions_.empty())
+      return;
+    auto completion(std::move(completions_.front()));
+    completions_.pop_front();
+    lock.unlock();
+    try {
+      completion();
+    } catch (const std::exception& e) {
+      LOG(kError) << "Group commit handler threw: " << boost::diagnostic_information(e);
+    }
+    lock.lock();
+  }
+}
+
+std::vector<std::error_code> GroupCommitter::CommitGroup(const std::deque<Entry>& group) {
+  std::vector<std::error_code> errors(group.size());
+  const auto kIoError(make_error_code(CommonErrors::filesystem_io_error));
+  for (std::size_t i(0); i != group.size(); ++i) {
+    if (!SyncFile(group[i].file)) {
+      LOG(kError) << "Failed to flush " << group[i].file;
+      errors[i] = kIoError;
+    }
+  }
+
+  std::set<fs::path> directories;
+  for (std::size_t i(0); i != group.size(); ++i) {
+    if (errors[i] || group[i].target.empty())
+      continue;
+    boost::system::error_code error_code;
+    fs::rename(group[i].file, group[i].target, error_code);
+    if (error_code) {
+      LOG(kError) << "Failed to rename " << group[i].file << " to " << group[i].target << ": "
+                  << error_code.message();
+      errors[i] = kIoError;
+    } else {
+      directories.insert(group[i].target.parent_path());
+      for (const auto& created : group[i].created_directories)
+        directories.insert(created.parent_path());
+    }
+  }
+
+  // The renamed files have replaced their targets whether or not this succeeds, so failing them
+  // would leave the caller's view of what's stored out of step with the disk.
+  for (const auto& directory : directories) {
+    if (!SyncDirectory(directory))
+      LOG(kError) << "Failed to flush directory " << directory << ", so entries in it may be lost";
+  }
+  for (std::size_t i(0); i != group.size(); ++i) {
+    if (errors[i] && !group[i].target.empty()) {
+      boost::system::error_code error_code;
+      fs::remove(group[i].file, error_code);
+    }
+  }
+  return errors;
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,106 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_GROUP_COMMITTER_H_
+#define MAIDSAFE_VAULT_GROUP_COMMITTER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Makes files durable in groups.  Each submitted file is flushed to stable storage and, if a
+// target is given, atomically renamed over the target, after which the target's directory is
+// flushed too, along with the parent of each directory which was created to hold the file.
+// Submissions are gathered for up to the commit window after the first one arrives
+// (or for as long as the previous group takes), then the whole group is flushed on a dedicated
+// thread, each directory only once.  Concurrent writers therefore share the cost of the flushes.
+// Completions are handed to a second thread, in the order their groups were committed, so that a
+// handler which commits (or waits for anything which does) can't hold up the commits it depends
+// on.
+class GroupCommitter {
+ public:
+  using Completion = std::function<void(std::error_code error)>;
+
+  explicit GroupCommitter(std::chrono::microseconds commit_window);
+  // Completes everything already submitted.
+  ~GroupCommitter();
+  GroupCommitter(const GroupCommitter&) = delete;
+  GroupCommitter(GroupCommitter&&) = delete;
+  GroupCommitter& operator=(const GroupCommitter&) = delete;
+  GroupCommitter& operator=(GroupCommitter&&) = delete;
+
+  // Blocks until the group containing 'file' has been committed.  Throws
+  // CommonErrors::filesystem_io_error if 'file' can't be flushed or renamed, in which case it's
+  // removed if it was to be renamed.  Once 'file' has replaced the target, the commit succeeds
+  // even if a directory can't be flushed, since the rename can't be undone; the file is in place,
+  // but may not survive a crash, and the failure is logged.
+  void Commit(const boost::filesystem::path& file,
+              const boost::filesystem::path& target = boost::filesystem::path(),
+              const std::vector<boost::filesystem::path>& created_directories =
+                  std::vector<boost::filesystem::path>());
+  // As Commit, but runs 'handler' on the committer's completion thread instead of blocking.
+  void CommitAsync(const boost::filesystem::path& file, const boost::filesystem::path& target,
+                   const std::vector<boost::filesystem::path>& created_directories,
+                   Completion handler);
+
+  // Number of groups committed so far.
+  std::uint64_t GroupCount() const;
+
+ private:
+  struct Entry {
+    boost::filesystem::path file, target;
+    std::vector<boost::filesystem::path> created_directories;
+    Completion handler;
+    // Set for a Commit made by a handler on the completion thread, which only wakes the caller
+    // so is run on the commit thread instead, since the completion thread is waiting for it.
+    bool on_commit_thread;
+  };
+
+  void Submit(Entry entry);
+  void CommitLoop();
+  void CompletionLoop();
+  static std::vector<std::error_code> CommitGroup(const std::deque<Entry>& group);
+
+  const std::chrono::microseconds kCommitWindow_;
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+  std::condition_variable completion_condition_;
+  std::deque<Entry> pending_;
+  std::deque<std::function<void()>> completions_;
+  std::uint64_t group_count_;
+  bool stopping_, commits_done_;
+  std::thread commit_thread_, completion_thread_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_GROUP_COMMITTER_H_
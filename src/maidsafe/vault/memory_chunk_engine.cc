@@ -0,0 +1,97 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/memory_chunk_engine.h"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+const std::size_t MemoryChunkEngine::kShardCount;
+
+MemoryChunkEngine::MemoryChunkEngine() : shards_() {}
+
+void MemoryChunkEngine::Put(const NameType& name, const std::vector<byte>& content) {
+  // The copy is made before locking, and the replaced content freed after unlocking.
+  std::vector<byte> copy(content);
+  auto& shard(ShardFor(name));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.chunks[name].swap(copy);
+}
+
+std::vector<byte> MemoryChunkEngine::Get(const NameType& name) const {
+  std::vector<byte> content;
+  Read(name, [&](const byte* data, std::size_t size) { content.assign(data, data + size); });
+  return content;
+}
+
+void MemoryChunkEngine::Read(const NameType& name, const Reader& reader) const {
+  const auto& shard(ShardFor(name));
+  const std::vector<byte>* content(nullptr);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto itr(shard.chunks.find(name));
+    if (itr == shard.chunks.end())
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+    content = &itr->second;
+  }
+  // Map elements don't move as others are added or removed, and ChunkStore doesn't let this one
+  // be replaced or deleted during the read, so the shard needn't stay locked.
+  reader(content->data(), content->size());
+}
+
+std::uint64_t MemoryChunkEngine::Delete(const NameType& name) {
+  std::vector<byte> content;
+  {
+    auto& shard(ShardFor(name));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto itr(shard.chunks.find(name));
+    if (itr == shard.chunks.end()) {
+      LOG(kError) << "Can't delete " << name.name << ": not held";
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+    }
+    content.swap(itr->second);
+    shard.chunks.erase(itr);
+  }
+  return content.size();
+}
+
+std::vector<MemoryChunkEngine::StoredChunk> MemoryChunkEngine::Scan() const {
+  std::vector<StoredChunk> chunks;
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (const auto& chunk : shard.chunks)
+      chunks.push_back(StoredChunk{chunk.first, chunk.second.size()});
+  }
+  return chunks;
+}
+
+MemoryChunkEngine::Shard& MemoryChunkEngine::ShardFor(const NameType& name) {
+  return shards_[static_cast<byte>(name.name.string()[0]) % kShardCount];
+}
+
+const MemoryChunkEngine::Shard& MemoryChunkEngine::ShardFor(const NameType& name) const {
+  return shards_[static_cast<byte>(name.name.string()[0]) % kShardCount];
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,74 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_MEMORY_CHUNK_ENGINE_H_
+#define MAIDSAFE_VAULT_MEMORY_CHUNK_ENGINE_H_
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "maidsafe/vault/chunk_store_engine.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Holds every chunk in memory, for benchmarks, simulations and nodes without usable disk.  Nothing
+// is written to disk, so the content is lost when the engine is destroyed and Scan() only ever
+// reports what this instance holds.  Chunks are spread over kShardCount independently locked
+// shards by the leading byte of their hashed name, so operations on different names rarely
+// contend.  Reads hand out the held content in place.
+class MemoryChunkEngine : public ChunkStoreEngine {
+ public:
+  MemoryChunkEngine();
+  MemoryChunkEngine(const MemoryChunkEngine&) = delete;
+  MemoryChunkEngine(MemoryChunkEngine&&) = delete;
+  MemoryChunkEngine& operator=(const MemoryChunkEngine&) = delete;
+  MemoryChunkEngine& operator=(MemoryChunkEngine&&) = delete;
+
+  void Initialise() override {}
+  void Put(const NameType& name, const std::vector<byte>& content) override;
+  std::vector<byte> Get(const NameType& name) const override;
+  void Read(const NameType& name, const Reader& reader) const override;
+  // Throws CommonErrors::no_such_element if 'name' isn't held.
+  std::uint64_t Delete(const NameType& name) override;
+  std::vector<StoredChunk> Scan() const override;
+
+ private:
+  static const std::size_t kShardCount = 64;
+
+  struct Shard {
+    Shard() : mutex(), chunks() {}
+    mutable std::mutex mutex;
+    std::map<NameType, std::vector<byte>> chunks;
+  };
+
+  Shard& ShardFor(const NameType& name);
+  const Shard& ShardFor(const NameType& name) const;
+
+  std::array<Shard, kShardCount> shards_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_MEMORY_CHUNK_ENGINE_H_
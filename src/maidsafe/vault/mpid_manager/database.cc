@@ -71,6 +71,14 @@ bool MpidManagerDatabase::HasGroup(const GroupName& mpid) {
 }
 
 MessageKey MpidManagerDatabase::GetAccountChunkName(const GroupName& mpid) {
+  auto key(FindAccountChunkName(mpid));
+  if (!key)
+    BOOST_THROW_EXCEPTION(key.error());
+  return *key;
+}
+
+boost::expected<MessageKey, maidsafe_error> MpidManagerDatabase::FindAccountChunkName(
+    const GroupName& mpid) {
   std::lock_guard<std::mutex> lock(mutex_);
   EntryByMpid& mpid_index = boost::multi_index::get<EntryMpid_Tag>(container_);
   auto itr0(mpid_index.lower_bound(mpid));
@@ -80,7 +88,7 @@ MessageKey MpidManagerDatabase::GetAccountChunkName(const GroupName& mpid) {
       return itr0->key;
     ++itr0;
   }
-  BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  return boost::make_unexpected(MakeError(CommonErrors::no_such_element));
 }
 
 std::pair<uint32_t, uint32_t> MpidManagerDatabase::GetStatistic(const GroupName& mpid) {
@@ -24,6 +24,7 @@
 #include <utility>
 #include <vector>
 
+#include "boost/expected/expected.hpp"
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/global_fun.hpp"
 #include "boost/multi_index/member.hpp"
@@ -81,6 +82,8 @@ class MpidManagerDatabase {
 
   bool HasGroup(const GroupName& mpid);
   MessageKey GetAccountChunkName(const GroupName& mpid);
+  // As GetAccountChunkName, but returns CommonErrors::no_such_element rather than throwing it.
+  boost::expected<MessageKey, maidsafe_error> FindAccountChunkName(const GroupName& mpid);
   std::pair<uint32_t, uint32_t> GetStatistic(const GroupName& mpid);
   std::vector<MessageKey> GetEntriesForMPID(const GroupName& mpid);
 
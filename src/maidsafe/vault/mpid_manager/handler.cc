@@ -25,10 +25,16 @@ namespace maidsafe {
 namespace vault {
 
 MpidManagerHandler::MpidManagerHandler(const boost::filesystem::path& vault_root_dir,
-                                       DiskUsage max_disk_usage)
-    : chunk_store_(vault_root_dir / "mpid_manager" / "permanent", max_disk_usage),
+                                       DiskUsage max_disk_usage, ChunkStore::Engine engine,
+                                       ChunkStore::Compression compression)
+    : chunk_store_(std::make_shared<SharedChunkStore>(
+          vault_root_dir / "mpid_manager" / "permanent", max_disk_usage, engine,
+          ChunkStore::Durability::kBuffered, compression)),
       db_() {}
 
+MpidManagerHandler::MpidManagerHandler(std::shared_ptr<SharedChunkStore> chunk_store)
+    : chunk_store_(std::move(chunk_store)), db_() {}
+
 void MpidManagerHandler::Put(const ImmutableData& data, const MpidName& mpid) {
   PutChunk(data);
   db_.Put(data.Name(), static_cast<uint32_t>(data.Value().size()), mpid);
@@ -45,15 +51,9 @@ bool MpidManagerHandler::Has(const MessageIdType& message_id) {
 }
 
 bool MpidManagerHandler::HasAccount(const MpidName& mpid) {
-  try {
-    Identity account_name(db_.GetAccountChunkName(mpid));
-    Data::NameAndTypeId key(account_name, DataTypeId(0));
-    NonEmptyString result(chunk_store_.Get(key));
-    return result.IsInitialised();
-  }
-  catch (...) {
-    return false;
-  }
+  auto account_name(db_.FindAccountChunkName(mpid));
+  return account_name && chunk_store_->Has(Data::NameAndTypeId(*account_name, DataTypeId(0)),
+                                           SharedChunkStore::Owner::kMpidManager);
 }
 
 // mpid_account becomes a special entry in database with chunk_size to be 0
@@ -86,9 +86,11 @@ void MpidManagerHandler::RemoveAccount(const MpidName& mpid) {
 }
 
 DbMessageQueryResult MpidManagerHandler::GetMessage(const MessageIdType& message_id) const {
+  auto data(GetChunk(Data::NameAndTypeId(message_id, DataTypeId(0))));
+  if (!data)
+    return boost::make_unexpected(data.error());
   try {
-    Data::NameAndTypeId data_name(message_id, DataTypeId(0));
-    return Parse<MpidMessage>(GetChunk(data_name).Value().string());
+    return Parse<MpidMessage>(data->Value().string());
   }
   catch (const maidsafe_error& error) {
     return boost::make_unexpected(error);
@@ -96,31 +98,23 @@ DbMessageQueryResult MpidManagerHandler::GetMessage(const MessageIdType& message
 }
 
 DbDataQueryResult MpidManagerHandler::GetData(const Data::NameAndTypeId& data_name) const {
-  try {
-    return GetChunk(data_name);
-  }
-  catch (const maidsafe_error& error) {
-    return boost::make_unexpected(error);
-  }
+  return GetChunk(data_name);
 }
 
-ImmutableData MpidManagerHandler::GetChunk(const Data::NameAndTypeId& data_name) const {
-  try {
-    ImmutableData data(chunk_store_.Get(data_name));
-    return data;
-  }
-  catch (const maidsafe_error& /*error*/) {
-    throw;
-  }
+DbDataQueryResult MpidManagerHandler::GetChunk(const Data::NameAndTypeId& data_name) const {
+  auto content(chunk_store_->TryGet(data_name, SharedChunkStore::Owner::kMpidManager));
+  if (!content)
+    return boost::make_unexpected(content.error());
+  return ImmutableData(NonEmptyString(std::move(*content)));
 }
 
 void MpidManagerHandler::PutChunk(const ImmutableData& data) {
 //  VLOG(nfs::Persona::kPmidNode, VisualiserAction::kStoreChunk, data.name().value);
-  chunk_store_.Put(data.NameAndType(), data.Value());
+  chunk_store_->Put(data.NameAndType(), data.Value(), SharedChunkStore::Owner::kMpidManager);
 }
 
 void MpidManagerHandler::DeleteChunk(const Data::NameAndTypeId& data_name) {
-  chunk_store_.Delete(data_name);
+  chunk_store_->Delete(data_name, SharedChunkStore::Owner::kMpidManager);
 }
 
 // MpidManager::TransferInfo MpidManagerHandler::GetTransferInfo(
@@ -19,6 +19,7 @@
 #ifndef MAIDSAFE_VAULT_MPID_MANAGER_HANDLER_H_
 #define MAIDSAFE_VAULT_MPID_MANAGER_HANDLER_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 #include "boost/filesystem.hpp"
@@ -27,6 +28,7 @@
 #include "maidsafe/common/visualiser_log.h"
 
 #include "maidsafe/vault/chunk_store.h"
+#include "maidsafe/vault/shared_chunk_store.h"
 #include "maidsafe/vault/mpid_manager/database.h"
 #include "maidsafe/vault/mpid_manager/messages.h"
 
@@ -41,7 +43,13 @@ using DbDataQueryResult = boost::expected<ImmutableData, maidsafe_error>;
 
 class MpidManagerHandler {
  public:
-  MpidManagerHandler(const boost::filesystem::path& vault_root_dir, DiskUsage max_disk_usage);
+  // Messages are mostly text, so they're worth storing with 'compression' on; it can't be
+  // switched on for an existing store written without it (see ChunkStore::Compression).
+  MpidManagerHandler(const boost::filesystem::path& vault_root_dir, DiskUsage max_disk_usage,
+                     ChunkStore::Engine engine = ChunkStore::Engine::kFilePerChunk,
+                     ChunkStore::Compression compression = ChunkStore::Compression::kNone);
+  // Stores messages and accounts in 'chunk_store', which may be shared with other personas.
+  explicit MpidManagerHandler(std::shared_ptr<SharedChunkStore> chunk_store);
 
   void Put(const ImmutableData& data, const MpidName& mpid);
   void Delete(const MessageIdType& message_id);
@@ -59,13 +67,13 @@ class MpidManagerHandler {
 //      std::shared_ptr<routing::CloseNodesChange> close_nodes_change);
 
  private:
-  ImmutableData GetChunk(const Data::NameAndTypeId& data_name) const;
+  DbDataQueryResult GetChunk(const Data::NameAndTypeId& data_name) const;
 
   void PutChunk(const ImmutableData& data);
 
   void DeleteChunk(const Data::NameAndTypeId& data_name);
 
-  ChunkStore chunk_store_;
+  std::shared_ptr<SharedChunkStore> chunk_store_;
   MpidManagerDatabase db_;
 };
 
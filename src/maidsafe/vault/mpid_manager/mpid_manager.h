@@ -19,6 +19,7 @@
 #ifndef MAIDSAFE_VAULT_MPID_MANAGER_MPID_MANAGER_H_
 #define MAIDSAFE_VAULT_MPID_MANAGER_MPID_MANAGER_H_
 
+#include <memory>
 #include <vector>
 
 #include "maidsafe/common/types.h"
@@ -36,6 +37,7 @@ class MpidManager {
  public:
   MpidManager(const boost::filesystem::path& vault_root_dir,
               DiskUsage max_disk_usage);
+  explicit MpidManager(std::shared_ptr<SharedChunkStore> chunk_store);
   template <typename DataType>
   routing::HandleGetReturn HandleGet(routing::SourceAddress from, Identity data_name);
 
@@ -60,6 +62,10 @@ MpidManager<FacadeType>::MpidManager(const boost::filesystem::path& vault_root_d
                                      DiskUsage max_disk_usage)
     : handler_mutex_(), handler_(vault_root_dir, max_disk_usage) {}
 
+template <typename FacadeType>
+MpidManager<FacadeType>::MpidManager(std::shared_ptr<SharedChunkStore> chunk_store)
+    : handler_mutex_(), handler_(std::move(chunk_store)) {}
+
 template <typename FacadeType>
 routing::HandlePostReturn MpidManager<FacadeType>::HandlePost(routing::SourceAddress from,
                                                               MpidMessage mpid_message) {
@@ -0,0 +1,462 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/pack_chunk_engine.h"
+
+#include <algorithm>
+#include <string>
+
+#include "boost/crc.hpp"
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+#include "maidsafe/vault/chunk_store_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Record layout: magic(4) kind(1) type_id(4) name(identity_size) length(4) header_crc(4) payload
+const std::uint32_t kRecordMagic(0x4b50534d);  // "MSPK"
+const std::size_t kHeaderSize(4 + 1 + 4 + identity_size + 4 + 4);
+const std::size_t kCrcOffset(kHeaderSize - 4);
+const char kSegmentExtension[] = ".pack";
+
+std::uint32_t GetUint32(const byte* in) {
+  return detail::GetLittleEndian<std::uint32_t>(in);
+}
+
+void PutUint32(std::uint32_t value, byte* out) {
+  detail::PutLittleEndian(value, out);
+}
+
+std::uint32_t HeaderCrc(const byte* header) {
+  boost::crc_32_type crc;
+  crc.process_bytes(header, kCrcOffset);
+  return crc.checksum();
+}
+
+bool ValidHeader(const byte* header) {
+  return GetUint32(header) == kRecordMagic && GetUint32(header + kCrcOffset) == HeaderCrc(header);
+}
+
+}  // unnamed namespace
+
+struct PackChunkEngine::Segment {
+  Segment(fs::path path_in, std::uint32_t number_in)
+      : path(std::move(path_in)),
+        number(number_in),
+        size(0),
+        dead_bytes(0),
+        retired(false),
+        corrupt(false) {}
+  // A retired segment is only unlinked once the last Get still reading from it has finished.
+  ~Segment() {
+    if (retired) {
+      boost::system::error_code error_code;
+      fs::remove(path, error_code);
+      if (error_code)
+        LOG(kWarning) << "Failed to remove compacted segment " << path << ": "
+                      << error_code.message();
+    }
+  }
+
+  const fs::path path;
+  const std::uint32_t number;
+  std::uint64_t size, dead_bytes;
+  bool retired;
+  // Set if compaction finds a record which has rotted since the segment was loaded.  The segment is
+  // then left alone, and its intact records stay readable where they are.
+  bool corrupt;
+};
+
+PackChunkEngine::PackChunkEngine(const fs::path& disk_path, std::uint64_t max_segment_size,
+                                 std::chrono::seconds compaction_interval,
+                                 std::shared_ptr<GroupCommitter> committer)
+    : kDiskPath_(disk_path),
+      kMaxSegmentSize_(max_segment_size),
+      kCompactionInterval_(compaction_interval),
+      committer_(std::move(committer)),
+      index_(),
+      segments_(),
+      active_segment_(0),
+      active_stream_(),
+      mutex_(),
+      compaction_mutex_(),
+      compaction_condition_(),
+      stop_(false),
+      compaction_thread_() {}
+
+PackChunkEngine::~PackChunkEngine() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  compaction_condition_.notify_one();
+  if (compaction_thread_.joinable())
+    compaction_thread_.join();
+}
+
+void PackChunkEngine::Initialise() {
+  boost::system::error_code error_code;
+  if (!fs::exists(kDiskPath_, error_code)) {
+    if (!fs::create_directories(kDiskPath_, error_code)) {
+      LOG(kError) << "Can't create disk root at " << kDiskPath_ << ": " << error_code.message();
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::uninitialised));
+    }
+  } else if (!fs::is_directory(kDiskPath_, error_code)) {
+    LOG(kError) << kDiskPath_ << " is not a directory";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::not_a_directory));
+  }
+
+  std::vector<std::uint32_t> numbers;
+  for (fs::directory_iterator it(kDiskPath_); it != fs::directory_iterator(); ++it) {
+    if (it->path().extension() != kSegmentExtension)
+      continue;
+    try {
+      numbers.push_back(static_cast<std::uint32_t>(std::stoul(it->path().stem().string())));
+    } catch (const std::exception&) {
+      LOG(kWarning) << "Ignoring unrecognised file " << it->path();
+    }
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto number : numbers)
+    LoadSegment(number, number == numbers.back());
+  if (numbers.empty()) {
+    OpenNewSegment(1);
+  } else {
+    active_segment_ = numbers.back();
+    active_stream_.open(SegmentPath(active_segment_).string(),
+                        std::ios::binary | std::ios::out | std::ios::app);
+    if (!active_stream_) {
+      LOG(kError) << "Failed to open " << SegmentPath(active_segment_) << " for appending";
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+  }
+  compaction_thread_ = std::thread([this] { CompactionLoop(); });
+}
+
+void PackChunkEngine::Put(const NameType& name, const std::vector<byte>& content) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto location(AppendRecord(RecordKind::kPut, name, content));
+  auto itr(index_.find(name));
+  if (itr != index_.end()) {
+    MarkDead(itr->second);
+    itr->second = location;
+  } else {
+    index_.emplace(name, location);
+  }
+  // Flushes of appends made by concurrent Puts are grouped.  Holding the segment keeps its file
+  // from being removed meanwhile.
+  std::shared_ptr<Segment> segment(committer_ ? segments_.at(location.segment) : nullptr);
+  lock.unlock();
+  if (segment)
+    committer_->Commit(segment->path);
+}
+
+std::vector<byte> PackChunkEngine::Get(const NameType& name) const {
+  auto found(Find(name));
+  const Location& location(found.first);
+  const auto& segment(found.second);
+  std::vector<byte> content(location.length);
+  std::ifstream stream(segment->path.string(), std::ios::binary);
+  stream.seekg(static_cast<std::streamoff>(location.offset));
+  stream.read(reinterpret_cast<char*>(content.data()), location.length);
+  if (!stream) {
+    LOG(kError) << "Failed to read " << location.length << " bytes at " << location.offset
+                << " from " << segment->path;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  return content;
+}
+
+void PackChunkEngine::Read(const NameType& name, const Reader& reader) const {
+  auto found(Find(name));
+  const Location& location(found.first);
+  if (location.length == 0) {
+    reader(nullptr, 0);
+    return;
+  }
+  if (!detail::ReadMappedFile(found.second->path, location.offset, location.length, reader)) {
+    LOG(kError) << "Failed to map " << location.length << " bytes at " << location.offset
+                << " from " << found.second->path;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+}
+
+std::pair<PackChunkEngine::Location, std::shared_ptr<PackChunkEngine::Segment>>
+    PackChunkEngine::Find(const NameType& name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto itr(index_.find(name));
+  if (itr == index_.end())
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  // Holding the segment keeps its file alive even if compaction retires it meanwhile.
+  return std::make_pair(itr->second, segments_.at(itr->second.segment));
+}
+
+std::uint64_t PackChunkEngine::Delete(const NameType& name) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto itr(index_.find(name));
+  if (itr == index_.end())
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  AppendRecord(RecordKind::kTombstone, name, std::vector<byte>());
+  segments_.at(active_segment_)->dead_bytes += kHeaderSize;
+  Location location(itr->second);
+  MarkDead(location);
+  index_.erase(itr);
+  bool notify(location.segment != active_segment_ &&
+              NeedsCompaction(*segments_.at(location.segment)));
+  std::shared_ptr<Segment> active(committer_ ? segments_.at(active_segment_) : nullptr);
+  lock.unlock();
+  if (notify)
+    compaction_condition_.notify_one();
+  if (active)
+    committer_->Commit(active->path);
+  return location.length;
+}
+
+std::vector<PackChunkEngine::StoredChunk> PackChunkEngine::Scan() const {
+  std::vector<StoredChunk> chunks;
+  std::lock_guard<std::mutex> lock(mutex_);
+  chunks.reserve(index_.size());
+  for (const auto& entry : index_)
+    chunks.push_back(StoredChunk{entry.first, entry.second.length});
+  return chunks;
+}
+
+void PackChunkEngine::Compact() {
+  std::lock_guard<std::mutex> compaction_lock(compaction_mutex_);
+  std::vector<std::shared_ptr<Segment>> candidates;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& segment : segments_) {
+      if (segment.first != active_segment_ && NeedsCompaction(*segment.second))
+        candidates.push_back(segment.second);
+    }
+  }
+  for (const auto& segment : candidates)
+    CompactSegment(segment);
+}
+
+std::size_t PackChunkEngine::SegmentCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return segments_.size();
+}
+
+fs::path PackChunkEngine::SegmentPath(std::uint32_t number) const {
+  std::string stem(std::to_string(number));
+  return kDiskPath_ / (std::string(std::max<std::size_t>(8, stem.size()) - stem.size(), '0') +
+                       stem + kSegmentExtension);
+}
+
+void PackChunkEngine::LoadSegment(std::uint32_t number, bool is_last) {
+  auto segment(std::make_shared<Segment>(SegmentPath(number), number));
+  std::uint64_t file_size(fs::file_size(segment->path));
+  std::ifstream stream(segment->path.string(), std::ios::binary);
+  byte header[kHeaderSize];
+  while (segment->size + kHeaderSize <= file_size) {
+    stream.seekg(static_cast<std::streamoff>(segment->size));
+    if (!stream.read(reinterpret_cast<char*>(header), kHeaderSize) || !ValidHeader(header))
+      break;
+    std::uint32_t length(GetUint32(header + kCrcOffset - 4));
+    if (segment->size + kHeaderSize + length > file_size)
+      break;
+    NameType name(Identity(std::vector<byte>(header + 9, header + 9 + identity_size)),
+                  DataTypeId(GetUint32(header + 5)));
+    auto itr(index_.find(name));
+    if (itr != index_.end()) {
+      if (itr->second.segment == number)
+        segment->dead_bytes += kHeaderSize + itr->second.length;
+      else
+        MarkDead(itr->second);
+      index_.erase(itr);
+    }
+    if (static_cast<RecordKind>(header[4]) == RecordKind::kPut)
+      index_.emplace(name, Location{number, segment->size + kHeaderSize, length});
+    else
+      segment->dead_bytes += kHeaderSize;
+    segment->size += kHeaderSize + length;
+  }
+
+  if (segment->size != file_size) {
+    if (is_last) {
+      // Most likely a record torn by a crash mid-append; drop it so new records follow on cleanly.
+      LOG(kWarning) << "Truncating " << segment->path << " from " << file_size << " to "
+                    << segment->size << " bytes";
+      stream.close();
+      fs::resize_file(segment->path, segment->size);
+    } else {
+      LOG(kError) << segment->path << " is corrupt after offset " << segment->size
+                  << "; remaining records are ignored";
+      segment->dead_bytes += file_size - segment->size;
+      segment->size = file_size;
+    }
+  }
+  segments_.emplace(number, segment);
+}
+
+void PackChunkEngine::OpenNewSegment(std::uint32_t number) {
+  if (active_stream_.is_open())
+    active_stream_.close();
+  active_stream_.open(SegmentPath(number).string(),
+                      std::ios::binary | std::ios::out | std::ios::trunc);
+  if (!active_stream_) {
+    LOG(kError) << "Failed to create segment " << SegmentPath(number);
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  segments_.emplace(number, std::make_shared<Segment>(SegmentPath(number), number));
+  active_segment_ = number;
+}
+
+PackChunkEngine::Location PackChunkEngine::AppendRecord(RecordKind kind, const NameType& name,
+                                                        const std::vector<byte>& content) {
+  auto active(segments_.at(active_segment_));
+  if (active->size != 0 && active->size + kHeaderSize + content.size() > kMaxSegmentSize_) {
+    OpenNewSegment(active_segment_ + 1);
+    active = segments_.at(active_segment_);
+  }
+
+  byte header[kHeaderSize];
+  PutUint32(kRecordMagic, header);
+  header[4] = static_cast<byte>(kind);
+  PutUint32(name.type_id.data, header + 5);
+  const auto& raw_name(name.name.string());
+  std::copy(raw_name.begin(), raw_name.end(), header + 9);
+  PutUint32(static_cast<std::uint32_t>(content.size()), header + kCrcOffset - 4);
+  PutUint32(HeaderCrc(header), header + kCrcOffset);
+
+  active_stream_.write(reinterpret_cast<const char*>(header), kHeaderSize);
+  active_stream_.write(reinterpret_cast<const char*>(content.data()), content.size());
+  active_stream_.flush();
+  if (!active_stream_) {
+    LOG(kError) << "Failed to append to " << active->path;
+    // Part of the record may have reached the file, so nothing more can be appended after it.
+    // The partial record is ignored when the (then sealed) segment is next loaded.
+    try {
+      OpenNewSegment(active_segment_ + 1);
+    } catch (const std::exception&) {}
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  Location location{active_segment_, active->size + kHeaderSize,
+                    static_cast<std::uint32_t>(content.size())};
+  active->size += kHeaderSize + content.size();
+  return location;
+}
+
+void PackChunkEngine::MarkDead(const Location& location) {
+  auto itr(segments_.find(location.segment));
+  if (itr != segments_.end())
+    itr->second->dead_bytes += kHeaderSize + location.length;
+}
+
+void PackChunkEngine::CompactSegment(const std::shared_ptr<Segment>& segment) {
+  std::uint32_t first_target(0);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    first_target = active_segment_;
+  }
+  std::ifstream stream(segment->path.string(), std::ios::binary);
+  std::uint64_t offset(0);
+  byte header[kHeaderSize];
+  std::vector<byte> content;
+  while (offset + kHeaderSize <= segment->size &&
+         stream.read(reinterpret_cast<char*>(header), kHeaderSize)) {
+    // Records are checked as LoadSegment checks them, since the segment may have rotted since.
+    std::uint32_t length(GetUint32(header + kCrcOffset - 4));
+    if (!ValidHeader(header) || offset + kHeaderSize + length > segment->size)
+      break;
+    NameType name(Identity(std::vector<byte>(header + 9, header + 9 + identity_size)),
+                  DataTypeId(GetUint32(header + 5)));
+    content.resize(length);
+    if (!stream.read(reinterpret_cast<char*>(content.data()), length))
+      break;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto itr(index_.find(name));
+    if (static_cast<RecordKind>(header[4]) == RecordKind::kPut) {
+      if (itr != index_.end() && itr->second.segment == segment->number &&
+          itr->second.offset == offset + kHeaderSize) {
+        itr->second = AppendRecord(RecordKind::kPut, name, content);
+      }
+    } else if (itr == index_.end() && segments_.begin()->first < segment->number) {
+      // The tombstone may still be hiding a record in an older segment.
+      AppendRecord(RecordKind::kTombstone, name, content);
+      segments_.at(active_segment_)->dead_bytes += kHeaderSize;
+    }
+    offset += kHeaderSize + length;
+  }
+
+  if (committer_) {
+    // The copied records must be durable before the only other copy of them is removed.
+    std::vector<std::shared_ptr<Segment>> targets;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto itr(segments_.lower_bound(first_target)); itr != segments_.end(); ++itr)
+        targets.push_back(itr->second);
+    }
+    try {
+      for (const auto& target : targets)
+        committer_->Commit(target->path);
+    } catch (const std::exception&) {
+      LOG(kError) << "Failed to flush compacted records from " << segment->path;
+      return;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (offset < segment->size) {
+    LOG(kError) << "Stopped compacting " << segment->path << " at offset " << offset;
+    segment->corrupt = true;
+    return;
+  }
+  segment->retired = true;
+  segments_.erase(segment->number);
+}
+
+bool PackChunkEngine::NeedsCompaction(const Segment& segment) const {
+  return !segment.corrupt && segment.dead_bytes * 2 >= segment.size;
+}
+
+void PackChunkEngine::CompactionLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    compaction_condition_.wait_for(lock, kCompactionInterval_);
+    if (stop_)
+      break;
+    lock.unlock();
+    try {
+      Compact();
+    } catch (const std::exception& e) {
+      LOG(kError) << "Compaction of " << kDiskPath_ << " failed: "
+                  << boost::diagnostic_information(e);
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
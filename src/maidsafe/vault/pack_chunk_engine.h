@@ -0,0 +1,113 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_PACK_CHUNK_ENGINE_H_
+#define MAIDSAFE_VAULT_PACK_CHUNK_ENGINE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/vault/chunk_store_engine.h"
+#include "maidsafe/vault/group_committer.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Appends chunks to numbered segment files in the store root and keeps an in-memory index of
+// name -> (segment, offset, length).  A Delete appends a tombstone, so the index can be rebuilt
+// on startup by reading the record headers of each segment in order.  Sealed segments which are
+// at least half garbage are rewritten by a background compaction thread.
+class PackChunkEngine : public ChunkStoreEngine {
+ public:
+  // If 'committer' is given, Put and Delete don't return until their records have been flushed
+  // to disk (in groups), and compaction flushes copied records before removing the originals.
+  explicit PackChunkEngine(const boost::filesystem::path& disk_path,
+                           std::uint64_t max_segment_size = 256 * 1024 * 1024,
+                           std::chrono::seconds compaction_interval = std::chrono::seconds(60),
+                           std::shared_ptr<GroupCommitter> committer = nullptr);
+  ~PackChunkEngine() override;
+  PackChunkEngine(const PackChunkEngine&) = delete;
+  PackChunkEngine(PackChunkEngine&&) = delete;
+  PackChunkEngine& operator=(const PackChunkEngine&) = delete;
+  PackChunkEngine& operator=(PackChunkEngine&&) = delete;
+
+  void Initialise() override;
+  void Put(const NameType& name, const std::vector<byte>& content) override;
+  std::vector<byte> Get(const NameType& name) const override;
+  // Maps the record's payload from its segment rather than reading it.
+  void Read(const NameType& name, const Reader& reader) const override;
+  std::uint64_t Delete(const NameType& name) override;
+  std::vector<StoredChunk> Scan() const override;
+
+  // Rewrites the live records of every sealed segment which qualifies for compaction.  Normally
+  // run by the background thread.
+  void Compact();
+  std::size_t SegmentCount() const;
+
+ private:
+  struct Segment;
+  struct Location {
+    std::uint32_t segment;
+    std::uint64_t offset;
+    std::uint32_t length;
+  };
+  enum class RecordKind : byte { kPut = 0, kTombstone = 1 };
+
+  boost::filesystem::path SegmentPath(std::uint32_t number) const;
+  void LoadSegment(std::uint32_t number, bool is_last);
+  void OpenNewSegment(std::uint32_t number);
+  // Must be called with 'mutex_' held.  Returns the location of the record's payload.
+  Location AppendRecord(RecordKind kind, const NameType& name, const std::vector<byte>& content);
+  // Looks up 'name' and pins the segment holding it.
+  std::pair<Location, std::shared_ptr<Segment>> Find(const NameType& name) const;
+  void MarkDead(const Location& location);
+  void CompactSegment(const std::shared_ptr<Segment>& segment);
+  bool NeedsCompaction(const Segment& segment) const;
+  void CompactionLoop();
+
+  const boost::filesystem::path kDiskPath_;
+  const std::uint64_t kMaxSegmentSize_;
+  const std::chrono::seconds kCompactionInterval_;
+  const std::shared_ptr<GroupCommitter> committer_;
+  std::map<NameType, Location> index_;
+  std::map<std::uint32_t, std::shared_ptr<Segment>> segments_;
+  std::uint32_t active_segment_;
+  std::ofstream active_stream_;
+  mutable std::mutex mutex_;
+  std::mutex compaction_mutex_;
+  std::condition_variable compaction_condition_;
+  bool stop_;
+  std::thread compaction_thread_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_PACK_CHUNK_ENGINE_H_
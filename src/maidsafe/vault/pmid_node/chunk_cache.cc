@@ -0,0 +1,143 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/pmid_node/chunk_cache.h"
+
+#include <utility>
+
+namespace maidsafe {
+
+namespace vault {
+
+ChunkCache::ChunkCache(MemoryUsage capacity)
+    : kCapacity_(capacity.data),
+      kProtectedCapacity_(capacity.data / 5 * 4),
+      kMaxEntrySize_(capacity.data / 8),
+      mutex_(),
+      entries_(),
+      probation_(),
+      protected_(),
+      probation_size_(0),
+      protected_size_(0),
+      epoch_(0),
+      stats_(Stats{0, 0, 0, 0, 0, 0, 0, 0}) {}
+
+bool ChunkCache::Get(const NameType& name, std::vector<byte>& value) {
+  std::shared_ptr<const std::vector<byte>> cached;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto itr(entries_.find(name));
+    if (itr == entries_.end()) {
+      ++stats_.misses;
+      return false;
+    }
+    ++stats_.hits;
+    cached = itr->second.value;
+    MoveTo(itr->second, Segment::kProtected);
+    // Overflow from the protected segment gets a second chance in the probationary one.
+    while (protected_size_ > kProtectedCapacity_)
+      MoveTo(entries_.at(protected_.back()), Segment::kProbation);
+  }
+  // Copy outside the lock; the shared pointer keeps the value alive if it's evicted meanwhile.
+  value.assign(cached->begin(), cached->end());
+  return true;
+}
+
+std::uint64_t ChunkCache::InsertToken() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return epoch_;
+}
+
+void ChunkCache::Insert(const NameType& name, const std::vector<byte>& value,
+                        std::uint64_t token) {
+  if (value.size() > kMaxEntrySize_) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.rejections;
+    return;
+  }
+  auto copy(std::make_shared<const std::vector<byte>>(value));
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (token != epoch_) {
+    ++stats_.rejections;
+    return;
+  }
+  auto itr(entries_.find(name));
+  if (itr != entries_.end()) {
+    SegmentSize(itr->second.segment) -= itr->second.value->size();
+    itr->second.value = std::move(copy);
+    SegmentSize(itr->second.segment) += itr->second.value->size();
+  } else {
+    probation_.push_front(name);
+    entries_.emplace(name, Entry{std::move(copy), Segment::kProbation, probation_.begin()});
+    probation_size_ += value.size();
+  }
+  ++stats_.insertions;
+  Trim();
+}
+
+void ChunkCache::Invalidate(const NameType& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++epoch_;
+  auto itr(entries_.find(name));
+  if (itr == entries_.end())
+    return;
+  ++stats_.invalidations;
+  Erase(itr);
+}
+
+ChunkCache::Stats ChunkCache::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats(stats_);
+  stats.size = probation_size_ + protected_size_;
+  stats.count = entries_.size();
+  return stats;
+}
+
+std::list<ChunkCache::NameType>& ChunkCache::List(Segment segment) {
+  return segment == Segment::kProbation ? probation_ : protected_;
+}
+
+std::uint64_t& ChunkCache::SegmentSize(Segment segment) {
+  return segment == Segment::kProbation ? probation_size_ : protected_size_;
+}
+
+void ChunkCache::MoveTo(Entry& entry, Segment segment) {
+  auto& target(List(segment));
+  target.splice(target.begin(), List(entry.segment), entry.position);
+  SegmentSize(entry.segment) -= entry.value->size();
+  SegmentSize(segment) += entry.value->size();
+  entry.segment = segment;
+}
+
+void ChunkCache::Erase(std::map<NameType, Entry>::iterator itr) {
+  SegmentSize(itr->second.segment) -= itr->second.value->size();
+  List(itr->second.segment).erase(itr->second.position);
+  entries_.erase(itr);
+}
+
+void ChunkCache::Trim() {
+  while (probation_size_ + protected_size_ > kCapacity_) {
+    auto& victims(probation_.empty() ? protected_ : probation_);
+    Erase(entries_.find(victims.back()));
+    ++stats_.evictions;
+  }
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
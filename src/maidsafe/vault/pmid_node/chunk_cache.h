@@ -0,0 +1,96 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_PMID_NODE_CHUNK_CACHE_H_
+#define MAIDSAFE_VAULT_PMID_NODE_CHUNK_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/data.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Memory-bounded cache of decrypted chunks, managed as a segmented LRU.  A newly inserted chunk
+// enters a probationary segment and is only promoted to the protected segment (at most 80% of the
+// capacity) when it is read again while still cached, so a scan of chunks read once can't flush
+// the popular ones.  Chunks larger than an eighth of the capacity aren't admitted at all.
+//
+// To stop a chunk read from the store before an invalidation from being cached after it, take an
+// InsertToken() before reading from the store and pass it to Insert(); the insertion is dropped if
+// anything was invalidated in between.  All member functions are thread-safe.
+class ChunkCache {
+ public:
+  using NameType = Data::NameAndTypeId;
+
+  struct Stats {
+    std::uint64_t hits, misses, insertions, rejections, evictions, invalidations;
+    std::uint64_t size, count;
+  };
+
+  explicit ChunkCache(MemoryUsage capacity);
+  ChunkCache(const ChunkCache&) = delete;
+  ChunkCache(ChunkCache&&) = delete;
+  ChunkCache& operator=(const ChunkCache&) = delete;
+  ChunkCache& operator=(ChunkCache&&) = delete;
+
+  // Copies the cached value into 'value', reusing its capacity.  Returns false on a miss.
+  bool Get(const NameType& name, std::vector<byte>& value);
+  std::uint64_t InsertToken() const;
+  void Insert(const NameType& name, const std::vector<byte>& value, std::uint64_t token);
+  void Invalidate(const NameType& name);
+
+  MemoryUsage Capacity() const { return MemoryUsage(kCapacity_); }
+  Stats GetStats() const;
+
+ private:
+  enum class Segment { kProbation, kProtected };
+  struct Entry {
+    std::shared_ptr<const std::vector<byte>> value;
+    Segment segment;
+    std::list<NameType>::iterator position;
+  };
+
+  std::list<NameType>& List(Segment segment);
+  std::uint64_t& SegmentSize(Segment segment);
+  // Moves 'entry' to the most recently used end of 'segment'.
+  void MoveTo(Entry& entry, Segment segment);
+  void Erase(std::map<NameType, Entry>::iterator itr);
+  void Trim();
+
+  const std::uint64_t kCapacity_, kProtectedCapacity_, kMaxEntrySize_;
+  mutable std::mutex mutex_;
+  std::map<NameType, Entry> entries_;
+  // Front is most recently used.
+  std::list<NameType> probation_, protected_;
+  std::uint64_t probation_size_, protected_size_, epoch_;
+  Stats stats_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_PMID_NODE_CHUNK_CACHE_H_
@@ -19,13 +19,23 @@
 #ifndef MAIDSAFE_VAULT_PMID_NODE_PMID_NODE_H_
 #define MAIDSAFE_VAULT_PMID_NODE_PMID_NODE_H_
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/immutable_data.h"
+#include "maidsafe/common/serialisation/serialisation.h"
 #include "maidsafe/routing/types.h"
 
 #include "maidsafe/vault/chunk_store.h"
+#include "maidsafe/vault/shared_chunk_store.h"
+#include "maidsafe/vault/pmid_node/chunk_cache.h"
 
 
 namespace maidsafe {
@@ -35,50 +45,136 @@ namespace vault {
 template <typename FacadeType>
 class PmidNode {
  public:
-  PmidNode(const boost::filesystem::path vault_root_dir, DiskUsage max_disk_usage);
+  // Decrypted copies of recently read chunks are kept in memory up to 'cache_capacity'; pass 0 to
+  // disable the cache.  If 'fast_tier' has a path, hot chunks are kept there, up to its own limit,
+  // in addition to 'max_disk_usage' under 'vault_root_dir' (see ChunkStore::FastTier).
+  PmidNode(const boost::filesystem::path vault_root_dir, DiskUsage max_disk_usage,
+           ChunkStore::Engine engine = ChunkStore::Engine::kFilePerChunk,
+           MemoryUsage cache_capacity = MemoryUsage(64 * 1024 * 1024),
+           ChunkStore::FastTier fast_tier = ChunkStore::FastTier{boost::filesystem::path(),
+                                                                 DiskUsage(0)});
+  // Stores chunks in 'chunk_store', which may be shared with other personas, instead of a store of
+  // its own.
+  explicit PmidNode(std::shared_ptr<SharedChunkStore> chunk_store,
+                    MemoryUsage cache_capacity = MemoryUsage(64 * 1024 * 1024));
+  // Stops the scrubber before the cache it invalidates is destroyed.
+  ~PmidNode() { StopScrubbing(); }
 
   routing::HandleGetReturn HandleGet(routing::SourceAddress from,
                                      Data::NameAndTypeId name_and_type_id);
+  // As HandleGet, but returns only up to 'length' bytes of the stored chunk from 'offset', reading
+  // and decrypting as little of it as the chunk's format allows (see ChunkStore::Get).  Fails with
+  // CommonErrors::invalid_argument if 'offset' is beyond the end of the chunk.
+  routing::HandleGetReturn HandleGetRange(routing::SourceAddress from,
+                                          Data::NameAndTypeId name_and_type_id,
+                                          std::uint64_t offset, std::uint64_t length);
 
   template <typename DataType>
   routing::HandlePutPostReturn HandlePut(routing::SourceAddress from, DataType data);
+  void HandleDelete(Data::NameAndTypeId name_and_type_id);
   void HandleChurn(routing::CloseGroupDifference);
 
+  // Verifies stored chunks in the background (see ChunkStore::StartScrubbing).  ImmutableData
+  // must also hash to its name once decrypted.  A corrupt chunk is purged, even if other personas
+  // reference it, so that it's never served, and passed to 'on_corrupt', which should arrange for
+  // it to be re-replicated.  Without 'names', the chunks this persona holds references to are
+  // verified.
+  void StartScrubbing(ChunkStore::NameSource names, std::uint64_t bytes_per_second,
+                      std::function<void(const Data::NameAndTypeId&)> on_corrupt);
+  void StartScrubbing(std::uint64_t bytes_per_second,
+                      std::function<void(const Data::NameAndTypeId&)> on_corrupt);
+  void StopScrubbing() { chunk_store_->Store().StopScrubbing(); }
+
+  ChunkCache::Stats CacheStats() const { return cache_.GetStats(); }
+
  private:
 //  boost::filesystem::space_info space_info_;
   DiskUsage disk_total_;
   DiskUsage permanent_size_;
-  ChunkStore chunk_store_;
+  std::shared_ptr<SharedChunkStore> chunk_store_;
+  ChunkCache cache_;
 };
 
 template <typename FacadeType>
 PmidNode<FacadeType>::PmidNode(const boost::filesystem::path vault_root_dir,
-                               DiskUsage max_disk_usage)
+                               DiskUsage max_disk_usage, ChunkStore::Engine engine,
+                               MemoryUsage cache_capacity, ChunkStore::FastTier fast_tier)
     : /*space_info_(boost::filesystem::space(vault_root_dir)),*/
 //      disk_total_(space_info_.available),
       disk_total_(max_disk_usage),
       permanent_size_(disk_total_ * 4 / 5),
-      chunk_store_(vault_root_dir / "pmid_node" / "permanent", max_disk_usage) {}
+      chunk_store_(std::make_shared<SharedChunkStore>(
+          vault_root_dir / "pmid_node" / "permanent", max_disk_usage, engine,
+          ChunkStore::Durability::kBuffered, ChunkStore::Compression::kNone,
+          ChunkStore::CacheBypass{ChunkStore::CacheBypass::Mode::kNone, 0}, fast_tier)),
+      cache_(cache_capacity) {}
+
+template <typename FacadeType>
+PmidNode<FacadeType>::PmidNode(std::shared_ptr<SharedChunkStore> chunk_store,
+                               MemoryUsage cache_capacity)
+    : disk_total_(chunk_store->Store().MaxDiskUsage()),
+      permanent_size_(disk_total_ * 4 / 5),
+      chunk_store_(std::move(chunk_store)),
+      cache_(cache_capacity) {}
 
 template <typename FacadeType>
 routing::HandleGetReturn PmidNode<FacadeType>::HandleGet(routing::SourceAddress /* from */,
                                                          Data::NameAndTypeId name_and_type_id) {
   try {
-    auto deobfuscated_data(chunk_store_.Get(name_and_type_id));
-    return routing::HandleGetReturn::value_type(
-                std::vector<byte>(std::begin(deobfuscated_data.string()),
-                                  std::end(deobfuscated_data.string())));
+    std::vector<byte> deobfuscated_data;
+    if (cache_.Get(name_and_type_id, deobfuscated_data))
+      return routing::HandleGetReturn::value_type(std::move(deobfuscated_data));
+    // Requests for chunks which aren't held are common after churn, and are failed without
+    // throwing.
+    auto token(cache_.InsertToken());
+    auto result(chunk_store_->TryGet(name_and_type_id, SharedChunkStore::Owner::kPmidNode));
+    if (!result)
+      return boost::make_unexpected(MakeError(CommonErrors::no_such_element));
+    cache_.Insert(name_and_type_id, *result, token);
+    return routing::HandleGetReturn::value_type(std::move(*result));
   } catch (const std::exception& /*e*/) {
     return boost::make_unexpected(MakeError(CommonErrors::no_such_element));
   }
 }
 
+template <typename FacadeType>
+routing::HandleGetReturn PmidNode<FacadeType>::HandleGetRange(
+    routing::SourceAddress /* from */, Data::NameAndTypeId name_and_type_id, std::uint64_t offset,
+    std::uint64_t length) {
+  try {
+    std::vector<byte> deobfuscated_data;
+    // A cached chunk is already decrypted, so is cheaper to slice than to read the range again.
+    if (cache_.Get(name_and_type_id, deobfuscated_data)) {
+      if (offset > deobfuscated_data.size())
+        return boost::make_unexpected(MakeError(CommonErrors::invalid_argument));
+      auto begin(deobfuscated_data.begin() + static_cast<std::ptrdiff_t>(offset));
+      auto count(std::min<std::uint64_t>(length, deobfuscated_data.end() - begin));
+      return routing::HandleGetReturn::value_type(
+          std::vector<byte>(begin, begin + static_cast<std::ptrdiff_t>(count)));
+    }
+    auto result(chunk_store_->TryGet(name_and_type_id, SharedChunkStore::Owner::kPmidNode, offset,
+                                     length));
+    if (result)
+      return routing::HandleGetReturn::value_type(std::move(*result));
+    if (result.error().code() == make_error_code(CommonErrors::invalid_argument))
+      return boost::make_unexpected(result.error());
+  } catch (const std::exception& /*e*/) {
+  }
+  return boost::make_unexpected(MakeError(CommonErrors::no_such_element));
+}
+
 template <typename FacadeType>
 template <typename DataType>
 routing::HandlePutPostReturn PmidNode<FacadeType>::HandlePut(routing::SourceAddress /* from */,
                                                              DataType data) {
   try {
-    chunk_store_.Put(data.NameAndType(), NonEmptyString{Serialise(data)});
+    // Only ImmutableData is named by its content, so only it is deduplicated.
+    chunk_store_->Put(data.NameAndType(), NonEmptyString{Serialise(data)},
+                      SharedChunkStore::Owner::kPmidNode,
+                      std::is_same<DataType, ImmutableData>::value
+                          ? SharedChunkStore::Content::kImmutable
+                          : SharedChunkStore::Content::kMutable);
+    cache_.Invalidate(data.NameAndType());
     return boost::make_unexpected(MakeError(CommonErrors::success));
   } catch (const maidsafe_error& e) {
     if (e.code() == make_error_code(CommonErrors::cannot_exceed_limit))
@@ -92,6 +188,42 @@ routing::HandlePutPostReturn PmidNode<FacadeType>::HandlePut(routing::SourceAddr
   return boost::make_unexpected(MakeError(VaultErrors::failed_to_handle_request));
 }
 
+template <typename FacadeType>
+void PmidNode<FacadeType>::StartScrubbing(
+    ChunkStore::NameSource names, std::uint64_t bytes_per_second,
+    std::function<void(const Data::NameAndTypeId&)> on_corrupt) {
+  auto on_scrubbed_corrupt([this, on_corrupt](const Data::NameAndTypeId& name_and_type_id) {
+    try {
+      chunk_store_->Purge(name_and_type_id);
+      cache_.Invalidate(name_and_type_id);
+    } catch (const std::exception& /*e*/) {}
+    on_corrupt(name_and_type_id);
+  });
+  // Decrypting proves the stored bytes are those written, but not that they were the right ones.
+  auto validate([](const Data::NameAndTypeId& name_and_type_id, const std::vector<byte>& value) {
+    if (name_and_type_id.type_id != detail::TypeId<ImmutableData>::value)
+      return true;
+    return ImmutableData(Parse<ImmutableData>(value).Value()).Name() == name_and_type_id.name;
+  });
+  chunk_store_->Store().StartScrubbing(std::move(names), bytes_per_second, on_scrubbed_corrupt,
+                                       validate);
+}
+
+template <typename FacadeType>
+void PmidNode<FacadeType>::StartScrubbing(
+    std::uint64_t bytes_per_second, std::function<void(const Data::NameAndTypeId&)> on_corrupt) {
+  StartScrubbing([this] { return chunk_store_->Names(SharedChunkStore::Owner::kPmidNode); },
+                 bytes_per_second, std::move(on_corrupt));
+}
+
+template <typename FacadeType>
+void PmidNode<FacadeType>::HandleDelete(Data::NameAndTypeId name_and_type_id) {
+  // Invalidating after the store has changed means a concurrent HandleGet can't re-cache the old
+  // content (see ChunkCache::InsertToken).
+  chunk_store_->Delete(name_and_type_id, SharedChunkStore::Owner::kPmidNode);
+  cache_.Invalidate(name_and_type_id);
+}
+
 }  // namespace vault
 
 }  // namespace maidsafe
@@ -0,0 +1,147 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/reference_ledger.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "boost/crc.hpp"
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+#include "maidsafe/vault/chunk_store_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Record layout: name(identity_size) type_id(4) owner(1) count(4) crc(4)
+const std::size_t kTypeOffset(identity_size);
+const std::size_t kOwnerOffset(kTypeOffset + 4);
+const std::size_t kCountOffset(kOwnerOffset + 1);
+const std::size_t kCrcOffset(kCountOffset + 4);
+const std::size_t kRecordSize(kCrcOffset + 4);
+
+std::uint32_t RecordCrc(const byte* record) {
+  boost::crc_32_type crc;
+  crc.process_bytes(record, kCrcOffset);
+  return crc.checksum();
+}
+
+void WriteRecord(std::ofstream& stream, const ReferenceLedger::Entry& entry) {
+  byte record[kRecordSize];
+  const auto& raw_name(entry.name.name.string());
+  std::copy(raw_name.begin(), raw_name.end(), record);
+  detail::PutLittleEndian(entry.name.type_id.data, record + kTypeOffset);
+  record[kOwnerOffset] = entry.owner;
+  detail::PutLittleEndian(entry.count, record + kCountOffset);
+  detail::PutLittleEndian(RecordCrc(record), record + kCrcOffset);
+  stream.write(reinterpret_cast<const char*>(record), kRecordSize);
+}
+
+}  // unnamed namespace
+
+ReferenceLedger::ReferenceLedger(const fs::path& metadata_directory)
+    : kLedgerPath_(metadata_directory / "references"), stream_(), record_count_(0) {}
+
+std::vector<ReferenceLedger::Entry> ReferenceLedger::Load() {
+  std::map<std::pair<NameType, byte>, std::uint32_t> counts;
+  record_count_ = 0;
+  boost::system::error_code error_code;
+  if (fs::exists(kLedgerPath_, error_code)) {
+    std::ifstream stream(kLedgerPath_.string(), std::ios::binary);
+    byte record[kRecordSize];
+    while (stream.read(reinterpret_cast<char*>(record), kRecordSize)) {
+      if (detail::GetLittleEndian<std::uint32_t>(record + kCrcOffset) != RecordCrc(record)) {
+        LOG(kWarning) << kLedgerPath_ << " has a corrupt record; ignoring the rest of it";
+        break;
+      }
+      NameType name(Identity(std::vector<byte>(record, record + identity_size)),
+                    DataTypeId(detail::GetLittleEndian<std::uint32_t>(record + kTypeOffset)));
+      counts[std::make_pair(name, record[kOwnerOffset])] =
+          detail::GetLittleEndian<std::uint32_t>(record + kCountOffset);
+      ++record_count_;
+    }
+  }
+  std::vector<Entry> entries;
+  for (const auto& count : counts) {
+    if (count.second != 0)
+      entries.push_back(Entry{count.first.first, count.first.second, count.second});
+  }
+  return entries;
+}
+
+void ReferenceLedger::Append(const Entry& entry) {
+  if (!stream_.is_open()) {
+    boost::system::error_code error_code;
+    fs::create_directories(kLedgerPath_.parent_path(), error_code);
+    stream_.open(kLedgerPath_.string(), std::ios::binary | std::ios::app);
+  }
+  WriteRecord(stream_, entry);
+  stream_.flush();
+  if (!stream_) {
+    LOG(kError) << "Failed to append to " << kLedgerPath_;
+    stream_.close();
+    stream_.clear();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  ++record_count_;
+}
+
+void ReferenceLedger::Rewrite(const std::vector<Entry>& entries) {
+  if (stream_.is_open())
+    stream_.close();
+  boost::system::error_code error_code;
+  if (entries.empty()) {
+    fs::remove(kLedgerPath_, error_code);
+    if (error_code) {
+      LOG(kError) << "Failed to remove " << kLedgerPath_ << ": " << error_code.message();
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+    record_count_ = 0;
+    return;
+  }
+  fs::path temp_path(kLedgerPath_.string() + ".tmp");
+  {
+    std::ofstream stream(temp_path.string(), std::ios::binary | std::ios::trunc);
+    for (const auto& entry : entries)
+      WriteRecord(stream, entry);
+    if (!stream) {
+      LOG(kError) << "Failed to write " << temp_path;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+  }
+  fs::rename(temp_path, kLedgerPath_, error_code);
+  if (error_code) {
+    LOG(kError) << "Failed to rename " << temp_path << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  record_count_ = entries.size();
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,72 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_REFERENCE_LEDGER_H_
+#define MAIDSAFE_VAULT_REFERENCE_LEDGER_H_
+
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/data.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Durable record of how many references each owner holds on each chunk of a SharedChunkStore.
+// Every change is appended as the owner's new count, so replaying the file in order yields the
+// current counts however many changes preceded a crash; a torn final record is ignored.  Rewrite
+// compacts the file to one record per non-zero count.  Not thread-safe.
+class ReferenceLedger {
+ public:
+  using NameType = Data::NameAndTypeId;
+  struct Entry {
+    NameType name;
+    byte owner;
+    std::uint32_t count;
+  };
+
+  explicit ReferenceLedger(const boost::filesystem::path& metadata_directory);
+  ReferenceLedger(const ReferenceLedger&) = delete;
+  ReferenceLedger(ReferenceLedger&&) = delete;
+  ReferenceLedger& operator=(const ReferenceLedger&) = delete;
+  ReferenceLedger& operator=(ReferenceLedger&&) = delete;
+
+  // Returns the last count recorded for each name and owner, omitting those which are 0.
+  std::vector<Entry> Load();
+  // Flushed to the OS before returning.
+  void Append(const Entry& entry);
+  // Replaces the file with one holding just 'entries', or removes it if there are none.
+  void Rewrite(const std::vector<Entry>& entries);
+  std::uint64_t RecordCount() const { return record_count_; }
+
+ private:
+  const boost::filesystem::path kLedgerPath_;
+  std::ofstream stream_;
+  std::uint64_t record_count_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_REFERENCE_LEDGER_H_
@@ -0,0 +1,235 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/shared_chunk_store.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+#include "maidsafe/vault/chunk_store_engine.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+std::size_t Index(SharedChunkStore::Owner owner) { return static_cast<std::size_t>(owner); }
+
+}  // unnamed namespace
+
+SharedChunkStore::SharedChunkStore(const fs::path& disk_path, DiskUsage max_disk_usage,
+                                   ChunkStore::Engine engine, ChunkStore::Durability durability,
+                                   ChunkStore::Compression compression,
+                                   ChunkStore::CacheBypass cache_bypass,
+                                   const ChunkStore::FastTier& fast_tier,
+                                   std::shared_ptr<DiskBudget::Account> disk_budget)
+    : store_(disk_path, max_disk_usage, fast_tier, engine, durability, compression, cache_bypass,
+             std::move(disk_budget)),
+      kPersistent_(engine != ChunkStore::Engine::kMemory),
+      stripes_(),
+      mutex_(),
+      references_(),
+      ledger_(ChunkStoreEngine::MetadataDirectory(disk_path)) {
+  if (!kPersistent_)
+    return;
+  for (const auto& entry : ledger_.Load()) {
+    if (entry.owner >= kOwnerCount) {
+      LOG(kWarning) << "Ignoring references of unknown owner " << static_cast<int>(entry.owner);
+      continue;
+    }
+    references_[entry.name][entry.owner] = entry.count;
+  }
+}
+
+SharedChunkStore::~SharedChunkStore() {
+  if (!kPersistent_)
+    return;
+  try {
+    ledger_.Rewrite(Entries());
+  } catch (const std::exception& e) {
+    LOG(kError) << "Failed to compact references of " << store_.DiskPath() << ": "
+                << boost::diagnostic_information(e);
+  }
+}
+
+void SharedChunkStore::Put(const NameType& name, const NonEmptyString& value, Owner owner,
+                           Content content) {
+  std::lock_guard<std::mutex> lock(StripeFor(name));
+  auto counts(CountsOf(name));
+  std::uint32_t previous(counts[Index(owner)]);
+  if (store_.Has(name)) {
+    if (content == Content::kImmutable)
+      return SetReferences(name, owner, previous + 1);
+  } else {
+    ClearReferences(name, counts);
+    previous = 0;
+  }
+
+  std::uint32_t updated(std::max<std::uint32_t>(previous, 1));
+  if (updated != previous)
+    SetReferences(name, owner, updated);
+  try {
+    store_.Put(name, value);
+  } catch (const std::exception&) {
+    if (updated != previous) {
+      try {
+        SetReferences(name, owner, previous);
+      } catch (const std::exception& e) {
+        LOG(kError) << "Failed to restore references to " << name.name << ": "
+                    << boost::diagnostic_information(e);
+      }
+    }
+    throw;
+  }
+}
+
+void SharedChunkStore::Delete(const NameType& name, Owner owner) {
+  std::lock_guard<std::mutex> lock(StripeFor(name));
+  auto counts(CountsOf(name));
+  std::uint32_t count(counts[Index(owner)]);
+  std::uint64_t total(std::accumulate(counts.begin(), counts.end(), std::uint64_t(0)));
+  if (count == 0) {
+    // A chunk without any references predates them, and belongs to whoever deletes it.
+    if (total == 0)
+      return store_.Delete(name);
+    LOG(kWarning) << "Cannot delete " << name.name << " since it isn't referenced by owner "
+                  << static_cast<int>(owner);
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  }
+  if (total == 1) {
+    try {
+      store_.Delete(name);
+    } catch (const maidsafe_error& e) {
+      if (e.code() != make_error_code(CommonErrors::no_such_element))
+        throw;
+    }
+  }
+  SetReferences(name, owner, count - 1);
+}
+
+void SharedChunkStore::Purge(const NameType& name) {
+  std::lock_guard<std::mutex> lock(StripeFor(name));
+  try {
+    store_.Delete(name);
+  } catch (const maidsafe_error& e) {
+    if (e.code() != make_error_code(CommonErrors::no_such_element))
+      throw;
+  }
+  ClearReferences(name, CountsOf(name));
+}
+
+void SharedChunkStore::Import(ChunkStore& source) { store_.Import(source); }
+
+bool SharedChunkStore::Has(const NameType& name, Owner owner) const {
+  return Visible(name, owner) && store_.Has(name);
+}
+
+ChunkStore::GetResult SharedChunkStore::TryGet(const NameType& name, Owner owner) const {
+  if (!Visible(name, owner))
+    return boost::make_unexpected(MakeError(CommonErrors::no_such_element));
+  return store_.TryGet(name);
+}
+
+ChunkStore::GetResult SharedChunkStore::TryGet(const NameType& name, Owner owner,
+                                               std::uint64_t offset,
+                                               std::uint64_t length) const {
+  if (!Visible(name, owner))
+    return boost::make_unexpected(MakeError(CommonErrors::no_such_element));
+  return store_.TryGet(name, offset, length);
+}
+
+std::uint32_t SharedChunkStore::References(const NameType& name, Owner owner) const {
+  return CountsOf(name)[Index(owner)];
+}
+
+std::vector<SharedChunkStore::NameType> SharedChunkStore::Names(Owner owner) const {
+  std::vector<NameType> names;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& reference : references_) {
+    if (reference.second[Index(owner)] != 0)
+      names.push_back(reference.first);
+  }
+  return names;
+}
+
+SharedChunkStore::Counts SharedChunkStore::CountsOf(const NameType& name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto itr(references_.find(name));
+  return itr == references_.end() ? Counts() : itr->second;
+}
+
+bool SharedChunkStore::Visible(const NameType& name, Owner owner) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto itr(references_.find(name));
+  return itr == references_.end() || itr->second[Index(owner)] != 0;
+}
+
+void SharedChunkStore::SetReferences(const NameType& name, Owner owner, std::uint32_t count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (kPersistent_)
+    ledger_.Append(ReferenceLedger::Entry{name, static_cast<byte>(owner), count});
+  auto& counts(references_[name]);
+  counts[Index(owner)] = count;
+  if (std::all_of(counts.begin(), counts.end(), [](std::uint32_t c) { return c == 0; }))
+    references_.erase(name);
+  if (!kPersistent_ ||
+      ledger_.RecordCount() <= 2 * kOwnerCount * references_.size() + kCompactionSlack) {
+    return;
+  }
+  try {
+    ledger_.Rewrite(Entries());
+  } catch (const std::exception& e) {
+    LOG(kWarning) << "Failed to compact references of " << store_.DiskPath() << ": "
+                  << boost::diagnostic_information(e);
+  }
+}
+
+void SharedChunkStore::ClearReferences(const NameType& name, const Counts& counts) {
+  for (std::size_t i(0); i != kOwnerCount; ++i) {
+    if (counts[i] != 0)
+      SetReferences(name, static_cast<Owner>(i), 0);
+  }
+}
+
+std::vector<ReferenceLedger::Entry> SharedChunkStore::Entries() const {
+  std::vector<ReferenceLedger::Entry> entries;
+  for (const auto& reference : references_) {
+    for (std::size_t i(0); i != kOwnerCount; ++i) {
+      if (reference.second[i] != 0) {
+        entries.push_back(
+            ReferenceLedger::Entry{reference.first, static_cast<byte>(i), reference.second[i]});
+      }
+    }
+  }
+  return entries;
+}
+
+std::mutex& SharedChunkStore::StripeFor(const NameType& name) const {
+  return stripes_[static_cast<std::size_t>(name.name.string()[0]) % kLockStripes];
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,129 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_SHARED_CHUNK_STORE_H_
+#define MAIDSAFE_VAULT_SHARED_CHUNK_STORE_H_
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/data.h"
+
+#include "maidsafe/vault/chunk_store.h"
+#include "maidsafe/vault/disk_budget.h"
+#include "maidsafe/vault/reference_ledger.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// A ChunkStore shared by the personas of one vault, so that a chunk which several of them hold is
+// stored, and charged against the quota, once.  Each persona counts its own references to each
+// chunk, and the chunk is only removed from the store when the last reference to it is dropped.
+// A persona only sees the chunks it references, apart from those stored before references were
+// recorded, which have none and are visible to all.  Counts are kept durably (see
+// ReferenceLedger) unless the store is in memory.  References left to a chunk which the store no
+// longer holds (e.g. after a crash between removing a chunk and recording it) are discarded when
+// the chunk is next stored.
+class SharedChunkStore {
+ public:
+  using NameType = ChunkStore::NameType;
+  enum class Owner : byte { kPmidNode, kMpidManager };
+  // kImmutable chunks are named by the hash of their content, so a repeated Put of one already
+  // held carries the same bytes and only adds a reference.  kMutable chunks can change under the
+  // same name, so are always written; an owner holds at most one reference to each.
+  enum class Content { kImmutable, kMutable };
+
+  SharedChunkStore(const boost::filesystem::path& disk_path, DiskUsage max_disk_usage,
+                   ChunkStore::Engine engine = ChunkStore::Engine::kFilePerChunk,
+                   ChunkStore::Durability durability = ChunkStore::Durability::kBuffered,
+                   ChunkStore::Compression compression = ChunkStore::Compression::kNone,
+                   ChunkStore::CacheBypass cache_bypass =
+                       ChunkStore::CacheBypass{ChunkStore::CacheBypass::Mode::kNone, 0},
+                   const ChunkStore::FastTier& fast_tier =
+                       ChunkStore::FastTier{boost::filesystem::path(), DiskUsage(0)},
+                   std::shared_ptr<DiskBudget::Account> disk_budget = nullptr);
+  ~SharedChunkStore();
+  SharedChunkStore(const SharedChunkStore&) = delete;
+  SharedChunkStore(SharedChunkStore&&) = delete;
+  SharedChunkStore& operator=(const SharedChunkStore&) = delete;
+  SharedChunkStore& operator=(SharedChunkStore&&) = delete;
+
+  void Put(const NameType& name, const NonEmptyString& value, Owner owner,
+           Content content = Content::kImmutable);
+  // Drops one of 'owner''s references.  Throws CommonErrors::no_such_element if it holds none.
+  void Delete(const NameType& name, Owner owner);
+  // Removes the chunk along with every owner's references to it, so that a corrupt chunk isn't
+  // kept (and a fresh copy deduplicated against it) for the sake of another owner.
+  void Purge(const NameType& name);
+  // Moves the chunks of a store which one persona kept to itself into this one (see
+  // ChunkStore::Import).  They carry no references, as with any chunk stored before references
+  // were recorded.  Must be called before the store is otherwise in use.
+  void Import(ChunkStore& source);
+
+  bool Has(const NameType& name, Owner owner) const;
+  ChunkStore::GetResult TryGet(const NameType& name, Owner owner) const;
+  ChunkStore::GetResult TryGet(const NameType& name, Owner owner, std::uint64_t offset,
+                               std::uint64_t length) const;
+  std::uint32_t References(const NameType& name, Owner owner) const;
+  // The names of the chunks 'owner' references.  Chunks without references can't be listed, since
+  // the store only knows them by their hashed names.
+  std::vector<NameType> Names(Owner owner) const;
+
+  // For whatever doesn't depend on ownership, such as scrubbing and usage queries.  Chunks must
+  // only be stored and deleted through the SharedChunkStore.
+  ChunkStore& Store() { return store_; }
+  const ChunkStore& Store() const { return store_; }
+
+ private:
+  static const std::size_t kOwnerCount = 2;
+  static const std::size_t kLockStripes = 64;
+  // Ledger records beyond those needed for the current counts before it's compacted.
+  static const std::uint64_t kCompactionSlack = 4096;
+  using Counts = std::array<std::uint32_t, kOwnerCount>;
+
+  Counts CountsOf(const NameType& name) const;
+  bool Visible(const NameType& name, Owner owner) const;
+  // Records 'count' as the number of 'owner''s references to 'name', durably before returning.
+  void SetReferences(const NameType& name, Owner owner, std::uint32_t count);
+  void ClearReferences(const NameType& name, const Counts& counts);
+  std::vector<ReferenceLedger::Entry> Entries() const;
+  std::mutex& StripeFor(const NameType& name) const;
+
+  ChunkStore store_;
+  const bool kPersistent_;
+  // Held across each Put, Delete and Purge of a chunk, so that its counts and presence in the
+  // store change together.  'mutex_' guards 'references_' and 'ledger_'.
+  mutable std::array<std::mutex, kLockStripes> stripes_;
+  mutable std::mutex mutex_;
+  std::map<NameType, Counts> references_;
+  ReferenceLedger ledger_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_SHARED_CHUNK_STORE_H_
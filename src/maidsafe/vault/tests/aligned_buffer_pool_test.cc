@@ -0,0 +1,71 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/aligned_buffer_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "maidsafe/common/test.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+TEST(AlignedBufferPoolTest, BEH_AcquireAndReuse) {
+  AlignedBufferPool pool(2);
+  byte* first(nullptr);
+  {
+    auto buffer(pool.Acquire(1));
+    EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(buffer.data()) % AlignedBufferPool::kAlignment);
+    EXPECT_EQ(AlignedBufferPool::kAlignment, buffer.capacity());
+    first = buffer.data();
+    auto large(pool.Acquire(3 * AlignedBufferPool::kAlignment + 1));
+    EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(large.data()) % AlignedBufferPool::kAlignment);
+    EXPECT_EQ(4 * AlignedBufferPool::kAlignment, large.capacity());
+    EXPECT_EQ(0, pool.PooledCount());
+  }
+  EXPECT_EQ(2, pool.PooledCount());
+
+  // The smallest pooled buffer which fits is reused.
+  {
+    auto buffer(pool.Acquire(AlignedBufferPool::kAlignment));
+    EXPECT_EQ(first, buffer.data());
+    EXPECT_EQ(1, pool.PooledCount());
+  }
+
+  // Beyond the limit, the smallest buffer is freed rather than pooled.
+  {
+    std::vector<AlignedBufferPool::Buffer> buffers;
+    buffers.push_back(pool.Acquire(1));
+    buffers.push_back(pool.Acquire(1));
+    buffers.push_back(pool.Acquire(8 * AlignedBufferPool::kAlignment));
+  }
+  EXPECT_EQ(2, pool.PooledCount());
+  auto buffer(pool.Acquire(5 * AlignedBufferPool::kAlignment));
+  EXPECT_EQ(8 * AlignedBufferPool::kAlignment, buffer.capacity());
+  EXPECT_EQ(1, pool.PooledCount());
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,68 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/bloom_filter.h"
+
+#include <vector>
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+TEST(BloomFilterTest, BEH_NoFalseNegatives) {
+  BloomFilter filter(0);
+  EXPECT_EQ(BloomFilter::kMinCapacity, filter.Capacity());
+  std::vector<BloomFilter::NameType> names;
+  for (std::uint64_t i(0); i != BloomFilter::kMinCapacity; ++i) {
+    EXPECT_FALSE(filter.Full());
+    names.push_back(GetRandomDataNameAndTypeId());
+    filter.Add(names.back());
+  }
+  EXPECT_TRUE(filter.Full());
+  for (const auto& name : names)
+    EXPECT_TRUE(filter.MayContain(name));
+
+  // The same name with a different type is a different chunk.
+  std::size_t false_positives(0);
+  for (const auto& name : names) {
+    BloomFilter::NameType retyped(name.name, DataTypeId(name.type_id.data + 1));
+    if (filter.MayContain(retyped))
+      ++false_positives;
+  }
+  EXPECT_GT(names.size() / 50, false_positives);
+
+  false_positives = 0;
+  for (std::size_t i(0); i != names.size(); ++i) {
+    if (filter.MayContain(GetRandomDataNameAndTypeId()))
+      ++false_positives;
+  }
+  EXPECT_GT(names.size() / 50, false_positives);
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,123 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/pmid_node/chunk_cache.h"
+
+#include <utility>
+#include <vector>
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+namespace {
+
+const std::uint32_t kChunkSize(1024);
+
+std::vector<std::pair<Data::NameAndTypeId, std::vector<byte>>> MakeChunks(std::uint32_t count) {
+  std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> pairs;
+  AddRandomNameValuePairs(pairs, count, kChunkSize);
+  std::vector<std::pair<Data::NameAndTypeId, std::vector<byte>>> chunks;
+  for (const auto& pair : pairs)
+    chunks.emplace_back(pair.first, pair.second.string());
+  return chunks;
+}
+
+}  // unnamed namespace
+
+TEST(ChunkCacheTest, BEH_GetInsertInvalidate) {
+  ChunkCache cache(MemoryUsage(16 * kChunkSize));
+  auto chunks(MakeChunks(2));
+  std::vector<byte> value;
+  EXPECT_FALSE(cache.Get(chunks[0].first, value));
+
+  cache.Insert(chunks[0].first, chunks[0].second, cache.InsertToken());
+  ASSERT_TRUE(cache.Get(chunks[0].first, value));
+  EXPECT_EQ(chunks[0].second, value);
+
+  // An insertion raced by an invalidation is dropped.
+  auto token(cache.InsertToken());
+  cache.Invalidate(chunks[1].first);
+  cache.Insert(chunks[1].first, chunks[1].second, token);
+  EXPECT_FALSE(cache.Get(chunks[1].first, value));
+
+  cache.Invalidate(chunks[0].first);
+  EXPECT_FALSE(cache.Get(chunks[0].first, value));
+
+  auto stats(cache.GetStats());
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(3, stats.misses);
+  EXPECT_EQ(1, stats.insertions);
+  EXPECT_EQ(1, stats.rejections);
+  EXPECT_EQ(1, stats.invalidations);
+  EXPECT_EQ(0, stats.size);
+  EXPECT_EQ(0, stats.count);
+}
+
+TEST(ChunkCacheTest, BEH_ByteBudget) {
+  ChunkCache cache(MemoryUsage(8 * kChunkSize));
+  auto chunks(MakeChunks(12));
+  for (const auto& chunk : chunks)
+    cache.Insert(chunk.first, chunk.second, cache.InsertToken());
+  auto stats(cache.GetStats());
+  EXPECT_EQ(8, stats.count);
+  EXPECT_EQ(8 * kChunkSize, stats.size);
+  EXPECT_EQ(4, stats.evictions);
+
+  // The oldest were evicted first.
+  std::vector<byte> value;
+  EXPECT_FALSE(cache.Get(chunks[0].first, value));
+  EXPECT_TRUE(cache.Get(chunks[11].first, value));
+
+  // Anything over an eighth of the budget isn't admitted.
+  auto large(GetRandomDataNameAndTypeId());
+  cache.Insert(large, RandomBytes(kChunkSize + 1), cache.InsertToken());
+  EXPECT_FALSE(cache.Get(large, value));
+}
+
+TEST(ChunkCacheTest, BEH_ScanResistance) {
+  ChunkCache cache(MemoryUsage(10 * kChunkSize));
+  auto hot(MakeChunks(5)), scan(MakeChunks(50));
+  std::vector<byte> value;
+  for (const auto& chunk : hot) {
+    cache.Insert(chunk.first, chunk.second, cache.InsertToken());
+    ASSERT_TRUE(cache.Get(chunk.first, value));
+  }
+
+  // A long run of chunks read only once doesn't displace the ones read repeatedly.
+  for (const auto& chunk : scan)
+    cache.Insert(chunk.first, chunk.second, cache.InsertToken());
+  for (const auto& chunk : hot) {
+    ASSERT_TRUE(cache.Get(chunk.first, value));
+    EXPECT_EQ(chunk.second, value);
+  }
+  EXPECT_LE(cache.GetStats().size, 10 * kChunkSize);
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
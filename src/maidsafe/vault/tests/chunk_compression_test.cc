@@ -0,0 +1,118 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_compression.h"
+
+#include <string>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+namespace {
+
+std::vector<byte> Text(std::size_t size) {
+  const std::string kLine("Message body with the usual amount of repetition, number ");
+  std::vector<byte> text;
+  for (int i(0); text.size() < size; ++i) {
+    auto line(kLine + std::to_string(i) + '\n');
+    text.insert(text.end(), line.begin(), line.end());
+  }
+  text.resize(size);
+  return text;
+}
+
+}  // unnamed namespace
+
+TEST(ChunkCompressorTest, BEH_RoundTrip) {
+  ChunkCompressor compressor;
+  std::vector<byte> framed, data;
+  for (auto level : {ChunkCompressor::Level::kFast, ChunkCompressor::Level::kBest}) {
+    for (std::size_t size : {std::size_t(1), std::size_t(100), std::size_t(64 * 1024)}) {
+      auto text(Text(size));
+      compressor.Compress(level, text.data(), text.size(), framed);
+      EXPECT_GE(text.size() + ChunkCompressor::kMaxOverhead, framed.size());
+      if (size > 1024)
+        EXPECT_GT(text.size() / 2, framed.size());
+      compressor.Decompress(framed.data(), framed.size(), data);
+      EXPECT_EQ(text, data);
+
+      auto random(RandomBytes(size));
+      compressor.Compress(level, random.data(), random.size(), framed);
+      EXPECT_EQ(random.size() + ChunkCompressor::kMaxOverhead, framed.size());
+      compressor.Decompress(framed.data(), framed.size(), data);
+      EXPECT_EQ(random, data);
+    }
+  }
+}
+
+TEST(ChunkCompressorTest, BEH_Sampling) {
+  ChunkCompressor compressor;
+  std::vector<byte> framed, data;
+  // Random content is stored without being compressed in full, even if a region between the
+  // sampled slices is compressible.
+  auto content(RandomBytes(256 * 1024));
+  auto text(Text(32 * 1024));
+  std::copy(text.begin(), text.end(), content.begin() + 16 * 1024);
+  compressor.Compress(ChunkCompressor::Level::kBest, content.data(), content.size(), framed);
+  EXPECT_EQ(content.size() + ChunkCompressor::kMaxOverhead, framed.size());
+  compressor.Decompress(framed.data(), framed.size(), data);
+  EXPECT_EQ(content, data);
+
+  // Compressible content with a random prefix is compressed.
+  content = Text(256 * 1024);
+  auto random(RandomBytes(8 * 1024));
+  std::copy(random.begin(), random.end(), content.begin());
+  compressor.Compress(ChunkCompressor::Level::kFast, content.data(), content.size(), framed);
+  EXPECT_GT(content.size() / 2, framed.size());
+  compressor.Decompress(framed.data(), framed.size(), data);
+  EXPECT_EQ(content, data);
+}
+
+TEST(ChunkCompressorTest, BEH_RejectsMalformedInput) {
+  ChunkCompressor compressor;
+  std::vector<byte> framed, data(RandomBytes(10));
+  EXPECT_THROW(compressor.Decompress(framed.data(), 0, data), maidsafe_error);
+  EXPECT_TRUE(data.empty());
+
+  auto text(Text(4096));
+  compressor.Compress(ChunkCompressor::Level::kFast, text.data(), text.size(), framed);
+  auto truncated(framed);
+  truncated.resize(framed.size() / 2);
+  EXPECT_THROW(compressor.Decompress(truncated.data(), truncated.size(), data), maidsafe_error);
+  EXPECT_TRUE(data.empty());
+  framed[0] = 0x7f;
+  EXPECT_THROW(compressor.Decompress(framed.data(), framed.size(), data), maidsafe_error);
+
+  // The compressor is still usable after a failure.
+  compressor.Compress(ChunkCompressor::Level::kFast, text.data(), text.size(), framed);
+  compressor.Decompress(framed.data(), framed.size(), data);
+  EXPECT_EQ(text, data);
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,173 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_index.h"
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+namespace {
+
+using NameType = ChunkIndex::NameType;
+// Mirrors the index's ordering: by name, then by type.
+using Model = std::map<std::pair<std::vector<byte>, std::uint32_t>, std::uint64_t>;
+
+std::pair<std::vector<byte>, std::uint32_t> ModelKey(const NameType& name) {
+  return std::make_pair(name.name.string(), name.type_id.data);
+}
+
+void ExpectMatches(const ChunkIndex& index, const Model& model) {
+  EXPECT_EQ(model.size(), index.Count());
+  auto names(index.Names());
+  ASSERT_EQ(model.size(), names.size());
+  auto itr(model.begin());
+  for (const auto& name : names) {
+    EXPECT_TRUE(ModelKey(name) == itr->first);
+    EXPECT_EQ(itr->second, index.Size(name));
+    ++itr;
+  }
+}
+
+}  // unnamed namespace
+
+TEST(ChunkIndexTest, BEH_ChangesAcrossMerges) {
+  maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_ChunkIndex"));
+  ChunkIndex index(*test_path);
+  Model model;
+  std::vector<NameType> names;
+  // Enough changes for every shard's pending changes to be merged several times.
+  for (int i(0); i != 200000; ++i) {
+    if (names.empty() || RandomUint32() % 4 != 0) {
+      names.emplace_back(MakeIdentity(), DataTypeId(RandomUint32() % 3));
+      auto size(RandomUint32());
+      index.Put(names.back(), size);
+      model[ModelKey(names.back())] = size;
+      continue;
+    }
+    const auto& name(names[RandomUint32() % names.size()]);
+    if (RandomUint32() % 2 == 0) {
+      index.Delete(name);
+      model.erase(ModelKey(name));
+      EXPECT_FALSE(index.Has(name));
+      EXPECT_EQ(0, index.Size(name));
+    } else {
+      auto size(RandomUint32());
+      index.Put(name, size);
+      model[ModelKey(name)] = size;
+      EXPECT_TRUE(index.Has(name));
+    }
+  }
+  // Deleting a name which isn't held changes nothing.
+  index.Delete(NameType(MakeIdentity(), DataTypeId(0)));
+  ExpectMatches(index, model);
+}
+
+TEST(ChunkIndexTest, BEH_NamesAfter) {
+  maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_ChunkIndex"));
+  ChunkIndex index(*test_path);
+  Model model;
+  std::vector<NameType> names;
+  for (int i(0); i != 5000; ++i) {
+    names.emplace_back(MakeIdentity(), DataTypeId(i % 2));
+    index.Put(names.back(), i);
+    model[ModelKey(names.back())] = i;
+  }
+  // Leave some deletions and replacements pending alongside the merged entries.
+  for (int i(0); i != 100; ++i) {
+    index.Delete(names[i]);
+    model.erase(ModelKey(names[i]));
+    index.Put(names[i + 100], 0);
+    model[ModelKey(names[i + 100])] = 0;
+  }
+
+  ChunkIndex::Filter filter;
+  filter.type_id = DataTypeId(1);
+  std::vector<NameType> listed;
+  boost::optional<NameType> after;
+  for (;;) {
+    auto page(index.NamesAfter(after, 7, filter));
+    listed.insert(listed.end(), page.begin(), page.end());
+    if (page.size() < 7)
+      break;
+    after = page.back();
+  }
+  auto itr(model.begin());
+  for (const auto& name : listed) {
+    while (itr != model.end() && itr->first.second != 1)
+      ++itr;
+    ASSERT_TRUE(itr != model.end());
+    EXPECT_TRUE(ModelKey(name) == itr->first);
+    ++itr;
+  }
+  while (itr != model.end() && itr->first.second != 1)
+    ++itr;
+  EXPECT_TRUE(itr == model.end());
+}
+
+TEST(ChunkIndexTest, BEH_SaveLoadAndRebuild) {
+  maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_ChunkIndex"));
+  Model model;
+  std::vector<ChunkStoreEngine::StoredChunk> chunks;
+  {
+    ChunkIndex index(*test_path);
+    EXPECT_FALSE(index.Load());
+    for (int i(0); i != 3000; ++i) {
+      NameType name(MakeIdentity(), DataTypeId(i % 3));
+      index.Put(name, i);
+      model[ModelKey(name)] = i;
+      chunks.push_back(ChunkStoreEngine::StoredChunk{name, static_cast<std::uint64_t>(i)});
+    }
+    index.Delete(chunks.front().name);
+    model.erase(ModelKey(chunks.front().name));
+    index.Save();
+  }
+  {
+    ChunkIndex index(*test_path);
+    ASSERT_TRUE(index.Load());
+    ExpectMatches(index, model);
+    // The snapshot is consumed.
+    ChunkIndex reopened(*test_path);
+    EXPECT_FALSE(reopened.Load());
+  }
+  {
+    // A name listed twice keeps the size given last.
+    chunks.erase(chunks.begin());
+    chunks.push_back(ChunkStoreEngine::StoredChunk{chunks.front().name, 1});
+    model[ModelKey(chunks.front().name)] = 1;
+    ChunkIndex index(*test_path);
+    index.Rebuild(chunks);
+    ExpectMatches(index, model);
+  }
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
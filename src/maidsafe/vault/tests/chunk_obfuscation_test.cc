@@ -0,0 +1,223 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_obfuscation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "maidsafe/common/crypto.h"
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+namespace {
+
+crypto::AES256KeyAndIV KeyAndIv(const Identity& name) {
+  const auto& raw_name(name.string());
+  return crypto::AES256KeyAndIV(std::vector<byte>(
+      raw_name.begin(), raw_name.begin() + crypto::AES256_KeySize + crypto::AES256_IVSize));
+}
+
+}  // unnamed namespace
+
+TEST(ChunkObfuscatorTest, BEH_MatchesSymmEncrypt) {
+  ChunkObfuscator obfuscator;
+  std::vector<byte> obfuscated, plain_text;
+  for (std::size_t size : {std::size_t(1), std::size_t(4 * 1024 + 3), std::size_t(64 * 1024)}) {
+    Identity name(GetRandomDataNameAndTypeId().name);
+    NonEmptyString value(RandomBytes(size));
+    auto expected(crypto::SymmEncrypt(value, KeyAndIv(name)).data.string());
+
+    obfuscator.Obfuscate(name, value.string().data(), size, obfuscated);
+    EXPECT_EQ(expected, obfuscated);
+    EXPECT_EQ(size + ChunkObfuscator::kTagSize, obfuscated.size());
+    EXPECT_TRUE(value == crypto::SymmDecrypt(crypto::CipherText(NonEmptyString(obfuscated)),
+                                             KeyAndIv(name)));
+
+    obfuscator.Deobfuscate(name, expected.data(), expected.size(), plain_text);
+    EXPECT_EQ(value.string(), plain_text);
+  }
+}
+
+TEST(ChunkObfuscatorTest, BEH_RejectsBadInput) {
+  ChunkObfuscator obfuscator;
+  Identity name(GetRandomDataNameAndTypeId().name);
+  auto value(RandomBytes(1024));
+  std::vector<byte> obfuscated, plain_text;
+  obfuscator.Obfuscate(name, value.data(), value.size(), obfuscated);
+
+  obfuscated[100] ^= 1;
+  EXPECT_THROW(obfuscator.Deobfuscate(name, obfuscated.data(), obfuscated.size(), plain_text),
+               maidsafe_error);
+  EXPECT_TRUE(plain_text.empty());
+  EXPECT_THROW(obfuscator.Deobfuscate(name, obfuscated.data(), ChunkObfuscator::kTagSize,
+                                      plain_text), maidsafe_error);
+  EXPECT_THROW(obfuscator.Obfuscate(name, value.data(), 0, obfuscated), maidsafe_error);
+}
+
+TEST(ChunkObfuscatorTest, BEH_Batch) {
+  ChunkObfuscator obfuscator;
+  std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> chunks;
+  AddRandomNameValuePairs(chunks, 4, 4096);
+  std::vector<std::vector<byte>> obfuscated(chunks.size()), plain_texts(chunks.size());
+  std::vector<ChunkObfuscator::Job> jobs;
+  for (std::size_t i(0); i != chunks.size(); ++i) {
+    jobs.push_back(ChunkObfuscator::Job{&chunks[i].first.name, chunks[i].second.string().data(),
+                                        chunks[i].second.string().size(), &obfuscated[i]});
+  }
+  obfuscator.Obfuscate(jobs);
+
+  obfuscated[2].front() ^= 1;
+  jobs.clear();
+  for (std::size_t i(0); i != chunks.size(); ++i) {
+    jobs.push_back(ChunkObfuscator::Job{&chunks[i].first.name, obfuscated[i].data(),
+                                        obfuscated[i].size(), &plain_texts[i]});
+  }
+  EXPECT_EQ(1, obfuscator.Deobfuscate(jobs));
+  for (std::size_t i(0); i != chunks.size(); ++i) {
+    if (i == 2)
+      EXPECT_TRUE(plain_texts[i].empty());
+    else
+      EXPECT_EQ(chunks[i].second.string(), plain_texts[i]);
+  }
+}
+
+TEST(ChunkObfuscatorTest, BEH_SeekableRanges) {
+  const std::size_t kBlock(ChunkObfuscator::kBlockSize);
+  ChunkObfuscator obfuscator;
+  std::vector<byte> obfuscated, legacy, plain_text;
+  Identity name(GetRandomDataNameAndTypeId().name);
+
+  // Chunks up to one block keep the non-seekable format.
+  auto value(RandomBytes(kBlock));
+  obfuscator.ObfuscateSeekable(name, value.data(), value.size(), obfuscated);
+  obfuscator.Obfuscate(name, value.data(), value.size(), legacy);
+  EXPECT_EQ(legacy, obfuscated);
+  EXPECT_EQ(ChunkObfuscator::SeekableSize(value.size()), obfuscated.size());
+
+  value = RandomBytes(3 * kBlock + 100);
+  obfuscator.ObfuscateSeekable(name, value.data(), value.size(), obfuscated);
+  obfuscator.Obfuscate(name, value.data(), value.size(), legacy);
+  EXPECT_EQ(ChunkObfuscator::SeekableSize(value.size()), obfuscated.size());
+  obfuscator.Deobfuscate(name, obfuscated.data(), obfuscated.size(), plain_text);
+  EXPECT_EQ(value, plain_text);
+
+  // Both formats give the same ranges.
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges{
+      {0, 10}, {kBlock - 5, 10}, {kBlock, kBlock}, {100, 2 * kBlock}, {3 * kBlock + 90, 1000},
+      {value.size(), 10}, {0, value.size() * 2}};
+  for (const auto& content : {obfuscated, legacy}) {
+    for (const auto& range : ranges) {
+      obfuscator.DeobfuscateRange(name, content.data(), content.size(), range.first,
+                                  range.second, plain_text);
+      auto begin(value.begin() + range.first);
+      auto end(begin + std::min<std::uint64_t>(range.second, value.end() - begin));
+      EXPECT_EQ(std::vector<byte>(begin, end), plain_text);
+    }
+    EXPECT_THROW(obfuscator.DeobfuscateRange(name, content.data(), content.size(),
+                                             value.size() + 1, 1, plain_text),
+                 maidsafe_error);
+  }
+
+  // Corruption is only detected in the blocks which are read.
+  obfuscated[obfuscated.size() - ChunkObfuscator::kTagSize - 50] ^= 1;
+  obfuscator.DeobfuscateRange(name, obfuscated.data(), obfuscated.size(), 0, kBlock, plain_text);
+  EXPECT_EQ(std::vector<byte>(value.begin(), value.begin() + kBlock), plain_text);
+  EXPECT_THROW(obfuscator.DeobfuscateRange(name, obfuscated.data(), obfuscated.size(),
+                                           3 * kBlock, 10, plain_text),
+               maidsafe_error);
+  EXPECT_TRUE(plain_text.empty());
+  EXPECT_THROW(obfuscator.Deobfuscate(name, obfuscated.data(), obfuscated.size(), plain_text),
+               maidsafe_error);
+}
+
+TEST(ChunkObfuscatorTest, BEH_SeekableTruncation) {
+  const std::size_t kBlock(ChunkObfuscator::kBlockSize);
+  const std::size_t kRecord(kBlock + ChunkObfuscator::kTagSize);
+  ChunkObfuscator obfuscator;
+  std::vector<byte> obfuscated, plain_text;
+  Identity name(GetRandomDataNameAndTypeId().name);
+  auto value(RandomBytes(4 * kBlock));
+  obfuscator.ObfuscateSeekable(name, value.data(), value.size(), obfuscated);
+
+  // Dropping whole blocks from the end still leaves a well-formed sequence of blocks, each of
+  // which would verify on its own.
+  for (std::size_t dropped(1); dropped != 3; ++dropped) {
+    std::vector<byte> truncated(obfuscated.begin(), obfuscated.end() - dropped * kRecord);
+    EXPECT_THROW(obfuscator.Deobfuscate(name, truncated.data(), truncated.size(), plain_text),
+                 maidsafe_error);
+    EXPECT_TRUE(plain_text.empty());
+    EXPECT_THROW(obfuscator.DeobfuscateRange(name, truncated.data(), truncated.size(), 0, 10,
+                                             plain_text),
+                 maidsafe_error);
+  }
+}
+
+TEST(ChunkObfuscatorTest, FUNC_CompareWithSymmEncrypt) {
+  using std::chrono::steady_clock;
+  std::cout << "AES instructions " << (ChunkObfuscator::HardwareAccelerated() ? "" : "not ")
+            << "available" << std::endl;
+  ChunkObfuscator obfuscator;
+  std::vector<byte> obfuscated, plain_text;
+  for (std::size_t size : {std::size_t(4 * 1024), std::size_t(64 * 1024),
+                           std::size_t(1024 * 1024)}) {
+    Identity name(GetRandomDataNameAndTypeId().name);
+    NonEmptyString value(RandomBytes(size));
+    const std::size_t kIterations(std::max<std::size_t>(8, 64 * 1024 * 1024 / size));
+
+    auto start(steady_clock::now());
+    for (std::size_t i(0); i != kIterations; ++i) {
+      auto key_and_iv(KeyAndIv(name));
+      auto cipher_text(crypto::SymmEncrypt(value, key_and_iv));
+      ASSERT_TRUE(value == crypto::SymmDecrypt(cipher_text, key_and_iv));
+    }
+    auto symm_time(steady_clock::now() - start);
+
+    start = steady_clock::now();
+    for (std::size_t i(0); i != kIterations; ++i) {
+      obfuscator.Obfuscate(name, value.string().data(), size, obfuscated);
+      obfuscator.Deobfuscate(name, obfuscated.data(), obfuscated.size(), plain_text);
+    }
+    auto obfuscator_time(steady_clock::now() - start);
+    ASSERT_EQ(value.string(), plain_text);
+
+    auto megabytes_per_second([&](steady_clock::duration duration) {
+      auto seconds(std::chrono::duration<double>(duration).count());
+      return seconds == 0 ? 0 : 2.0 * size * kIterations / (1024 * 1024) / seconds;
+    });
+    std::cout << size / 1024 << " KB chunks: SymmEncrypt/SymmDecrypt "
+              << megabytes_per_second(symm_time) << " MB/s, ChunkObfuscator "
+              << megabytes_per_second(obfuscator_time) << " MB/s" << std::endl;
+  }
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
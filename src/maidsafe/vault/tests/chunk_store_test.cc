@@ -18,7 +18,16 @@
 
 #include "maidsafe/vault/chunk_store.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include "boost/filesystem/path.hpp"
 #include "boost/filesystem/operations.hpp"
@@ -26,9 +35,12 @@
 #include "boost/date_time/posix_time/posix_time.hpp"
 
 #include "maidsafe/common/convert.h"
+#include "maidsafe/common/crypto.h"
 #include "maidsafe/common/error.h"
 #include "maidsafe/common/test.h"
 #include "maidsafe/common/utils.h"
+#include "maidsafe/vault/chunk_obfuscation.h"
+#include "maidsafe/vault/tombstone_journal.h"
 #include "maidsafe/vault/tests/chunk_store_test_utils.h"
 
 namespace fs = boost::filesystem;
@@ -138,7 +150,9 @@ TEST_F(ChunkStoreTest, BEH_RemoveDiskStore) {
   NonEmptyString small_value(RandomBytes(kSize));
   ASSERT_NO_THROW(chunk_store_->Put(name, small_value));
   ASSERT_NO_THROW(chunk_store_->Delete(name));
-  EXPECT_TRUE(6 == fs::remove_all(chunk_store_path, error_code));
+  chunk_store_->Reclaim();
+  // Everything removed includes the layout manifest in the root.
+  EXPECT_TRUE(8 == fs::remove_all(chunk_store_path, error_code));
   ASSERT_FALSE(fs::exists(chunk_store_path, error_code));
   NameType name1(MakeIdentity(), DataTypeId(RandomUint32()));
   // The data gets AES encrypted and will end up at most 16 bytes larger when written to the store
@@ -149,7 +163,9 @@ TEST_F(ChunkStoreTest, BEH_RemoveDiskStore) {
   chunk_store_.reset(new ChunkStore(chunk_store_path, DiskUsage(kDiskSize)));
   ASSERT_NO_THROW(chunk_store_->Put(name1, large_value));
   ASSERT_NO_THROW(chunk_store_->Delete(name1));
-  EXPECT_TRUE(6 != fs::remove_all(chunk_store_path, error_code));
+  chunk_store_->Reclaim();
+  // The failed calls above mustn't have recreated fan-out directories for 'name'.
+  EXPECT_TRUE(8 == fs::remove_all(chunk_store_path, error_code));
   ASSERT_FALSE(fs::exists(chunk_store_path, error_code));
   EXPECT_THROW(chunk_store_->Put(name, small_value), std::exception);
   EXPECT_THROW(chunk_store_->Get(name), std::exception);
@@ -221,6 +237,999 @@ TEST_F(ChunkStoreTest, FUNC_Restart) {
   EXPECT_EQ((num_entries * (OneKB + AesPadding)), chunk_store_->CurrentDiskUsage().data);
 }
 
+TEST_F(ChunkStoreTest, BEH_GetIntoBuffer) {
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(kDefaultMaxDiskUsage * 64)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 2, 32 * OneKB);
+  AddRandomNameValuePairs(name_value_pairs, 1, OneKB);
+  for (const auto& name_value : name_value_pairs)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+
+  // One buffer is reused for every Get; it only grows when a larger chunk is read.
+  std::vector<byte> buffer;
+  ASSERT_NO_THROW(chunk_store_->Get(name_value_pairs[0].first, buffer));
+  const auto* const storage(buffer.data());
+  for (const auto& name_value : name_value_pairs) {
+    ASSERT_NO_THROW(chunk_store_->Get(name_value.first, buffer));
+    EXPECT_EQ(name_value.second.string(), buffer);
+  }
+  EXPECT_EQ(storage, buffer.data());
+  EXPECT_TRUE(name_value_pairs[0].second == chunk_store_->Get(name_value_pairs[0].first));
+
+  EXPECT_THROW(chunk_store_->Get(GetRandomDataNameAndTypeId(), buffer), std::exception);
+  EXPECT_TRUE(buffer.empty());
+
+  // Content which fails to decrypt is reported as missing.
+  fs::path chunk_file;
+  for (fs::recursive_directory_iterator itr(chunk_store_path_), end; itr != end; ++itr) {
+    if (fs::is_regular_file(itr->status()) && fs::file_size(itr->path()) == OneKB + AesPadding)
+      chunk_file = itr->path();
+  }
+  ASSERT_FALSE(chunk_file.empty());
+  auto corrupted(RandomBytes(OneKB + AesPadding));
+  ASSERT_TRUE(WriteFile(chunk_file, corrupted));
+  try {
+    chunk_store_->Get(name_value_pairs[2].first, buffer);
+    ADD_FAILURE() << "Corrupted chunk was returned";
+  } catch (const maidsafe_error& error) {
+    EXPECT_EQ(make_error_code(CommonErrors::no_such_element), error.code());
+  }
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST_F(ChunkStoreTest, BEH_ReadsCreateNoDirectories) {
+  auto count_directories([&] {
+    std::size_t count(0);
+    for (fs::recursive_directory_iterator itr(chunk_store_path_), end; itr != end; ++itr) {
+      if (itr->path() == ChunkStoreEngine::MetadataDirectory(chunk_store_path_))
+        itr.no_push();
+      else if (fs::is_directory(itr->status()))
+        ++count;
+    }
+    return count;
+  });
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 2, OneKB);
+  std::vector<byte> value;
+  EXPECT_EQ(0, count_directories());
+  EXPECT_THROW(chunk_store_->Get(name_value_pairs[0].first, value), std::exception);
+  EXPECT_THROW(chunk_store_->Get(name_value_pairs[0].first, 0, 1, value), std::exception);
+  EXPECT_THROW(chunk_store_->Delete(name_value_pairs[0].first), std::exception);
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[0].first));
+  EXPECT_EQ(0, count_directories());
+
+  // Writes create the fan-out directories they need, and reads of the chunks create no more.
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[0].first, name_value_pairs[0].second));
+  auto directories(count_directories());
+  EXPECT_EQ(5, directories);
+  EXPECT_THROW(chunk_store_->Get(name_value_pairs[1].first, value), std::exception);
+  EXPECT_TRUE(name_value_pairs[0].second == chunk_store_->Get(name_value_pairs[0].first));
+  EXPECT_EQ(directories, count_directories());
+
+  // The layout is unchanged, so a reopened store finds the chunk.
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, max_disk_usage_));
+  EXPECT_TRUE(name_value_pairs[0].second == chunk_store_->Get(name_value_pairs[0].first));
+}
+
+TEST_F(ChunkStoreTest, BEH_RangedGet) {
+  const std::uint64_t kSmallSize(OneKB), kLargeSize(4 * ChunkObfuscator::kBlockSize + 7);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(2 * kLargeSize)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 1, kSmallSize);
+  AddRandomNameValuePairs(name_value_pairs, 1, kLargeSize);
+  for (const auto& name_value : name_value_pairs)
+    chunk_store_->Put(name_value.first, name_value.second);
+  EXPECT_EQ(kSmallSize + AesPadding, chunk_store_->StoredSize(name_value_pairs[0].first));
+  EXPECT_EQ(ChunkObfuscator::SeekableSize(kLargeSize),
+            chunk_store_->StoredSize(name_value_pairs[1].first));
+
+  std::vector<byte> value;
+  for (const auto& name_value : name_value_pairs) {
+    const auto& content(name_value.second.string());
+    for (std::uint64_t offset : {std::uint64_t(0), std::uint64_t(content.size() / 3),
+                                 std::uint64_t(content.size())}) {
+      chunk_store_->Get(name_value.first, offset, 1000, value);
+      auto begin(content.begin() + offset);
+      auto end(begin + std::min<std::uint64_t>(1000, content.end() - begin));
+      EXPECT_EQ(std::vector<byte>(begin, end), value);
+    }
+    EXPECT_THROW(chunk_store_->Get(name_value.first, content.size() + 1, 1, value),
+                 maidsafe_error);
+    chunk_store_->Get(name_value.first, value);
+    EXPECT_EQ(content, value);
+  }
+  EXPECT_THROW(chunk_store_->Get(GetRandomDataNameAndTypeId(), 0, 1, value), maidsafe_error);
+}
+
+TEST_F(ChunkStoreTest, BEH_TruncatedChunk) {
+  const std::uint64_t kSize(4 * ChunkObfuscator::kBlockSize);
+  const std::uint64_t kRecordSize(ChunkObfuscator::kBlockSize + ChunkObfuscator::kTagSize);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(2 * kSize)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 1, kSize);
+  const auto& name(name_value_pairs.front().first);
+  chunk_store_->Put(name, name_value_pairs.front().second);
+
+  fs::path chunk_file;
+  for (fs::recursive_directory_iterator itr(chunk_store_path_), end; itr != end; ++itr) {
+    if (itr->path().filename() == "metadata")
+      itr.no_push();
+    else if (itr.level() != 0 && fs::is_regular_file(itr->status()))
+      chunk_file = itr->path();
+  }
+  ASSERT_FALSE(chunk_file.empty());
+  // Cut at a block boundary, as a crash or a torn copy might leave it, with blocks still to spare.
+  fs::resize_file(chunk_file, fs::file_size(chunk_file) - kRecordSize);
+
+  std::vector<byte> value;
+  EXPECT_THROW(chunk_store_->Get(name), maidsafe_error);
+  EXPECT_THROW(chunk_store_->Get(name, value), maidsafe_error);
+  EXPECT_THROW(chunk_store_->Get(name, 0, 10, value), maidsafe_error);
+  EXPECT_FALSE(chunk_store_->TryGet(name));
+}
+
+TEST_F(ChunkStoreTest, BEH_CacheBypass) {
+  const std::uint64_t kThreshold(8 * OneKB), kLargeSize(3 * ChunkObfuscator::kBlockSize + 5);
+  int store_count(0);
+  for (auto mode : {ChunkStore::CacheBypass::Mode::kDirect,
+                    ChunkStore::CacheBypass::Mode::kDropCache}) {
+    for (auto durability : {ChunkStore::Durability::kBuffered,
+                            ChunkStore::Durability::kGroupCommit}) {
+      fs::path path(*test_path / ("bypass_" + std::to_string(store_count++)));
+      chunk_store_.reset(new ChunkStore(path, DiskUsage(4 * kLargeSize),
+                                        ChunkStore::Engine::kFilePerChunk, durability,
+                                        ChunkStore::Compression::kNone,
+                                        ChunkStore::CacheBypass{mode, kThreshold}));
+      NameValueContainer name_value_pairs;
+      AddRandomNameValuePairs(name_value_pairs, 1, OneKB);
+      AddRandomNameValuePairs(name_value_pairs, 2, kLargeSize);
+      chunk_store_->Put(name_value_pairs[0].first, name_value_pairs[0].second);
+      chunk_store_->Put(name_value_pairs[1].first, name_value_pairs[1].second);
+      std::promise<std::error_code> put_result;
+      chunk_store_->PutAsync(name_value_pairs[2].first, name_value_pairs[2].second,
+                             [&](std::error_code error) { put_result.set_value(error); });
+      EXPECT_FALSE(put_result.get_future().get());
+
+      std::uint64_t stored_size(0);
+      std::vector<byte> value;
+      for (const auto& name_value : name_value_pairs) {
+        const auto& content(name_value.second.string());
+        stored_size += chunk_store_->StoredSize(name_value.first);
+        EXPECT_TRUE(name_value.second == chunk_store_->Get(name_value.first));
+        chunk_store_->Get(name_value.first, content.size() / 2, 100, value);
+        auto begin(content.begin() + content.size() / 2);
+        EXPECT_EQ(std::vector<byte>(begin, begin + 100), value);
+        std::promise<std::error_code> get_result;
+        chunk_store_->GetAsync(name_value.first, [&](std::error_code error,
+                                                     std::vector<byte> async_value) {
+          value = std::move(async_value);
+          get_result.set_value(error);
+        });
+        EXPECT_FALSE(get_result.get_future().get());
+        EXPECT_EQ(content, value);
+      }
+      EXPECT_EQ(ChunkObfuscator::SeekableSize(kLargeSize),
+                chunk_store_->StoredSize(name_value_pairs[1].first));
+      EXPECT_EQ(stored_size, chunk_store_->CurrentDiskUsage().data);
+
+      // Chunks padded for direct writes were truncated back to size, so deleting them frees
+      // exactly what they were charged.
+      for (const auto& name_value : name_value_pairs)
+        chunk_store_->Delete(name_value.first);
+      EXPECT_EQ(0, chunk_store_->CurrentDiskUsage().data);
+    }
+  }
+}
+
+TEST_F(ChunkStoreTest, BEH_TryGet) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 2, OneKB);
+  chunk_store_->Put(name_value_pairs[0].first, name_value_pairs[0].second);
+  const auto& content(name_value_pairs[0].second.string());
+
+  auto result(chunk_store_->TryGet(name_value_pairs[0].first));
+  ASSERT_TRUE(static_cast<bool>(result));
+  EXPECT_EQ(content, *result);
+  result = chunk_store_->TryGet(name_value_pairs[0].first, 10, 20);
+  ASSERT_TRUE(static_cast<bool>(result));
+  EXPECT_EQ(std::vector<byte>(content.begin() + 10, content.begin() + 30), *result);
+  result = chunk_store_->TryGet(name_value_pairs[0].first, content.size() + 1, 1);
+  ASSERT_FALSE(static_cast<bool>(result));
+  EXPECT_EQ(make_error_code(CommonErrors::invalid_argument), result.error().code());
+
+  // Misses are returned, not thrown.
+  EXPECT_NO_THROW(result = chunk_store_->TryGet(name_value_pairs[1].first));
+  ASSERT_FALSE(static_cast<bool>(result));
+  EXPECT_EQ(make_error_code(CommonErrors::no_such_element), result.error().code());
+  EXPECT_NO_THROW(result = chunk_store_->TryGet(name_value_pairs[1].first, 0, 1));
+  ASSERT_FALSE(static_cast<bool>(result));
+  EXPECT_EQ(make_error_code(CommonErrors::no_such_element), result.error().code());
+  chunk_store_->Delete(name_value_pairs[0].first);
+  result = chunk_store_->TryGet(name_value_pairs[0].first);
+  ASSERT_FALSE(static_cast<bool>(result));
+  EXPECT_EQ(make_error_code(CommonErrors::no_such_element), result.error().code());
+}
+
+TEST_F(ChunkStoreTest, BEH_BatchOperations) {
+  const std::uint32_t kCapacity(8);
+  chunk_store_.reset(
+      new ChunkStore(chunk_store_path_, DiskUsage(kCapacity * (OneKB + AesPadding))));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kCapacity - 2, OneKB);
+
+  // The whole batch fits.
+  auto results(chunk_store_->PutMany(name_value_pairs));
+  ASSERT_EQ(name_value_pairs.size(), results.size());
+  EXPECT_EQ(name_value_pairs.size(), std::count(results.begin(), results.end(), std::error_code()));
+  EXPECT_EQ((kCapacity - 2) * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+
+  // Overwriting existing chunks needs no more space; of the new ones only two fit.
+  NameValueContainer more(name_value_pairs.begin(), name_value_pairs.begin() + 2);
+  AddRandomNameValuePairs(more, 4, OneKB);
+  results = chunk_store_->PutMany(more);
+  EXPECT_EQ(4, std::count(results.begin(), results.end(), std::error_code()));
+  EXPECT_EQ(2, std::count(results.begin(), results.end(),
+                          make_error_code(CommonErrors::cannot_exceed_limit)));
+  EXPECT_FALSE(results[0] || results[1]);
+  EXPECT_EQ(kCapacity * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+  EXPECT_EQ(kCapacity, chunk_store_->Count());
+
+  std::vector<NameType> names;
+  for (const auto& name_value : more)
+    names.push_back(name_value.first);
+  std::vector<std::vector<byte>> values;
+  results = chunk_store_->GetMany(names, values);
+  ASSERT_EQ(names.size(), values.size());
+  for (std::size_t i(0); i != names.size(); ++i) {
+    if (results[i])
+      EXPECT_TRUE(values[i].empty());
+    else
+      EXPECT_EQ(more[i].second.string(), values[i]);
+  }
+  EXPECT_EQ(4, std::count(results.begin(), results.end(), std::error_code()));
+
+  results = chunk_store_->DeleteMany(names);
+  EXPECT_EQ(4, std::count(results.begin(), results.end(), std::error_code()));
+  EXPECT_EQ((kCapacity - 4) * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+  EXPECT_EQ(kCapacity - 4, chunk_store_->Count());
+}
+
+TEST_F(ChunkStoreTest, BEH_AsyncPutGetDelete) {
+  const std::uint32_t kChunkCount(64);
+  chunk_store_.reset(
+      new ChunkStore(chunk_store_path_, DiskUsage(kChunkCount * (OneKB + AesPadding))));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kChunkCount + 1, OneKB);
+  auto extra(name_value_pairs.back());
+  name_value_pairs.pop_back();
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::size_t outstanding(0);
+  std::vector<std::error_code> errors;
+  auto completion([&](std::error_code error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    errors.push_back(error);
+    --outstanding;
+    condition.notify_one();
+  });
+  auto wait_for_all([&] {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&] { return outstanding == 0; });
+  });
+
+  outstanding = kChunkCount;
+  for (const auto& name_value : name_value_pairs)
+    chunk_store_->PutAsync(name_value.first, name_value.second, completion);
+  wait_for_all();
+  EXPECT_EQ(kChunkCount, std::count(errors.begin(), errors.end(), std::error_code()));
+  EXPECT_EQ(kChunkCount * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+
+  std::error_code error;
+  chunk_store_->PutAsync(extra.first, extra.second, [&](std::error_code e) { error = e; });
+  chunk_store_.reset();  // Waits for outstanding handlers.
+  EXPECT_EQ(make_error_code(CommonErrors::cannot_exceed_limit), error);
+  chunk_store_.reset(
+      new ChunkStore(chunk_store_path_, DiskUsage(kChunkCount * (OneKB + AesPadding))));
+
+  std::vector<std::vector<byte>> values(kChunkCount);
+  outstanding = kChunkCount;
+  errors.clear();
+  for (std::size_t i(0); i != kChunkCount; ++i) {
+    chunk_store_->GetAsync(name_value_pairs[i].first,
+                           [&, i](std::error_code error, std::vector<byte> value) {
+      values[i] = std::move(value);
+      completion(error);
+    });
+  }
+  wait_for_all();
+  EXPECT_EQ(kChunkCount, std::count(errors.begin(), errors.end(), std::error_code()));
+  for (std::size_t i(0); i != kChunkCount; ++i)
+    EXPECT_EQ(name_value_pairs[i].second.string(), values[i]);
+
+  outstanding = kChunkCount / 2;
+  errors.clear();
+  for (std::size_t i(0); i != kChunkCount / 2; ++i)
+    chunk_store_->DeleteAsync(name_value_pairs[i].first, completion);
+  wait_for_all();
+  EXPECT_EQ(kChunkCount / 2, std::count(errors.begin(), errors.end(), std::error_code()));
+  EXPECT_EQ(kChunkCount / 2, chunk_store_->Count());
+  EXPECT_EQ(kChunkCount / 2 * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+  EXPECT_THROW(chunk_store_->Get(name_value_pairs[0].first), std::exception);
+
+  chunk_store_->GetAsync(name_value_pairs[0].first,
+                         [&](std::error_code e, std::vector<byte>) { error = e; });
+  chunk_store_.reset();
+  EXPECT_EQ(make_error_code(CommonErrors::no_such_element), error);
+}
+
+TEST_F(ChunkStoreTest, BEH_AsyncOperationsQueuePerChunk) {
+  // Far more Gets than there are lock stripes are submitted from one thread, many on the same
+  // chunks, and each handler starts a further operation on its chunk from the completion thread.
+  // Since no call waits for another's I/O, none of this can block.
+  const std::size_t kChunkCount(8), kGetCount(1024);
+  chunk_store_.reset(
+      new ChunkStore(chunk_store_path_, DiskUsage(kChunkCount * (OneKB + AesPadding))));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kChunkCount, OneKB);
+  for (const auto& name_value : name_value_pairs)
+    chunk_store_->Put(name_value.first, name_value.second);
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::size_t outstanding(2 * kGetCount), failures(0);
+  std::atomic<std::size_t> mismatches(0);
+  auto completion([&](std::error_code error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error)
+      ++failures;
+    --outstanding;
+    condition.notify_one();
+  });
+  for (std::size_t i(0); i != kGetCount; ++i) {
+    const auto& name_value(name_value_pairs[i % kChunkCount]);
+    chunk_store_->GetAsync(name_value.first, [&](std::error_code error, std::vector<byte> value) {
+      if (!error && name_value.second.string() != value)
+        ++mismatches;
+      chunk_store_->PutAsync(name_value.first, name_value.second, completion);
+      completion(error);
+    });
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&] { return outstanding == 0; });
+  }
+  EXPECT_EQ(0, failures);
+  EXPECT_EQ(0, mismatches);
+  EXPECT_EQ(kChunkCount, chunk_store_->Count());
+  EXPECT_EQ(kChunkCount * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+
+  // Operations on one chunk take effect, and their handlers run, in the order submitted.
+  NonEmptyString updated(RandomBytes(OneKB));
+  const auto& name(name_value_pairs.front().first);
+  std::vector<int> order;
+  std::vector<byte> value;
+  chunk_store_->PutAsync(name, updated, [&](std::error_code) { order.push_back(0); });
+  chunk_store_->GetAsync(name, [&](std::error_code, std::vector<byte> v) {
+    order.push_back(1);
+    value = std::move(v);
+  });
+  chunk_store_->DeleteAsync(name, [&](std::error_code) { order.push_back(2); });
+  chunk_store_.reset();
+  EXPECT_EQ((std::vector<int>{0, 1, 2}), order);
+  EXPECT_EQ(updated.string(), value);
+}
+
+TEST_F(ChunkStoreTest, BEH_AsyncQueueUnderGroupCommit) {
+  // A queued Put of a chunk large enough to bypass the cache is written synchronously, and its
+  // handler here stores another chunk synchronously.  Both wait for the committer, so mustn't be
+  // run on its thread by the completion of the Put ahead of them.
+  const std::uint64_t kThreshold(8 * OneKB);
+  chunk_store_.reset(new ChunkStore(
+      chunk_store_path_, DiskUsage(4 * (kThreshold + OneKB)), ChunkStore::Engine::kFilePerChunk,
+      ChunkStore::Durability::kGroupCommit, ChunkStore::Compression::kNone,
+      ChunkStore::CacheBypass{ChunkStore::CacheBypass::Mode::kDropCache, kThreshold}));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 1, OneKB);
+  AddRandomNameValuePairs(name_value_pairs, 1, 2 * kThreshold);
+  AddRandomNameValuePairs(name_value_pairs, 1, OneKB);
+  const auto& name(name_value_pairs[0].first);
+  std::promise<std::error_code> first, second;
+  chunk_store_->PutAsync(name, name_value_pairs[0].second,
+                         [&](std::error_code error) { first.set_value(error); });
+  chunk_store_->PutAsync(name, name_value_pairs[1].second, [&](std::error_code error) {
+    try {
+      chunk_store_->Put(name_value_pairs[2].first, name_value_pairs[2].second);
+    } catch (const std::exception&) {
+      error = make_error_code(CommonErrors::filesystem_io_error);
+    }
+    second.set_value(error);
+  });
+  auto first_result(first.get_future()), second_result(second.get_future());
+  ASSERT_EQ(std::future_status::ready, second_result.wait_for(std::chrono::seconds(10)));
+  EXPECT_FALSE(first_result.get());
+  EXPECT_FALSE(second_result.get());
+  EXPECT_TRUE(name_value_pairs[1].second == chunk_store_->Get(name));
+  EXPECT_TRUE(name_value_pairs[2].second == chunk_store_->Get(name_value_pairs[2].first));
+}
+
+TEST_F(ChunkStoreTest, BEH_CommitWindow) {
+  const std::chrono::milliseconds kWindow(200);
+  EXPECT_THROW(ChunkStore(*test_path / "negative", DiskUsage(OneKB + AesPadding),
+                          ChunkStore::Engine::kFilePerChunk,
+                          ChunkStore::Durability(ChunkStore::Durability::kGroupCommit,
+                                                 std::chrono::microseconds(-1))),
+               maidsafe_error);
+  chunk_store_.reset(new ChunkStore(
+      chunk_store_path_, DiskUsage(OneKB + AesPadding), ChunkStore::Engine::kFilePerChunk,
+      ChunkStore::Durability(ChunkStore::Durability::kGroupCommit, kWindow)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 1, OneKB);
+  // A lone Put waits out the whole window for others to join its group.
+  auto start(std::chrono::steady_clock::now());
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[0].first, name_value_pairs[0].second));
+  EXPECT_LE(kWindow, std::chrono::steady_clock::now() - start);
+  EXPECT_TRUE(name_value_pairs[0].second == chunk_store_->Get(name_value_pairs[0].first));
+}
+
+TEST_F(ChunkStoreTest, BEH_GroupCommitDurability) {
+  const std::uint32_t kChunkCount(32);
+  const DiskUsage kMaxUsage(kChunkCount * (OneKB + AesPadding));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kChunkCount, OneKB);
+  for (auto engine : {ChunkStore::Engine::kFilePerChunk, ChunkStore::Engine::kPackFile}) {
+    chunk_store_.reset();
+    fs::remove_all(chunk_store_path_);
+    chunk_store_.reset(new ChunkStore(chunk_store_path_, kMaxUsage, engine,
+                                      ChunkStore::Durability::kGroupCommit));
+    std::vector<std::thread> threads;
+    for (std::uint32_t t(0); t != 4; ++t) {
+      threads.emplace_back([&, t] {
+        for (std::uint32_t i(t); i < kChunkCount / 2; i += 4)
+          chunk_store_->Put(name_value_pairs[i].first, name_value_pairs[i].second);
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::size_t outstanding(kChunkCount / 2);
+    std::size_t failures(0);
+    for (std::uint32_t i(kChunkCount / 2); i != kChunkCount; ++i) {
+      chunk_store_->PutAsync(name_value_pairs[i].first, name_value_pairs[i].second,
+                             [&](std::error_code error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error)
+          ++failures;
+        --outstanding;
+        condition.notify_one();
+      });
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [&] { return outstanding == 0; });
+    }
+    EXPECT_EQ(0, failures);
+    chunk_store_->Delete(name_value_pairs[0].first);
+
+    chunk_store_.reset(new ChunkStore(chunk_store_path_, kMaxUsage, engine,
+                                      ChunkStore::Durability::kGroupCommit));
+    EXPECT_EQ(kChunkCount - 1, chunk_store_->Count());
+    EXPECT_THROW(chunk_store_->Get(name_value_pairs[0].first), std::exception);
+    for (std::uint32_t i(1); i != kChunkCount; ++i)
+      EXPECT_TRUE(name_value_pairs[i].second == chunk_store_->Get(name_value_pairs[i].first));
+    for (fs::recursive_directory_iterator itr(chunk_store_path_), end; itr != end; ++itr)
+      EXPECT_NE(".tmp", itr->path().extension());
+  }
+}
+
+TEST_F(ChunkStoreTest, BEH_Compression) {
+  const std::uint32_t kChunkCount(8);
+  const DiskUsage kMaxUsage(kChunkCount * (5 * OneKB + AesPadding + 1));
+  NameValueContainer compressible, incompressible;
+  AddRandomNameValuePairs(incompressible, kChunkCount, 4 * OneKB);
+  for (std::uint32_t i(0); i != kChunkCount; ++i) {
+    std::string text;
+    while (text.size() < 4 * OneKB)
+      text += "A highly repetitive message " + std::to_string(i) + ". ";
+    compressible.emplace_back(GetRandomDataNameAndTypeId(),
+                              NonEmptyString(std::vector<byte>(text.begin(), text.end())));
+  }
+
+  for (auto engine : {ChunkStore::Engine::kFilePerChunk, ChunkStore::Engine::kPackFile}) {
+    chunk_store_.reset();
+    fs::remove_all(chunk_store_path_);
+    chunk_store_.reset(new ChunkStore(chunk_store_path_, kMaxUsage, engine,
+                                      ChunkStore::Durability::kBuffered,
+                                      ChunkStore::Compression::kFast));
+    for (const auto& chunk : compressible)
+      ASSERT_NO_THROW(chunk_store_->Put(chunk.first, chunk.second));
+    // Compressed chunks are charged at their compressed size.
+    EXPECT_GT(kChunkCount * OneKB, chunk_store_->CurrentDiskUsage().data);
+    EXPECT_GT(OneKB, chunk_store_->StoredSize(compressible[0].first));
+    auto results(chunk_store_->PutMany(incompressible));
+    EXPECT_EQ(kChunkCount, std::count(results.begin(), results.end(), std::error_code()));
+    EXPECT_EQ(4 * OneKB + AesPadding + 1, chunk_store_->StoredSize(incompressible[0].first));
+
+    // The level can change between sessions.
+    chunk_store_.reset(new ChunkStore(chunk_store_path_, kMaxUsage, engine,
+                                      ChunkStore::Durability::kBuffered,
+                                      ChunkStore::Compression::kBest));
+    for (const auto& chunk : compressible)
+      EXPECT_TRUE(chunk.second == chunk_store_->Get(chunk.first));
+    std::vector<byte> value;
+    for (const auto& chunk : incompressible) {
+      chunk_store_->Get(chunk.first, value);
+      EXPECT_EQ(chunk.second.string(), value);
+    }
+    std::vector<byte> async_value;
+    chunk_store_->GetAsync(compressible[1].first,
+                           [&](std::error_code, std::vector<byte> v) { async_value = v; });
+    chunk_store_.reset();
+    EXPECT_EQ(compressible[1].second.string(), async_value);
+  }
+}
+
+TEST_F(ChunkStoreTest, BEH_MemoryEngine) {
+  const std::uint32_t kChunkCount(8);
+  const DiskUsage kMaxUsage(kChunkCount * (OneKB + AesPadding));
+  fs::path path(*test_path / "in_memory");
+  chunk_store_.reset(new ChunkStore(path, kMaxUsage, ChunkStore::Engine::kMemory));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kChunkCount + 1, OneKB);
+  auto extra(name_value_pairs.back());
+  name_value_pairs.pop_back();
+
+  // The quota is applied just as for the disk engines.
+  auto results(chunk_store_->PutMany(name_value_pairs));
+  EXPECT_EQ(kChunkCount, std::count(results.begin(), results.end(), std::error_code()));
+  EXPECT_EQ(kMaxUsage, chunk_store_->CurrentDiskUsage());
+  EXPECT_THROW(chunk_store_->Put(extra.first, extra.second), maidsafe_error);
+  EXPECT_EQ(kChunkCount, chunk_store_->Count());
+
+  std::vector<byte> value;
+  for (const auto& name_value : name_value_pairs) {
+    EXPECT_TRUE(chunk_store_->Has(name_value.first));
+    EXPECT_TRUE(name_value.second == chunk_store_->Get(name_value.first));
+    chunk_store_->Get(name_value.first, 10, 20, value);
+    auto begin(name_value.second.string().begin() + 10);
+    EXPECT_EQ(std::vector<byte>(begin, begin + 20), value);
+  }
+  std::promise<std::error_code> get_result;
+  chunk_store_->GetAsync(name_value_pairs[1].first,
+                         [&](std::error_code error, std::vector<byte> async_value) {
+    value = std::move(async_value);
+    get_result.set_value(error);
+  });
+  EXPECT_FALSE(get_result.get_future().get());
+  EXPECT_EQ(name_value_pairs[1].second.string(), value);
+
+  chunk_store_->Delete(name_value_pairs[0].first);
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[0].first));
+  EXPECT_EQ(make_error_code(CommonErrors::no_such_element),
+            chunk_store_->TryGet(name_value_pairs[0].first).error().code());
+  EXPECT_THROW(chunk_store_->Delete(name_value_pairs[0].first), maidsafe_error);
+  EXPECT_NO_THROW(chunk_store_->Put(extra.first, extra.second));
+  EXPECT_EQ(kMaxUsage, chunk_store_->CurrentDiskUsage());
+
+  // Nothing is written to disk, so nothing outlives the store.
+  EXPECT_FALSE(fs::exists(path));
+  chunk_store_.reset(new ChunkStore(path, kMaxUsage, ChunkStore::Engine::kMemory));
+  EXPECT_EQ(0, chunk_store_->Count());
+  EXPECT_EQ(0, chunk_store_->CurrentDiskUsage().data);
+  EXPECT_FALSE(fs::exists(path));
+}
+
+TEST_F(ChunkStoreTest, BEH_Scrubbing) {
+  const std::uint32_t kChunkCount(8);
+  const std::uint64_t kChunkSize(8 * OneKB), kBytesPerSecond(128 * OneKB);
+  chunk_store_.reset(
+      new ChunkStore(chunk_store_path_, DiskUsage(kChunkCount * (kChunkSize + AesPadding))));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kChunkCount, kChunkSize);
+  std::vector<ChunkStore::NameType> names;
+  for (const auto& name_value : name_value_pairs) {
+    chunk_store_->Put(name_value.first, name_value.second);
+    names.push_back(name_value.first);
+  }
+  // Names which aren't held are skipped.
+  names.push_back(GetRandomDataNameAndTypeId());
+
+  // Flip a byte in one chunk's file.
+  fs::path corrupted;
+  for (fs::recursive_directory_iterator itr(chunk_store_path_), end; itr != end; ++itr) {
+    if (itr->path().parent_path().filename() == "metadata") {
+      itr.no_push();
+    } else if (itr.level() != 0 && fs::is_regular_file(itr->status())) {
+      corrupted = itr->path();
+      break;
+    }
+  }
+  ASSERT_FALSE(corrupted.empty());
+  {
+    std::fstream stream(corrupted.string(), std::ios::binary | std::ios::in | std::ios::out);
+    char first(static_cast<char>(stream.get()));
+    stream.seekp(0);
+    stream.put(static_cast<char>(first ^ 0x55));
+  }
+
+  EXPECT_THROW(chunk_store_->StartScrubbing([&] { return names; }, 0,
+                                            [](const ChunkStore::NameType&) {}),
+               maidsafe_error);
+  std::mutex mutex;
+  std::vector<ChunkStore::NameType> reported;
+  auto start(std::chrono::steady_clock::now());
+  chunk_store_->StartScrubbing([&] { return names; }, kBytesPerSecond,
+                               [&](const ChunkStore::NameType& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    reported.push_back(name);
+  });
+  while (chunk_store_->GetScrubStats().passes == 0 &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  auto elapsed(std::chrono::steady_clock::now() - start);
+  chunk_store_->StopScrubbing();
+
+  auto stats(chunk_store_->GetScrubStats());
+  EXPECT_EQ(1, stats.passes);
+  EXPECT_EQ(kChunkCount, stats.chunks);
+  EXPECT_EQ(kChunkCount * (kChunkSize + AesPadding), stats.bytes);
+  EXPECT_EQ(1, stats.corrupt);
+  // All but the last chunk's worth of bytes must have been paced.
+  EXPECT_LE((kChunkCount - 1) * kChunkSize * 1000 / kBytesPerSecond,
+            std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+  ASSERT_EQ(1, reported.size());
+  EXPECT_THROW(chunk_store_->Get(reported.front()), std::exception);
+  for (const auto& name_value : name_value_pairs) {
+    if (!(name_value.first == reported.front()))
+      EXPECT_TRUE(name_value.second == chunk_store_->Get(name_value.first));
+  }
+}
+
+TEST_F(ChunkStoreTest, BEH_ScrubbingValidatesContent) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 4, OneKB);
+  std::vector<ChunkStore::NameType> names;
+  for (const auto& name_value : name_value_pairs) {
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+    names.push_back(name_value.first);
+  }
+  const ChunkStore::NameType rejected(names.front());
+
+  // The validator sees the decrypted values, and a chunk it rejects is reported but kept.
+  std::mutex mutex;
+  std::vector<ChunkStore::NameType> reported;
+  std::atomic<std::size_t> mismatches(0);
+  chunk_store_->StartScrubbing(
+      [&] { return names; }, 1024 * OneKB,
+      [&](const ChunkStore::NameType& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        reported.push_back(name);
+      },
+      [&](const ChunkStore::NameType& name, const std::vector<byte>& value) {
+        auto itr(std::find_if(name_value_pairs.begin(), name_value_pairs.end(),
+                              [&](const NameValueContainer::value_type& name_value) {
+                                return name_value.first == name;
+                              }));
+        if (itr == name_value_pairs.end() || itr->second.string() != value)
+          ++mismatches;
+        return !(name == rejected);
+      });
+  auto start(std::chrono::steady_clock::now());
+  while (chunk_store_->GetScrubStats().passes == 0 &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  chunk_store_->StopScrubbing();
+
+  auto stats(chunk_store_->GetScrubStats());
+  EXPECT_EQ(1, stats.passes);
+  EXPECT_EQ(names.size(), stats.chunks);
+  EXPECT_EQ(1, stats.corrupt);
+  EXPECT_EQ(0, mismatches);
+  ASSERT_EQ(1, reported.size());
+  EXPECT_TRUE(reported.front() == rejected);
+  EXPECT_TRUE(chunk_store_->Has(rejected));
+}
+
+TEST_F(ChunkStoreTest, BEH_IndexQueries) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 3, OneKB);
+  for (std::size_t i(0); i != 2; ++i)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[i].first, name_value_pairs[i].second));
+  EXPECT_EQ(2, chunk_store_->Count());
+  EXPECT_TRUE(chunk_store_->Has(name_value_pairs[0].first));
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[2].first));
+  EXPECT_EQ(OneKB + AesPadding, chunk_store_->StoredSize(name_value_pairs[1].first));
+  EXPECT_EQ(0, chunk_store_->StoredSize(name_value_pairs[2].first));
+  auto names(chunk_store_->Names());
+  EXPECT_EQ(2, names.size());
+  EXPECT_TRUE(std::is_sorted(names.begin(), names.end()));
+
+  ASSERT_NO_THROW(chunk_store_->Delete(name_value_pairs[0].first));
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[0].first));
+  EXPECT_EQ(1, chunk_store_->Names().size());
+}
+
+TEST_F(ChunkStoreTest, BEH_NameCursor) {
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(100 * (OneKB + AesPadding))));
+  NameValueContainer name_value_pairs;
+  for (std::uint32_t i(0); i != 60; ++i) {
+    name_value_pairs.emplace_back(NameType(MakeIdentity(), DataTypeId(i % 3)),
+                                  NonEmptyString(RandomBytes(OneKB)));
+    ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs.back().first,
+                                      name_value_pairs.back().second));
+  }
+  const auto names(chunk_store_->Names());
+  auto list([&](ChunkStore::NameCursor& cursor, std::size_t page_size) {
+    std::vector<NameType> listed;
+    while (!cursor.Done()) {
+      auto page(cursor.Next(page_size));
+      EXPECT_GE(page_size, page.size());
+      listed.insert(listed.end(), page.begin(), page.end());
+    }
+    EXPECT_TRUE(cursor.Next(page_size).empty());
+    return listed;
+  });
+
+  ChunkStore::NameCursor cursor(*chunk_store_, ChunkStore::NameFilter());
+  EXPECT_TRUE(names == list(cursor, 7));
+  ChunkStore::NameCursor exact_cursor(*chunk_store_, ChunkStore::NameFilter());
+  EXPECT_TRUE(names == list(exact_cursor, names.size()));
+
+  // A new cursor, even on a restarted store, resumes from another's token.
+  ChunkStore::NameCursor first_half(*chunk_store_, ChunkStore::NameFilter());
+  auto listed(first_half.Next(25));
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(100 * (OneKB + AesPadding))));
+  ChunkStore::NameCursor second_half(*chunk_store_, ChunkStore::NameFilter(), first_half.Token());
+  auto rest(list(second_half, 10));
+  listed.insert(listed.end(), rest.begin(), rest.end());
+  EXPECT_TRUE(names == listed);
+  EXPECT_THROW(ChunkStore::NameCursor(*chunk_store_, ChunkStore::NameFilter(),
+                                      std::vector<byte>(10)),
+               maidsafe_error);
+
+  // Filtering by type and by (hashed) name prefix.
+  ChunkStore::NameFilter filter;
+  filter.type_id = DataTypeId(1);
+  ChunkStore::NameCursor type_cursor(*chunk_store_, filter);
+  std::vector<NameType> expected;
+  std::copy_if(names.begin(), names.end(), std::back_inserter(expected),
+               [](const NameType& name) { return name.type_id == DataTypeId(1); });
+  EXPECT_EQ(20, expected.size());
+  EXPECT_TRUE(expected == list(type_cursor, 3));
+
+  filter = ChunkStore::NameFilter();
+  filter.prefix.assign(1, names[30].name.string()[0]);
+  ChunkStore::NameCursor prefix_cursor(*chunk_store_, filter);
+  expected.clear();
+  std::copy_if(names.begin(), names.end(), std::back_inserter(expected), [&](const NameType& name) {
+    return name.name.string()[0] == filter.prefix[0];
+  });
+  EXPECT_FALSE(expected.empty());
+  EXPECT_TRUE(expected == list(prefix_cursor, 2));
+
+  // Changes behind the cursor aren't seen, those ahead of it are, and nothing is repeated.
+  ChunkStore::NameCursor live_cursor(*chunk_store_, ChunkStore::NameFilter());
+  listed = live_cursor.Next(30);
+  NameValueContainer added;
+  AddRandomNameValuePairs(added, 10, OneKB);
+  for (const auto& name_value : added)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+  rest = list(live_cursor, 8);
+  listed.insert(listed.end(), rest.begin(), rest.end());
+  EXPECT_TRUE(std::is_sorted(listed.begin(), listed.end()));
+  EXPECT_TRUE(std::adjacent_find(listed.begin(), listed.end()) == listed.end());
+  auto after_added(chunk_store_->Names());
+  std::vector<NameType> expected_live(after_added.begin(), after_added.end());
+  expected_live.erase(std::remove_if(expected_live.begin(), expected_live.end(),
+                                     [&](const NameType& name) {
+                        return name < listed[29] &&
+                               !std::binary_search(names.begin(), names.end(), name);
+                      }),
+                      expected_live.end());
+  EXPECT_TRUE(expected_live == listed);
+}
+
+TEST_F(ChunkStoreTest, BEH_IndexRestart) {
+  NameValueContainer name_value_pairs(PopulateChunkStore(4, 4, chunk_store_path_));
+  ASSERT_NO_THROW(chunk_store_->Delete(name_value_pairs[0].first));
+  auto names(chunk_store_->Names());
+  fs::path snapshot(ChunkStoreEngine::MetadataDirectory(chunk_store_path_) / "index");
+
+  // Clean shutdown: the index is reloaded from its snapshot, which is consumed on load.
+  chunk_store_.reset();
+  EXPECT_TRUE(fs::exists(snapshot));
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, max_disk_usage_));
+  EXPECT_FALSE(fs::exists(snapshot));
+  EXPECT_TRUE(names == chunk_store_->Names());
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[0].first));
+  EXPECT_TRUE(chunk_store_->Has(name_value_pairs[3].first));
+
+  // Unclean shutdown leaves no snapshot, so the index is rebuilt from the chunks on disk.
+  chunk_store_.reset();
+  fs::remove(snapshot);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, max_disk_usage_));
+  EXPECT_TRUE(names == chunk_store_->Names());
+  EXPECT_EQ(OneKB + AesPadding, chunk_store_->StoredSize(name_value_pairs[1].first));
+
+  // A damaged snapshot is discarded in favour of a rebuild.
+  chunk_store_.reset();
+  fs::resize_file(snapshot, fs::file_size(snapshot) - 1);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, max_disk_usage_));
+  EXPECT_TRUE(names == chunk_store_->Names());
+}
+
+TEST_F(ChunkStoreTest, BEH_UsageLedgerRestart) {
+  PopulateChunkStore(4, 4, chunk_store_path_);
+  const std::uint64_t kFullUsage(4 * (OneKB + AesPadding));
+  fs::path ledger(ChunkStoreEngine::MetadataDirectory(chunk_store_path_) / "usage_ledger");
+
+  // After a clean shutdown the usage is taken from the ledger, not from the disk, so a chunk
+  // removed behind the store's back goes unnoticed.
+  chunk_store_.reset();
+  EXPECT_TRUE(fs::exists(ledger));
+  fs::path chunk_file;
+  for (fs::recursive_directory_iterator itr(chunk_store_path_), end; itr != end; ++itr) {
+    // Chunks are never in the root, which holds the layout manifest.
+    if (fs::is_regular_file(itr->status()) && itr.level() != 0 &&
+        itr->path().parent_path() != ChunkStoreEngine::MetadataDirectory(chunk_store_path_))
+      chunk_file = itr->path();
+  }
+  ASSERT_FALSE(chunk_file.empty());
+  fs::remove(chunk_file);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, max_disk_usage_));
+  EXPECT_FALSE(fs::exists(ledger));
+  EXPECT_EQ(kFullUsage, chunk_store_->CurrentDiskUsage().data);
+
+  // Without a clean ledger the store is rescanned.
+  chunk_store_.reset();
+  fs::remove(ledger);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, max_disk_usage_));
+  EXPECT_EQ(kFullUsage - (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+  EXPECT_EQ(3, chunk_store_->Count());
+}
+
+TEST_F(ChunkStoreTest, BEH_DeferredDelete) {
+  const std::uint64_t kChunkSize(OneKB + AesPadding);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 4, OneKB);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(4 * kChunkSize)));
+  for (const auto& name_value : name_value_pairs)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+  fs::path metadata(ChunkStoreEngine::MetadataDirectory(chunk_store_path_));
+  auto chunk_files([&] {
+    std::size_t count(0);
+    for (fs::recursive_directory_iterator itr(chunk_store_path_), end; itr != end; ++itr) {
+      // Chunks are never in the root, which holds the layout manifest.
+      if (fs::is_regular_file(itr->status()) && itr.level() != 0 &&
+          itr->path().parent_path() != metadata) {
+        ++count;
+      }
+    }
+    return count;
+  });
+  EXPECT_EQ(4, chunk_files());
+
+  // Space is released as soon as a chunk is deleted, before the engine has removed it.
+  ASSERT_NO_THROW(chunk_store_->Delete(name_value_pairs[0].first));
+  ASSERT_NO_THROW(chunk_store_->Delete(name_value_pairs[1].first));
+  EXPECT_EQ(2 * kChunkSize, chunk_store_->CurrentDiskUsage().data);
+  EXPECT_EQ(2, chunk_store_->Count());
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[0].first));
+  EXPECT_FALSE(chunk_store_->TryGet(name_value_pairs[0].first));
+  EXPECT_THROW(chunk_store_->Delete(name_value_pairs[0].first), std::exception);
+
+  // A chunk stored again before it's reclaimed survives reclamation.
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[1].first, name_value_pairs[1].second));
+  chunk_store_->Reclaim();
+  EXPECT_EQ(0, chunk_store_->PendingReclaims());
+  EXPECT_EQ(3, chunk_files());
+  EXPECT_FALSE(fs::exists(metadata / "tombstones"));
+  EXPECT_TRUE(name_value_pairs[1].second == chunk_store_->Get(name_value_pairs[1].first));
+  EXPECT_EQ(3 * kChunkSize, chunk_store_->CurrentDiskUsage().data);
+
+  // A tombstone journalled before a crash, for a chunk which the engine still holds, survives the
+  // rescan: the chunk is neither counted nor served, and is then reclaimed.
+  chunk_store_.reset();
+  fs::remove(metadata / "usage_ledger");
+  {
+    NameType hashed_name(name_value_pairs[2].first);
+    hashed_name.name = crypto::Hash<crypto::SHA512>(hashed_name.name);
+    TombstoneJournal journal(metadata);
+    journal.Tombstone(hashed_name);
+  }
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(4 * kChunkSize)));
+  EXPECT_EQ(2 * kChunkSize, chunk_store_->CurrentDiskUsage().data);
+  EXPECT_EQ(2, chunk_store_->Count());
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[2].first));
+  chunk_store_->Reclaim();
+  EXPECT_EQ(2, chunk_files());
+
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(4 * kChunkSize)));
+  EXPECT_EQ(2 * kChunkSize, chunk_store_->CurrentDiskUsage().data);
+  EXPECT_TRUE(name_value_pairs[3].second == chunk_store_->Get(name_value_pairs[3].first));
+}
+
+TEST_F(ChunkStoreTest, BEH_ConcurrentPutGetDelete) {
+  const std::uint32_t kThreadCount(8), kEntriesPerThread(20);
+  std::vector<NameValueContainer> name_value_pairs(kThreadCount);
+  for (auto& thread_pairs : name_value_pairs)
+    AddRandomNameValuePairs(thread_pairs, kEntriesPerThread, OneKB);
+  chunk_store_.reset(new ChunkStore(
+      chunk_store_path_, DiskUsage(kThreadCount * kEntriesPerThread * (OneKB + AesPadding))));
+
+  std::vector<std::thread> threads;
+  for (const auto& thread_pairs : name_value_pairs) {
+    threads.emplace_back([&] {
+      for (const auto& name_value : thread_pairs) {
+        EXPECT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+        NonEmptyString recovered;
+        EXPECT_NO_THROW(recovered = chunk_store_->Get(name_value.first));
+        EXPECT_TRUE(name_value.second == recovered);
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(kThreadCount * kEntriesPerThread * (OneKB + AesPadding),
+            chunk_store_->CurrentDiskUsage().data);
+
+  // The store is now full, so a further chunk must be rejected without disturbing the accounting.
+  EXPECT_THROW(chunk_store_->Put(GetRandomDataNameAndTypeId(), NonEmptyString(RandomBytes(OneKB))),
+               std::exception);
+
+  threads.clear();
+  for (const auto& thread_pairs : name_value_pairs) {
+    threads.emplace_back([&] {
+      for (const auto& name_value : thread_pairs)
+        EXPECT_NO_THROW(chunk_store_->Delete(name_value.first));
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(0, chunk_store_->CurrentDiskUsage().data);
+}
+
+TEST_F(ChunkStoreTest, FUNC_ConcurrentThroughput) {
+  const std::uint32_t kTotalOps(2048), kValueSize(64 * OneKB);
+  const std::uint32_t kMaxThreads(std::max(4U, std::thread::hardware_concurrency()));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kTotalOps / 4, kValueSize);
+
+  auto ops_per_second = [&](std::uint32_t thread_count) {
+    chunk_store_.reset(new ChunkStore(*test_path / ("throughput_" + std::to_string(thread_count)),
+                                      DiskUsage(kTotalOps * (kValueSize + AesPadding))));
+    std::vector<std::thread> threads;
+    pt::ptime start_time(pt::microsec_clock::universal_time());
+    for (std::uint32_t i = 0; i != thread_count; ++i) {
+      threads.emplace_back([&, i] {
+        for (std::size_t j = i; j < name_value_pairs.size(); j += thread_count) {
+          EXPECT_NO_THROW(chunk_store_->Put(name_value_pairs[j].first, name_value_pairs[j].second));
+          for (int k = 0; k != 3; ++k)
+            EXPECT_NO_THROW(chunk_store_->Get(name_value_pairs[j].first));
+        }
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+    pt::ptime stop_time(pt::microsec_clock::universal_time());
+    PrintResult(start_time, stop_time);
+    auto duration(std::max<std::int64_t>((stop_time - start_time).total_microseconds(), 1));
+    return kTotalOps * 1000000.0 / duration;
+  };
+
+  double single_thread_rate(ops_per_second(1));
+  double multi_thread_rate(ops_per_second(kMaxThreads));
+  std::cout << "1 thread: " << single_thread_rate << " ops/s, " << kMaxThreads
+            << " threads: " << multi_thread_rate << " ops/s" << std::endl;
+  // Operations on distinct chunks must no longer serialise on one lock.
+  if (std::thread::hardware_concurrency() > 1)
+    EXPECT_GT(multi_thread_rate, single_thread_rate);
+}
+
 }  // namespace test
 
 }  // namespace vault
@@ -0,0 +1,168 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/disk_budget.h"
+
+#include <thread>
+#include <vector>
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/chunk_store.h"
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+TEST(DiskBudgetTest, BEH_SoftAndHardLimits) {
+  DiskBudget disk_budget(DiskUsage(100));
+  EXPECT_THROW(disk_budget.AddAccount("bad", DiskBudget::Limits{DiskUsage(20), DiskUsage(10)}),
+               maidsafe_error);
+  EXPECT_THROW(disk_budget.AddAccount("bad", DiskBudget::Limits{DiskUsage(20), DiskUsage(101)}),
+               maidsafe_error);
+  auto first(disk_budget.AddAccount("first", DiskBudget::Limits{DiskUsage(40), DiskUsage(60)}));
+  auto second(disk_budget.AddAccount("second", DiskBudget::Limits{DiskUsage(30), DiskUsage(90)}));
+  EXPECT_THROW(disk_budget.AddAccount("third", DiskBudget::Limits{DiskUsage(31), DiskUsage(31)}),
+               maidsafe_error);
+  EXPECT_EQ(30, disk_budget.Unallocated().data);
+
+  // 'first' is held to its hard limit, even with space to spare.
+  EXPECT_TRUE(first->Reserve(60));
+  EXPECT_FALSE(first->Reserve(1));
+  EXPECT_EQ(10, disk_budget.Unallocated().data);
+
+  // 'second' may borrow what's left unguaranteed, but no more.
+  EXPECT_TRUE(second->Reserve(40));
+  EXPECT_FALSE(second->Reserve(1));
+  EXPECT_EQ(100, disk_budget.Used().data);
+
+  // Borrowed space returns to the pool when released, for either account to take, while what's
+  // guaranteed to an account stays available to it alone.
+  first->Release(40);
+  EXPECT_EQ(20, first->Used());
+  EXPECT_TRUE(second->Reserve(20));
+  EXPECT_EQ(60, second->Used());
+  EXPECT_FALSE(second->Reserve(1));
+  EXPECT_TRUE(first->Reserve(20));
+  EXPECT_FALSE(first->Reserve(1));
+  EXPECT_EQ(0, disk_budget.Unallocated().data);
+
+  // Charges are accepted beyond the limits, and repaid before anything more is lent, though the
+  // other accounts keep their guarantees.
+  first->Release(40);
+  second->Release(60);
+  first->Charge(90);
+  EXPECT_EQ(90, first->Used());
+  EXPECT_TRUE(second->Reserve(30));
+  EXPECT_FALSE(second->Reserve(1));
+  first->Release(90);
+  EXPECT_EQ(30, disk_budget.Unallocated().data);
+  EXPECT_TRUE(second->Reserve(30));
+  first.reset();
+  EXPECT_EQ(60, disk_budget.Used().data);
+  EXPECT_EQ(40, disk_budget.Unallocated().data);
+}
+
+TEST(DiskBudgetTest, BEH_ConcurrentReservations) {
+  const std::uint64_t kCapacity(10000);
+  DiskBudget disk_budget((DiskUsage(kCapacity)));
+  std::vector<std::shared_ptr<DiskBudget::Account>> accounts;
+  for (int i(0); i != 4; ++i) {
+    accounts.push_back(disk_budget.AddAccount(
+        "account", DiskBudget::Limits{DiskUsage(kCapacity / 8), DiskUsage(kCapacity)}));
+  }
+  std::vector<std::thread> threads;
+  for (const auto& account : accounts) {
+    threads.emplace_back([&] {
+      std::uint64_t held(0);
+      for (int i(0); i != 20000; ++i) {
+        if (i % 3 != 2 && account->Reserve(7)) {
+          held += 7;
+        } else if (held != 0) {
+          account->Release(7);
+          held -= 7;
+        }
+        EXPECT_LE(disk_budget.Used().data, kCapacity);
+      }
+      account->Release(held);
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(0, disk_budget.Used().data);
+  EXPECT_EQ(kCapacity / 2, disk_budget.Unallocated().data);
+}
+
+TEST(DiskBudgetTest, BEH_ChunkStores) {
+  const std::uint64_t kChunkSize(1024), kStoredSize(kChunkSize + 16);
+  maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_DiskBudget"));
+  DiskBudget disk_budget(DiskUsage(4 * kStoredSize));
+  auto first_account(disk_budget.AddAccount(
+      "first", DiskBudget::Limits{DiskUsage(kStoredSize), DiskUsage(4 * kStoredSize)}));
+  auto second_account(disk_budget.AddAccount(
+      "second", DiskBudget::Limits{DiskUsage(kStoredSize), DiskUsage(4 * kStoredSize)}));
+  std::vector<Data::NameAndTypeId> names;
+  {
+    // Each store's own limit is the whole disk; the budget keeps them within it together.
+    ChunkStore first(*test_path / "first", DiskUsage(4 * kStoredSize),
+                     ChunkStore::Engine::kFilePerChunk, ChunkStore::Durability::kBuffered,
+                     ChunkStore::Compression::kNone,
+                     ChunkStore::CacheBypass{ChunkStore::CacheBypass::Mode::kNone, 0},
+                     first_account);
+    ChunkStore second(*test_path / "second", DiskUsage(4 * kStoredSize),
+                      ChunkStore::Engine::kFilePerChunk, ChunkStore::Durability::kBuffered,
+                      ChunkStore::Compression::kNone,
+                      ChunkStore::CacheBypass{ChunkStore::CacheBypass::Mode::kNone, 0},
+                      second_account);
+    for (int i(0); i != 3; ++i) {
+      names.push_back(GetRandomDataNameAndTypeId());
+      EXPECT_NO_THROW(first.Put(names.back(), NonEmptyString(RandomBytes(kChunkSize))));
+    }
+    auto name(GetRandomDataNameAndTypeId());
+    EXPECT_THROW(first.Put(name, NonEmptyString(RandomBytes(kChunkSize))), maidsafe_error);
+    EXPECT_EQ(3 * kStoredSize, first.CurrentDiskUsage().data);
+    EXPECT_NO_THROW(second.Put(name, NonEmptyString(RandomBytes(kChunkSize))));
+    EXPECT_THROW(second.Put(GetRandomDataNameAndTypeId(), NonEmptyString(RandomBytes(kChunkSize))),
+                 maidsafe_error);
+    EXPECT_NO_THROW(first.Delete(names.back()));
+    EXPECT_NO_THROW(second.Put(GetRandomDataNameAndTypeId(),
+                               NonEmptyString(RandomBytes(kChunkSize))));
+    EXPECT_EQ(4 * kStoredSize, disk_budget.Used().data);
+  }
+  // Closing a store returns its charge, and reopening it charges what it holds again.
+  EXPECT_EQ(0, disk_budget.Used().data);
+  ChunkStore first(*test_path / "first", DiskUsage(4 * kStoredSize),
+                   ChunkStore::Engine::kFilePerChunk, ChunkStore::Durability::kBuffered,
+                   ChunkStore::Compression::kNone,
+                   ChunkStore::CacheBypass{ChunkStore::CacheBypass::Mode::kNone, 0},
+                   first_account);
+  EXPECT_EQ(2 * kStoredSize, first_account->Used());
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
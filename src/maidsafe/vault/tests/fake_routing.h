@@ -35,7 +35,7 @@ namespace test {
 template <typename Child>
 class FakeRouting {
  public:
-  FakeRouting() {}
+  FakeRouting() : our_id_(RandomString(identity_size)) {}
 
   FakeRouting(const FakeRouting&) = delete;
   FakeRouting(FakeRouting&&) = delete;
@@ -43,6 +43,8 @@ class FakeRouting {
   FakeRouting& operator=(FakeRouting&&) = delete;
   ~FakeRouting() = default;
 
+  const Address& OurId() const { return our_id_; }
+
   template <typename DataType>
   routing::HandlePutPostReturn TriggerHandleGet(SourceAddress from, Authority from_authority,
       Authority authority, DataType data_type, Identity data_name) {
@@ -68,6 +70,9 @@ class FakeRouting {
       close_nodes.emplace_back(RandomString(identity_size));
     return close_nodes;
   }
+
+ private:
+  const Address our_id_;
 };
 
 }  // namespace test
@@ -0,0 +1,191 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/file_chunk_engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+class FileChunkEngineTest : public testing::Test {
+ protected:
+  using NameType = ChunkStoreEngine::NameType;
+  using Layout = FileChunkEngine::Layout;
+  static const std::uint64_t kChunkSize = 256;
+
+  FileChunkEngineTest()
+      : test_path_(maidsafe::test::CreateTestPath("MaidSafe_Test_FileChunkEngine")),
+        disk_path_(*test_path_ / "chunks"),
+        engine_(),
+        chunks_() {}
+
+  void Open(Layout layout) {
+    engine_.reset();
+    engine_.reset(new FileChunkEngine(disk_path_, nullptr,
+                                      FileChunkEngine::CacheBypass{
+                                          FileChunkEngine::CacheBypass::Mode::kNone, 0},
+                                      layout));
+    engine_->Initialise();
+  }
+
+  void PutChunks(std::size_t count) {
+    AddRandomNameValuePairs(chunks_, count, kChunkSize);
+    for (std::size_t i(chunks_.size() - count); i != chunks_.size(); ++i)
+      engine_->Put(chunks_[i].first, chunks_[i].second.string());
+  }
+
+  void ExpectAllReadable() {
+    for (const auto& chunk : chunks_)
+      EXPECT_EQ(chunk.second.string(), engine_->Get(chunk.first));
+    EXPECT_EQ(chunks_.size(), engine_->Scan().size());
+  }
+
+  bool WaitForMigration() {
+    auto deadline(std::chrono::steady_clock::now() + std::chrono::seconds(30));
+    while (engine_->Migrating() && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return !engine_->Migrating();
+  }
+
+  // Whether every chunk file is 'depth' directories of 'width' characters below the root.
+  bool IsLaidOut(Layout layout) const {
+    for (fs::recursive_directory_iterator itr(disk_path_), end; itr != end; ++itr) {
+      if (itr.level() == 0 && itr->path().filename() == "layout")
+        continue;
+      auto name(itr->path().filename().string());
+      if (fs::is_directory(itr->status())) {
+        if (name.size() != layout.width || static_cast<std::uint32_t>(itr.level()) >= layout.depth)
+          return false;
+      } else if (static_cast<std::uint32_t>(itr.level()) != layout.depth) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  maidsafe::test::TestPath test_path_;
+  fs::path disk_path_;
+  std::unique_ptr<FileChunkEngine> engine_;
+  std::vector<std::pair<NameType, NonEmptyString>> chunks_;
+};
+
+const std::uint64_t FileChunkEngineTest::kChunkSize;
+
+TEST_F(FileChunkEngineTest, BEH_Layouts) {
+  EXPECT_THROW(Open(Layout{0, 1}), maidsafe_error);
+  EXPECT_THROW(Open(Layout{1, 5}), maidsafe_error);
+  EXPECT_THROW(Open(Layout{65, 2}), maidsafe_error);
+  for (const auto& layout : {Layout{5, 1}, Layout{2, 2}, Layout{3, 3}}) {
+    chunks_.clear();
+    fs::remove_all(disk_path_);
+    Open(layout);
+    PutChunks(20);
+    engine_->Delete(chunks_.back().first);
+    chunks_.pop_back();
+    EXPECT_THROW(engine_->Get(GetRandomDataNameAndTypeId()), maidsafe_error);
+    ExpectAllReadable();
+    EXPECT_FALSE(engine_->Migrating());
+    EXPECT_TRUE(IsLaidOut(layout));
+  }
+}
+
+TEST_F(FileChunkEngineTest, BEH_ManifestValidation) {
+  auto write_manifest([&](const std::string& content) {
+    fs::create_directories(disk_path_);
+    ASSERT_TRUE(WriteFile(disk_path_ / "layout", content));
+  });
+  write_manifest("2 0\n");
+  EXPECT_THROW(Open(Layout{2, 2}), maidsafe_error);
+  write_manifest("2 2\n9 9\n");
+  EXPECT_THROW(Open(Layout{2, 2}), maidsafe_error);
+  write_manifest("2 2\nfive\n");
+  EXPECT_THROW(Open(Layout{2, 2}), maidsafe_error);
+
+  // A root whose paths fit the current layout, but not a deeper earlier one in the manifest.
+  const std::size_t kMaxPathSize(4096), kMaxFileNameSize(2 * 64 + 1 + 10);
+  std::size_t root_size(kMaxPathSize - kMaxFileNameSize - 5 - 1);
+  disk_path_ = *test_path_;
+  while (disk_path_.string().size() + 1 < root_size) {
+    std::size_t component(std::min<std::size_t>(200, root_size - disk_path_.string().size() - 1));
+    disk_path_ /= std::string(component, 'd');
+  }
+  ASSERT_EQ(root_size, disk_path_.string().size());
+  write_manifest("2 2\n");
+  EXPECT_NO_THROW(Open(Layout{2, 2}));
+  engine_.reset();
+  write_manifest("2 2\n5 1\n");
+  EXPECT_THROW(Open(Layout{2, 2}), maidsafe_error);
+}
+
+TEST_F(FileChunkEngineTest, BEH_Migration) {
+  // A store written before layouts were recorded.
+  Open(Layout{5, 1});
+  PutChunks(200);
+  fs::remove(disk_path_ / "layout");
+
+  // Chunks stay available throughout, whether or not they've been moved yet.
+  Open(Layout{2, 2});
+  engine_->Delete(chunks_.front().first);
+  chunks_.erase(chunks_.begin());
+  std::vector<byte> replacement(RandomBytes(kChunkSize));
+  engine_->Put(chunks_.back().first, replacement);
+  chunks_.back().second = NonEmptyString(replacement);
+  PutChunks(10);
+  for (const auto& chunk : chunks_)
+    EXPECT_EQ(chunk.second.string(), engine_->Get(chunk.first));
+  ASSERT_TRUE(WaitForMigration());
+  ExpectAllReadable();
+  EXPECT_TRUE(IsLaidOut(Layout{2, 2}));
+
+  // The manifest makes the layout stick.
+  Open(Layout{2, 2});
+  EXPECT_FALSE(engine_->Migrating());
+  ExpectAllReadable();
+
+  // A migration interrupted by closing the store resumes on reopening, even towards a new layout.
+  Open(Layout{3, 3});
+  Open(Layout{3, 1});
+  ExpectAllReadable();
+  ASSERT_TRUE(WaitForMigration());
+  ExpectAllReadable();
+  EXPECT_TRUE(IsLaidOut(Layout{3, 1}));
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
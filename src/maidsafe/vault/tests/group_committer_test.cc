@@ -0,0 +1,133 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/group_committer.h"
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/test.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+namespace {
+
+void WriteText(const fs::path& path, const std::string& text) {
+  std::ofstream stream(path.string(), std::ios::binary);
+  stream << text;
+}
+
+std::string ReadText(const fs::path& path) {
+  std::ifstream stream(path.string(), std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+}  // unnamed namespace
+
+TEST(GroupCommitterTest, BEH_CommitAndRename) {
+  maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_Committer"));
+  GroupCommitter committer(std::chrono::milliseconds(1));
+  fs::path file(*test_path / "a"), temp(*test_path / "b.tmp"), target(*test_path / "b");
+  WriteText(file, "in place");
+  WriteText(temp, "new");
+  WriteText(target, "old");
+
+  EXPECT_NO_THROW(committer.Commit(file));
+  EXPECT_NO_THROW(committer.Commit(temp, target));
+  EXPECT_EQ("in place", ReadText(file));
+  EXPECT_EQ("new", ReadText(target));
+  EXPECT_FALSE(fs::exists(temp));
+
+  EXPECT_THROW(committer.Commit(*test_path / "missing"), std::exception);
+  std::error_code error;
+  committer.CommitAsync(*test_path / "missing", target, std::vector<fs::path>(),
+                        [&](std::error_code e) { error = e; });
+  committer.Commit(file);  // Groups complete in order.
+  EXPECT_EQ(make_error_code(CommonErrors::filesystem_io_error), error);
+  EXPECT_EQ("new", ReadText(target));
+}
+
+TEST(GroupCommitterTest, BEH_CreatedDirectories) {
+  maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_Committer"));
+  GroupCommitter committer(std::chrono::milliseconds(1));
+  std::vector<fs::path> created{*test_path / "a", *test_path / "a" / "b"};
+  ASSERT_TRUE(fs::create_directories(created.back()));
+  fs::path temp(created.back() / "c.tmp"), target(created.back() / "c");
+  WriteText(temp, "new");
+  EXPECT_NO_THROW(committer.Commit(temp, target, created));
+  EXPECT_EQ("new", ReadText(target));
+
+  // Once the file has replaced its target, failing to flush a directory doesn't fail the commit,
+  // since the target can't be restored.
+  WriteText(temp, "newer");
+  EXPECT_NO_THROW(
+      committer.Commit(temp, target, std::vector<fs::path>{*test_path / "missing" / "d"}));
+  EXPECT_EQ("newer", ReadText(target));
+  EXPECT_FALSE(fs::exists(temp));
+}
+
+TEST(GroupCommitterTest, BEH_ConcurrentCommitsShareGroups) {
+  maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_Committer"));
+  const int kThreads(8), kCommitsPerThread(16);
+  GroupCommitter committer(std::chrono::milliseconds(5));
+  std::atomic<int> failures(0);
+  std::vector<std::thread> threads;
+  for (int t(0); t != kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i(0); i != kCommitsPerThread; ++i) {
+        auto name(std::to_string(t) + "_" + std::to_string(i));
+        fs::path temp(*test_path / (name + ".tmp"));
+        WriteText(temp, name);
+        try {
+          committer.Commit(temp, *test_path / name);
+        } catch (const std::exception&) {
+          ++failures;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(0, failures);
+  EXPECT_LT(committer.GroupCount(), static_cast<std::uint64_t>(kThreads * kCommitsPerThread));
+  for (int t(0); t != kThreads; ++t) {
+    for (int i(0); i != kCommitsPerThread; ++i) {
+      auto name(std::to_string(t) + "_" + std::to_string(i));
+      EXPECT_EQ(name, ReadText(*test_path / name));
+    }
+  }
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
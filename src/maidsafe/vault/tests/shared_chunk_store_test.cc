@@ -0,0 +1,218 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/shared_chunk_store.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/chunk_store_engine.h"
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+class SharedChunkStoreTest : public testing::Test {
+ protected:
+  using NameType = SharedChunkStore::NameType;
+  using Owner = SharedChunkStore::Owner;
+  static const std::uint64_t kChunkSize = 1024;
+  // Obfuscation adds up to 16 bytes.
+  static const std::uint64_t kStoredSize = kChunkSize + 16;
+
+  SharedChunkStoreTest()
+      : test_path_(maidsafe::test::CreateTestPath("MaidSafe_Test_SharedChunkStore")),
+        store_path_(*test_path_ / "shared"),
+        store_() {
+    Reset();
+  }
+
+  void Reset() {
+    store_.reset();
+    store_.reset(new SharedChunkStore(store_path_, DiskUsage(16 * kStoredSize)));
+  }
+
+  maidsafe::test::TestPath test_path_;
+  fs::path store_path_;
+  std::unique_ptr<SharedChunkStore> store_;
+};
+
+const std::uint64_t SharedChunkStoreTest::kChunkSize;
+const std::uint64_t SharedChunkStoreTest::kStoredSize;
+
+TEST_F(SharedChunkStoreTest, BEH_Deduplication) {
+  NameType name(GetRandomDataNameAndTypeId());
+  NonEmptyString value(RandomBytes(kChunkSize));
+
+  // Repeated Puts by either owner store the chunk, and charge for it, once.
+  ASSERT_NO_THROW(store_->Put(name, value, Owner::kPmidNode));
+  ASSERT_NO_THROW(store_->Put(name, value, Owner::kPmidNode));
+  EXPECT_FALSE(store_->Has(name, Owner::kMpidManager));
+  EXPECT_FALSE(store_->TryGet(name, Owner::kMpidManager));
+  ASSERT_NO_THROW(store_->Put(name, value, Owner::kMpidManager));
+  EXPECT_EQ(2, store_->References(name, Owner::kPmidNode));
+  EXPECT_EQ(1, store_->References(name, Owner::kMpidManager));
+  EXPECT_EQ(1, store_->Store().Count());
+  EXPECT_EQ(kStoredSize, store_->Store().CurrentDiskUsage().data);
+
+  // The chunk survives until the last reference to it is dropped.
+  ASSERT_NO_THROW(store_->Delete(name, Owner::kMpidManager));
+  EXPECT_THROW(store_->Delete(name, Owner::kMpidManager), maidsafe_error);
+  EXPECT_FALSE(store_->Has(name, Owner::kMpidManager));
+  ASSERT_NO_THROW(store_->Delete(name, Owner::kPmidNode));
+  auto result(store_->TryGet(name, Owner::kPmidNode));
+  ASSERT_TRUE(result);
+  EXPECT_EQ(value.string(), *result);
+  ASSERT_NO_THROW(store_->Delete(name, Owner::kPmidNode));
+  EXPECT_FALSE(store_->Store().Has(name));
+  EXPECT_EQ(0, store_->Store().CurrentDiskUsage().data);
+  EXPECT_THROW(store_->Delete(name, Owner::kPmidNode), maidsafe_error);
+}
+
+TEST_F(SharedChunkStoreTest, BEH_MutableContent) {
+  NameType name(GetRandomDataNameAndTypeId());
+  NonEmptyString value(RandomBytes(kChunkSize)), updated(RandomBytes(kChunkSize));
+  using Content = SharedChunkStore::Content;
+  ASSERT_NO_THROW(store_->Put(name, value, Owner::kPmidNode, Content::kMutable));
+  ASSERT_NO_THROW(store_->Put(name, updated, Owner::kPmidNode, Content::kMutable));
+  EXPECT_EQ(1, store_->References(name, Owner::kPmidNode));
+  auto result(store_->TryGet(name, Owner::kPmidNode));
+  ASSERT_TRUE(result);
+  EXPECT_EQ(updated.string(), *result);
+  ASSERT_NO_THROW(store_->Delete(name, Owner::kPmidNode));
+  EXPECT_FALSE(store_->Store().Has(name));
+}
+
+TEST_F(SharedChunkStoreTest, BEH_Names) {
+  NameType shared(GetRandomDataNameAndTypeId()), pmid_only(GetRandomDataNameAndTypeId());
+  NonEmptyString value(RandomBytes(kChunkSize));
+  ASSERT_NO_THROW(store_->Put(shared, value, Owner::kPmidNode));
+  ASSERT_NO_THROW(store_->Put(shared, value, Owner::kMpidManager));
+  ASSERT_NO_THROW(store_->Put(pmid_only, NonEmptyString(RandomBytes(kChunkSize)),
+                              Owner::kPmidNode));
+  auto names(store_->Names(Owner::kPmidNode));
+  std::sort(names.begin(), names.end());
+  std::vector<NameType> expected{shared, pmid_only};
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(expected, names);
+  EXPECT_EQ(std::vector<NameType>(1, shared), store_->Names(Owner::kMpidManager));
+
+  ASSERT_NO_THROW(store_->Delete(shared, Owner::kPmidNode));
+  EXPECT_EQ(std::vector<NameType>(1, pmid_only), store_->Names(Owner::kPmidNode));
+}
+
+TEST_F(SharedChunkStoreTest, BEH_Restart) {
+  NameType shared(GetRandomDataNameAndTypeId()), purged(GetRandomDataNameAndTypeId()),
+      legacy(GetRandomDataNameAndTypeId());
+  NonEmptyString value(RandomBytes(kChunkSize));
+  store_->Put(shared, value, Owner::kPmidNode);
+  store_->Put(shared, value, Owner::kMpidManager);
+  store_->Put(purged, value, Owner::kPmidNode);
+  store_->Put(purged, value, Owner::kMpidManager);
+  ASSERT_NO_THROW(store_->Purge(purged));
+  EXPECT_EQ(0, store_->References(purged, Owner::kMpidManager));
+  EXPECT_FALSE(store_->Store().Has(purged));
+
+  Reset();
+  EXPECT_EQ(1, store_->References(shared, Owner::kPmidNode));
+  EXPECT_EQ(1, store_->References(shared, Owner::kMpidManager));
+  EXPECT_EQ(0, store_->References(purged, Owner::kPmidNode));
+  EXPECT_EQ(1, store_->Store().Count());
+
+  // A chunk stored before references were recorded is visible to, and deletable by, any owner.
+  store_.reset();
+  {
+    ChunkStore chunk_store(store_path_, DiskUsage(16 * kStoredSize));
+    chunk_store.Put(legacy, value);
+  }
+  Reset();
+  EXPECT_TRUE(store_->Has(legacy, Owner::kMpidManager));
+  EXPECT_TRUE(store_->Has(legacy, Owner::kPmidNode));
+  ASSERT_NO_THROW(store_->Delete(legacy, Owner::kMpidManager));
+  EXPECT_FALSE(store_->Store().Has(legacy));
+
+  // References to a chunk which has gone from the store are discarded when it's stored again.
+  store_.reset();
+  {
+    ChunkStore chunk_store(store_path_, DiskUsage(16 * kStoredSize));
+    chunk_store.Delete(shared);
+  }
+  Reset();
+  EXPECT_FALSE(store_->Has(shared, Owner::kPmidNode));
+  ASSERT_NO_THROW(store_->Put(shared, value, Owner::kPmidNode));
+  EXPECT_EQ(1, store_->References(shared, Owner::kPmidNode));
+  EXPECT_EQ(0, store_->References(shared, Owner::kMpidManager));
+  EXPECT_EQ(kStoredSize, store_->Store().CurrentDiskUsage().data);
+}
+
+TEST_F(SharedChunkStoreTest, BEH_ImportPersonaStore) {
+  const std::size_t kChunkCount(6);
+  std::vector<NameType> names;
+  NonEmptyString value(RandomBytes(kChunkSize));
+  ChunkStore persona_store(*test_path_ / "mpid_manager", DiskUsage(16 * kStoredSize));
+  for (std::size_t i(0); i != kChunkCount; ++i) {
+    names.push_back(GetRandomDataNameAndTypeId());
+    persona_store.Put(names.back(), value);
+  }
+  // A chunk which the shared store already holds is charged once.
+  store_->Put(names.front(), value, Owner::kPmidNode);
+
+  ASSERT_NO_THROW(store_->Import(persona_store));
+  EXPECT_EQ(0, persona_store.Count());
+  EXPECT_EQ(0, persona_store.CurrentDiskUsage().data);
+  EXPECT_EQ(kChunkCount, store_->Store().Count());
+  EXPECT_EQ(kChunkCount * kStoredSize, store_->Store().CurrentDiskUsage().data);
+  for (std::size_t i(1); i != kChunkCount; ++i) {
+    auto result(store_->TryGet(names[i], Owner::kMpidManager));
+    ASSERT_TRUE(result);
+    EXPECT_EQ(value.string(), *result);
+    EXPECT_TRUE(store_->Has(names[i], Owner::kPmidNode));
+  }
+  EXPECT_EQ(1, store_->References(names.front(), Owner::kPmidNode));
+
+  // Imported chunks are kept across a restart.
+  Reset();
+  EXPECT_EQ(kChunkCount, store_->Store().Count());
+  EXPECT_TRUE(store_->Has(names.back(), Owner::kMpidManager));
+
+  // Chunks are moved as stored, so a compressed store can't take them from an uncompressed one.
+  ChunkStore compressed(*test_path_ / "compressed", DiskUsage(16 * kStoredSize),
+                        ChunkStore::Engine::kFilePerChunk, ChunkStore::Durability::kBuffered,
+                        ChunkStore::Compression::kFast);
+  persona_store.Put(names.front(), value);
+  EXPECT_THROW(compressed.Import(persona_store), maidsafe_error);
+  EXPECT_EQ(1, persona_store.Count());
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
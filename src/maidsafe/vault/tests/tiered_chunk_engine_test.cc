@@ -0,0 +1,216 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/tiered_chunk_engine.h"
+
+#include <memory>
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/chunk_store.h"
+#include "maidsafe/vault/file_chunk_engine.h"
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+class TieredChunkEngineTest : public testing::Test {
+ protected:
+  using NameType = ChunkStoreEngine::NameType;
+  static const std::uint64_t kChunkSize = 1024;
+
+  TieredChunkEngineTest()
+      : test_path_(maidsafe::test::CreateTestPath("MaidSafe_Test_TieredChunkEngine")),
+        fast_path_(*test_path_ / "fast"),
+        slow_path_(*test_path_ / "slow"),
+        engine_(),
+        chunks_() {}
+
+  // Migration is only run explicitly.  Placement is only saved if 'metadata_directory' is given.
+  void Reset(std::uint64_t fast_capacity = 8 * kChunkSize,
+             std::uint64_t slow_capacity = 64 * kChunkSize,
+             const fs::path& metadata_directory = fs::path()) {
+    engine_.reset();
+    engine_.reset(new TieredChunkEngine(
+        std::unique_ptr<ChunkStoreEngine>(new FileChunkEngine(fast_path_)), fast_capacity,
+        std::unique_ptr<ChunkStoreEngine>(new FileChunkEngine(slow_path_)), slow_capacity,
+        std::chrono::milliseconds(0), metadata_directory));
+    engine_->Initialise();
+  }
+
+  void PutChunks(std::size_t count) {
+    AddRandomNameValuePairs(chunks_, count, kChunkSize);
+    for (std::size_t i(chunks_.size() - count); i != chunks_.size(); ++i)
+      engine_->Put(chunks_[i].first, chunks_[i].second.string());
+  }
+
+  void ExpectAllReadable() {
+    for (const auto& chunk : chunks_)
+      EXPECT_EQ(chunk.second.string(), engine_->Get(chunk.first));
+  }
+
+  maidsafe::test::TestPath test_path_;
+  fs::path fast_path_, slow_path_;
+  std::unique_ptr<TieredChunkEngine> engine_;
+  std::vector<std::pair<NameType, NonEmptyString>> chunks_;
+};
+
+const std::uint64_t TieredChunkEngineTest::kChunkSize;
+
+TEST_F(TieredChunkEngineTest, BEH_PlacementAndMigration) {
+  Reset();
+  // New chunks land on the fast tier until it's full.
+  PutChunks(12);
+  EXPECT_EQ(8 * kChunkSize, engine_->FastTierUsage());
+  EXPECT_EQ(4 * kChunkSize, engine_->SlowTierUsage());
+  EXPECT_TRUE(engine_->IsOnFastTier(chunks_[7].first));
+  EXPECT_FALSE(engine_->IsOnFastTier(chunks_[8].first));
+
+  // Demotion takes the least recently used chunks down to the low watermark.
+  engine_->Get(chunks_[0].first);
+  engine_->Migrate();
+  EXPECT_EQ(6 * kChunkSize, engine_->FastTierUsage());
+  EXPECT_TRUE(engine_->IsOnFastTier(chunks_[0].first));
+  EXPECT_FALSE(engine_->IsOnFastTier(chunks_[1].first));
+  EXPECT_FALSE(engine_->IsOnFastTier(chunks_[2].first));
+  ExpectAllReadable();
+
+  // Chunks read repeatedly from the slow tier are promoted once there's room.
+  for (std::uint32_t i(0); i != TieredChunkEngine::kPromotionReads; ++i)
+    engine_->Get(chunks_[9].first);
+  engine_->Delete(chunks_[3].first);
+  engine_->Delete(chunks_[4].first);
+  chunks_.erase(chunks_.begin() + 3, chunks_.begin() + 5);
+  engine_->Migrate();
+  EXPECT_TRUE(engine_->IsOnFastTier(chunks_[7].first));
+  EXPECT_EQ(5 * kChunkSize, engine_->FastTierUsage());
+  ExpectAllReadable();
+  EXPECT_EQ(chunks_.size(), engine_->Scan().size());
+
+  // Placement survives a restart.
+  Reset();
+  EXPECT_EQ(5 * kChunkSize, engine_->FastTierUsage());
+  EXPECT_EQ(5 * kChunkSize, engine_->SlowTierUsage());
+  EXPECT_TRUE(engine_->IsOnFastTier(chunks_[7].first));
+  ExpectAllReadable();
+}
+
+TEST_F(TieredChunkEngineTest, BEH_CapacityAndReplacement) {
+  Reset(2 * kChunkSize, 2 * kChunkSize);
+  PutChunks(4);
+  NameType extra(GetRandomDataNameAndTypeId());
+  EXPECT_THROW(engine_->Put(extra, RandomBytes(kChunkSize)), maidsafe_error);
+  EXPECT_THROW(engine_->Get(extra), maidsafe_error);
+
+  // Replacing a chunk frees its old space first, and may move it between tiers.
+  std::vector<byte> smaller(RandomBytes(kChunkSize / 2));
+  engine_->Put(chunks_[3].first, smaller);
+  EXPECT_EQ(smaller, engine_->Get(chunks_[3].first));
+  EXPECT_EQ(2 * kChunkSize, engine_->FastTierUsage());
+  EXPECT_EQ(kChunkSize + kChunkSize / 2, engine_->SlowTierUsage());
+  engine_->Delete(chunks_[0].first);
+  std::vector<byte> larger(RandomBytes(kChunkSize));
+  engine_->Put(chunks_[3].first, larger);
+  EXPECT_TRUE(engine_->IsOnFastTier(chunks_[3].first));
+  EXPECT_EQ(kChunkSize, engine_->SlowTierUsage());
+  EXPECT_EQ(larger, engine_->Get(chunks_[3].first));
+}
+
+TEST_F(TieredChunkEngineTest, BEH_InterruptedMoveIsResolved) {
+  NameType torn(GetRandomDataNameAndTypeId()), intact(GetRandomDataNameAndTypeId());
+  std::vector<byte> content(RandomBytes(kChunkSize));
+  {
+    FileChunkEngine fast(fast_path_), slow(slow_path_);
+    fast.Initialise();
+    slow.Initialise();
+    // A torn copy on the fast tier, and an identical copy on both.
+    fast.Put(torn, std::vector<byte>(content.begin(), content.begin() + 10));
+    slow.Put(torn, content);
+    fast.Put(intact, content);
+    slow.Put(intact, content);
+  }
+  Reset();
+  EXPECT_FALSE(engine_->IsOnFastTier(torn));
+  EXPECT_TRUE(engine_->IsOnFastTier(intact));
+  EXPECT_EQ(content, engine_->Get(torn));
+  EXPECT_EQ(content, engine_->Get(intact));
+  EXPECT_EQ(kChunkSize, engine_->FastTierUsage());
+  EXPECT_EQ(kChunkSize, engine_->SlowTierUsage());
+  EXPECT_EQ(2, engine_->Scan().size());
+}
+
+TEST_F(TieredChunkEngineTest, BEH_SavedPlacement) {
+  const fs::path kMetadata(*test_path_ / "metadata");
+  Reset(2 * kChunkSize, 8 * kChunkSize, kMetadata);
+  PutChunks(4);
+  engine_->SaveState();
+
+  // A chunk added behind the engine's back shows that the saved placement is used, not a scan.
+  NameType unplaced(GetRandomDataNameAndTypeId());
+  {
+    FileChunkEngine slow(slow_path_);
+    slow.Initialise();
+    slow.Put(unplaced, RandomBytes(kChunkSize));
+  }
+  Reset(2 * kChunkSize, 8 * kChunkSize, kMetadata);
+  EXPECT_EQ(2 * kChunkSize, engine_->FastTierUsage());
+  EXPECT_EQ(2 * kChunkSize, engine_->SlowTierUsage());
+  EXPECT_TRUE(engine_->IsOnFastTier(chunks_[0].first));
+  EXPECT_FALSE(engine_->IsOnFastTier(chunks_[3].first));
+  EXPECT_EQ(4, engine_->Scan().size());
+  ExpectAllReadable();
+
+  // The saved placement was consumed, so without another save (as after a crash) the tiers are
+  // scanned.
+  Reset(2 * kChunkSize, 8 * kChunkSize, kMetadata);
+  EXPECT_EQ(5, engine_->Scan().size());
+  EXPECT_EQ(3 * kChunkSize, engine_->SlowTierUsage());
+}
+
+TEST_F(TieredChunkEngineTest, BEH_ChunkStoreWithFastTier) {
+  const std::uint64_t kStoredSize(kChunkSize + 16);
+  ChunkStore::FastTier fast_tier{fast_path_, DiskUsage(2 * kStoredSize)};
+  std::unique_ptr<ChunkStore> chunk_store(
+      new ChunkStore(slow_path_, DiskUsage(2 * kStoredSize), fast_tier));
+  EXPECT_EQ(4 * kStoredSize, chunk_store->MaxDiskUsage().data);
+  AddRandomNameValuePairs(chunks_, 5, kChunkSize);
+  for (std::size_t i(0); i != 4; ++i)
+    ASSERT_NO_THROW(chunk_store->Put(chunks_[i].first, chunks_[i].second));
+  EXPECT_THROW(chunk_store->Put(chunks_[4].first, chunks_[4].second), std::exception);
+
+  chunk_store.reset(new ChunkStore(slow_path_, DiskUsage(2 * kStoredSize), fast_tier));
+  EXPECT_EQ(4 * kStoredSize, chunk_store->CurrentDiskUsage().data);
+  for (std::size_t i(0); i != 4; ++i)
+    EXPECT_TRUE(chunks_[i].second == chunk_store->Get(chunks_[i].first));
+  EXPECT_FALSE(fs::is_empty(fast_path_));
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,434 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/tiered_chunk_engine.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+#include "maidsafe/vault/chunk_index.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+const double TieredChunkEngine::kHighWatermark(0.9);
+const double TieredChunkEngine::kLowWatermark(0.75);
+const std::uint32_t TieredChunkEngine::kPromotionReads;
+const std::chrono::milliseconds TieredChunkEngine::kDefaultMigrationInterval(
+    std::chrono::seconds(10));
+const std::size_t TieredChunkEngine::kLoadBatch;
+
+TieredChunkEngine::TieredChunkEngine(std::unique_ptr<ChunkStoreEngine> fast_engine,
+                                     std::uint64_t fast_capacity,
+                                     std::unique_ptr<ChunkStoreEngine> slow_engine,
+                                     std::uint64_t slow_capacity,
+                                     std::chrono::milliseconds migration_interval,
+                                     const fs::path& metadata_directory)
+    : fast_engine_(std::move(fast_engine)),
+      slow_engine_(std::move(slow_engine)),
+      kFastCapacity_(fast_capacity),
+      kSlowCapacity_(slow_capacity),
+      kMigrationInterval_(migration_interval),
+      kMetadataDirectory_(metadata_directory),
+      mutex_(),
+      condition_(),
+      placements_(),
+      promotions_(),
+      access_clock_(0),
+      fast_usage_(0),
+      slow_usage_(0),
+      migration_requested_(false),
+      stop_(false),
+      migration_thread_() {}
+
+TieredChunkEngine::~TieredChunkEngine() { StopMigration(); }
+
+void TieredChunkEngine::Initialise() {
+  fast_engine_->Initialise();
+  slow_engine_->Initialise();
+  if (!LoadPlacements())
+    ScanTiers();
+  if (kMigrationInterval_.count() != 0)
+    migration_thread_ = std::thread([this] { MigrationLoop(); });
+}
+
+void TieredChunkEngine::ScanTiers() {
+  LOG(kInfo) << "Scanning both tiers to place their chunks";
+  for (bool fast : {true, false}) {
+    for (const auto& chunk : Tier(fast).Scan()) {
+      auto inserted(placements_.insert(
+          std::make_pair(chunk.name, Placement{fast, chunk.size, 0, 0, 0, false, false})));
+      if (inserted.second) {
+        Usage(fast) += chunk.size;
+        continue;
+      }
+      // Left on both tiers by a move interrupted by a crash.
+      Placement& placement(inserted.first->second);
+      bool keep_slow(chunk.size > placement.size);
+      LOG(kWarning) << "Chunk " << chunk.name.name << " found on both tiers; keeping the "
+                    << (keep_slow ? "slow" : "fast") << " copy";
+      if (keep_slow) {
+        fast_engine_->Delete(chunk.name);
+        fast_usage_ -= placement.size;
+        placement = Placement{false, chunk.size, 0, 0, 0, false, false};
+        slow_usage_ += chunk.size;
+      } else {
+        slow_engine_->Delete(chunk.name);
+      }
+    }
+  }
+}
+
+bool TieredChunkEngine::LoadPlacements() {
+  if (kMetadataDirectory_.empty())
+    return false;
+  // Both are loaded, so that neither outlives the session which is about to move chunks.
+  ChunkIndex fast_index(kMetadataDirectory_ / "fast_tier"),
+      slow_index(kMetadataDirectory_ / "slow_tier");
+  bool fast_loaded(fast_index.Load()), slow_loaded(slow_index.Load());
+  if (!fast_loaded || !slow_loaded)
+    return false;
+  for (bool fast : {true, false}) {
+    const ChunkIndex& index(fast ? fast_index : slow_index);
+    boost::optional<NameType> last;
+    std::vector<NameType> names;
+    do {
+      names = index.NamesAfter(last, kLoadBatch, ChunkIndex::Filter());
+      for (const auto& name : names) {
+        std::uint64_t size(index.Size(name));
+        placements_.emplace_hint(placements_.end(), name,
+                                 Placement{fast, size, 0, 0, 0, false, false});
+        Usage(fast) += size;
+      }
+      if (!names.empty())
+        last = names.back();
+    } while (names.size() == kLoadBatch);
+  }
+  return true;
+}
+
+void TieredChunkEngine::SaveState() {
+  StopMigration();
+  if (kMetadataDirectory_.empty())
+    return;
+  ChunkIndex fast_index(kMetadataDirectory_ / "fast_tier"),
+      slow_index(kMetadataDirectory_ / "slow_tier");
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& placement : placements_) {
+      ChunkIndex& index(placement.second.on_fast_tier ? fast_index : slow_index);
+      index.Put(placement.first, placement.second.size);
+    }
+  }
+  fast_index.Save();
+  slow_index.Save();
+}
+
+void TieredChunkEngine::Put(const NameType& name, const std::vector<byte>& content) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  Placement* existing(Pin(lock, name));
+  bool replacing(existing != nullptr);
+  Placement old(replacing ? *existing : Placement{false, 0, 0, 0, 0, false, false});
+  auto fits([&](bool fast) {
+    std::uint64_t freed(replacing && old.on_fast_tier == fast ? old.size : 0);
+    return Usage(fast) - freed + content.size() <= (fast ? kFastCapacity_ : kSlowCapacity_);
+  });
+  bool to_fast(fits(true));
+  if (!to_fast && !fits(false)) {
+    if (replacing)
+      --existing->in_use;
+    LOG(kError) << "Neither tier has room for " << content.size() << " bytes";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+  }
+  // Space is reserved on the target tier while writing to it.
+  Usage(to_fast) += content.size();
+  if (!replacing) {
+    existing = &placements_.insert(std::make_pair(
+        name, Placement{to_fast, content.size(), 0, 0, 1, false, false})).first->second;
+  }
+  lock.unlock();
+
+  auto undo([&] {
+    lock.lock();
+    Usage(to_fast) -= content.size();
+    if (replacing)
+      --existing->in_use;
+    else
+      placements_.erase(name);
+  });
+  try {
+    Tier(to_fast).Put(name, content);
+  } catch (const std::exception&) {
+    undo();
+    throw;
+  }
+  if (replacing && old.on_fast_tier != to_fast) {
+    try {
+      Tier(old.on_fast_tier).Delete(name);
+    } catch (const std::exception&) {
+      // Leave only the old copy, which is still accounted for.
+      try {
+        Tier(to_fast).Delete(name);
+      } catch (const std::exception&) {}
+      undo();
+      throw;
+    }
+  }
+
+  lock.lock();
+  if (replacing)
+    Usage(old.on_fast_tier) -= old.size;
+  *existing = Placement{to_fast, content.size(), ++access_clock_, 0, 0, false, false};
+  if (fast_usage_ > kHighWatermark * kFastCapacity_) {
+    migration_requested_ = true;
+    condition_.notify_all();
+  }
+}
+
+std::vector<byte> TieredChunkEngine::Get(const NameType& name) const {
+  std::vector<byte> content;
+  Read(name, [&](const byte* data, std::size_t size) { content.assign(data, data + size); });
+  return content;
+}
+
+void TieredChunkEngine::Read(const NameType& name, const Reader& reader) const {
+  bool fast(false);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Placement* placement(Pin(lock, name));
+    if (!placement)
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+    fast = placement->on_fast_tier;
+  }
+  try {
+    Tier(fast).Read(name, reader);
+  } catch (const std::exception&) {
+    UnpinRead(name);
+    throw;
+  }
+  UnpinRead(name);
+}
+
+std::uint64_t TieredChunkEngine::Delete(const NameType& name) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  Placement* placement(Pin(lock, name));
+  if (!placement)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  bool fast(placement->on_fast_tier);
+  lock.unlock();
+  std::uint64_t freed(0);
+  try {
+    freed = Tier(fast).Delete(name);
+  } catch (const std::exception&) {
+    lock.lock();
+    --placements_.at(name).in_use;
+    throw;
+  }
+  lock.lock();
+  Usage(fast) -= placements_.at(name).size;
+  placements_.erase(name);
+  return freed;
+}
+
+std::vector<ChunkStoreEngine::StoredChunk> TieredChunkEngine::Scan() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<StoredChunk> chunks;
+  chunks.reserve(placements_.size());
+  for (const auto& placement : placements_)
+    chunks.push_back(StoredChunk{placement.first, placement.second.size});
+  return chunks;
+}
+
+void TieredChunkEngine::Migrate() {
+  // Demote the least recently used idle chunks.
+  std::vector<std::pair<std::uint64_t, NameType>> candidates;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fast_usage_ > kHighWatermark * kFastCapacity_) {
+      for (const auto& placement : placements_) {
+        if (placement.second.on_fast_tier)
+          candidates.emplace_back(placement.second.last_access, placement.first);
+      }
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const std::pair<std::uint64_t, NameType>& lhs,
+               const std::pair<std::uint64_t, NameType>& rhs) { return lhs.first < rhs.first; });
+  for (const auto& candidate : candidates) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_ || fast_usage_ <= kLowWatermark * kFastCapacity_)
+        break;
+    }
+    Move(candidate.second, false);
+  }
+
+  // Promote chunks read often enough, while there's room below the low watermark.
+  for (;;) {
+    NameType name;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_ || promotions_.empty())
+        break;
+      name = promotions_.front();
+      promotions_.pop_front();
+      auto itr(placements_.find(name));
+      if (itr == placements_.end())
+        continue;
+      itr->second.promotion_queued = false;
+      if (fast_usage_ + itr->second.size > kLowWatermark * kFastCapacity_)
+        continue;
+    }
+    Move(name, true);
+  }
+}
+
+std::uint64_t TieredChunkEngine::FastTierUsage() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return fast_usage_;
+}
+
+std::uint64_t TieredChunkEngine::SlowTierUsage() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slow_usage_;
+}
+
+bool TieredChunkEngine::IsOnFastTier(const NameType& name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto itr(placements_.find(name));
+  return itr != placements_.end() && itr->second.on_fast_tier;
+}
+
+TieredChunkEngine::Placement* TieredChunkEngine::Pin(std::unique_lock<std::mutex>& lock,
+                                                      const NameType& name) const {
+  auto itr(placements_.end());
+  condition_.wait(lock, [&] {
+    itr = placements_.find(name);
+    return itr == placements_.end() || !itr->second.moving;
+  });
+  if (itr == placements_.end())
+    return nullptr;
+  ++itr->second.in_use;
+  return &itr->second;
+}
+
+void TieredChunkEngine::UnpinRead(const NameType& name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto itr(placements_.find(name));
+  if (itr == placements_.end())
+    return;
+  Placement& placement(itr->second);
+  --placement.in_use;
+  placement.last_access = ++access_clock_;
+  if (!placement.on_fast_tier && ++placement.slow_reads >= kPromotionReads &&
+      !placement.promotion_queued) {
+    placement.promotion_queued = true;
+    promotions_.push_back(name);
+    migration_requested_ = true;
+    condition_.notify_all();
+  }
+}
+
+bool TieredChunkEngine::Move(const NameType& name, bool to_fast) {
+  std::uint64_t size(0);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto itr(placements_.find(name));
+    if (itr == placements_.end() || itr->second.on_fast_tier == to_fast || itr->second.in_use ||
+        itr->second.moving) {
+      return false;
+    }
+    size = itr->second.size;
+    if (Usage(to_fast) + size > (to_fast ? kFastCapacity_ : kSlowCapacity_))
+      return false;
+    itr->second.moving = true;
+    Usage(to_fast) += size;
+  }
+
+  // The original is only removed once the copy is in place, and foreground calls for the chunk
+  // wait until the move is finished.
+  bool moved(false);
+  try {
+    auto content(Tier(!to_fast).Get(name));
+    Tier(to_fast).Put(name, content);
+    moved = true;
+    Tier(!to_fast).Delete(name);
+  } catch (const std::exception& e) {
+    LOG(kWarning) << "Failed to move " << name.name << " to the " << (to_fast ? "fast" : "slow")
+                  << " tier: " << e.what();
+    if (moved) {
+      try {
+        Tier(to_fast).Delete(name);
+      } catch (const std::exception&) {}
+    }
+    moved = false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Placement& placement(placements_.at(name));
+    if (moved) {
+      Usage(!to_fast) -= size;
+      placement.on_fast_tier = to_fast;
+      placement.slow_reads = 0;
+    } else {
+      Usage(to_fast) -= size;
+    }
+    placement.moving = false;
+  }
+  condition_.notify_all();
+  return moved;
+}
+
+void TieredChunkEngine::StopMigration() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  if (migration_thread_.joinable())
+    migration_thread_.join();
+}
+
+void TieredChunkEngine::MigrationLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    condition_.wait_for(lock, kMigrationInterval_,
+                        [this] { return stop_ || migration_requested_; });
+    if (stop_)
+      return;
+    migration_requested_ = false;
+    lock.unlock();
+    try {
+      Migrate();
+    } catch (const std::exception& e) {
+      LOG(kError) << "Tier migration failed: " << e.what();
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,136 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_TIERED_CHUNK_ENGINE_H_
+#define MAIDSAFE_VAULT_TIERED_CHUNK_ENGINE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/vault/chunk_store_engine.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Spreads chunks over a small fast engine (e.g. on an SSD) and a large slow one (e.g. on an HDD),
+// each with its own capacity in bytes.  New chunks are written to the fast tier while it has
+// room, otherwise to the slow tier.  A background thread demotes the least recently used chunks
+// once the fast tier is more than kHighWatermark full, until it's at most kLowWatermark full, and
+// promotes chunks from the slow tier after kPromotionReads reads while the fast tier has room
+// below kLowWatermark.  Placement is saved under 'metadata_directory' by SaveState and taken from
+// there by Initialise; only if it's missing (or no directory was given) are both tiers scanned to
+// place every chunk.  A chunk being moved is copied before its original is removed, so after a
+// crash it may be found on both tiers; the larger (i.e. untorn) copy is then kept, preferring the
+// fast one.  A zero 'migration_interval' disables the background thread, leaving Migrate to the
+// caller.
+class TieredChunkEngine : public ChunkStoreEngine {
+ public:
+  static const double kHighWatermark, kLowWatermark;
+  static const std::uint32_t kPromotionReads = 2;
+  static const std::chrono::milliseconds kDefaultMigrationInterval;
+
+  TieredChunkEngine(std::unique_ptr<ChunkStoreEngine> fast_engine, std::uint64_t fast_capacity,
+                    std::unique_ptr<ChunkStoreEngine> slow_engine, std::uint64_t slow_capacity,
+                    std::chrono::milliseconds migration_interval = kDefaultMigrationInterval,
+                    const boost::filesystem::path& metadata_directory =
+                        boost::filesystem::path());
+  ~TieredChunkEngine() override;
+  TieredChunkEngine(const TieredChunkEngine&) = delete;
+  TieredChunkEngine(TieredChunkEngine&&) = delete;
+  TieredChunkEngine& operator=(const TieredChunkEngine&) = delete;
+  TieredChunkEngine& operator=(TieredChunkEngine&&) = delete;
+
+  void Initialise() override;
+  // Throws CommonErrors::cannot_exceed_limit if neither tier has room.
+  void Put(const NameType& name, const std::vector<byte>& content) override;
+  std::vector<byte> Get(const NameType& name) const override;
+  void Read(const NameType& name, const Reader& reader) const override;
+  std::uint64_t Delete(const NameType& name) override;
+  // Returns the placement found by Initialise, updated since, without rescanning.
+  std::vector<StoredChunk> Scan() const override;
+  // Stops migration and saves the placement of every chunk.
+  void SaveState() override;
+
+  // Runs one round of demotions and promotions.  Normally run by the background thread.
+  void Migrate();
+  std::uint64_t FastTierUsage() const;
+  std::uint64_t SlowTierUsage() const;
+  bool IsOnFastTier(const NameType& name) const;
+
+ private:
+  struct Placement {
+    bool on_fast_tier;
+    std::uint64_t size;
+    // Value of 'access_clock_' at the last Put or read.
+    std::uint64_t last_access;
+    std::uint32_t slow_reads;
+    // Foreground calls in progress.  A chunk isn't moved while any are.
+    std::uint32_t in_use;
+    // Set while the chunk is moved; foreground calls wait for it to clear.
+    bool moving;
+    bool promotion_queued;
+  };
+
+  // How many saved placements are read at a time.
+  static const std::size_t kLoadBatch = 4096;
+
+  ChunkStoreEngine& Tier(bool fast) const { return fast ? *fast_engine_ : *slow_engine_; }
+  std::uint64_t& Usage(bool fast) { return fast ? fast_usage_ : slow_usage_; }
+  // Waits for any move of 'name' to finish and marks it in use.  Returns null if it isn't held.
+  Placement* Pin(std::unique_lock<std::mutex>& lock, const NameType& name) const;
+  // Marks 'name' no longer in use by a read, noting the access.
+  void UnpinRead(const NameType& name) const;
+  // Moves 'name' to the other tier if it's still where expected, idle and fits.
+  bool Move(const NameType& name, bool to_fast);
+  void MigrationLoop();
+  void StopMigration();
+  // Places every chunk from the saved placement, returning false if there was none.
+  bool LoadPlacements();
+  // Places every chunk by scanning both tiers.
+  void ScanTiers();
+
+  const std::unique_ptr<ChunkStoreEngine> fast_engine_, slow_engine_;
+  const std::uint64_t kFastCapacity_, kSlowCapacity_;
+  const std::chrono::milliseconds kMigrationInterval_;
+  const boost::filesystem::path kMetadataDirectory_;
+  mutable std::mutex mutex_;
+  mutable std::condition_variable condition_;
+  mutable std::map<NameType, Placement> placements_;
+  mutable std::deque<NameType> promotions_;
+  mutable std::uint64_t access_clock_;
+  std::uint64_t fast_usage_, slow_usage_;
+  mutable bool migration_requested_;
+  bool stop_;
+  std::thread migration_thread_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_TIERED_CHUNK_ENGINE_H_
@@ -0,0 +1,148 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/tombstone_journal.h"
+
+#include <algorithm>
+
+#include "boost/crc.hpp"
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+#include "maidsafe/vault/chunk_store_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Record layout: kind(1) name(identity_size) type_id(4) crc(4)
+const std::size_t kRecordSize(1 + identity_size + 4 + 4);
+const std::size_t kCrcOffset(kRecordSize - 4);
+
+std::uint32_t RecordCrc(const byte* record) {
+  boost::crc_32_type crc;
+  crc.process_bytes(record, kCrcOffset);
+  return crc.checksum();
+}
+
+void WriteRecord(std::ofstream& stream, byte kind, const Data::NameAndTypeId& hashed_name) {
+  byte record[kRecordSize];
+  record[0] = kind;
+  const auto& raw_name(hashed_name.name.string());
+  std::copy(raw_name.begin(), raw_name.end(), record + 1);
+  detail::PutLittleEndian(hashed_name.type_id.data, record + 1 + identity_size);
+  detail::PutLittleEndian(RecordCrc(record), record + kCrcOffset);
+  stream.write(reinterpret_cast<const char*>(record), kRecordSize);
+}
+
+}  // unnamed namespace
+
+TombstoneJournal::TombstoneJournal(const fs::path& metadata_directory)
+    : kJournalPath_(metadata_directory / "tombstones"), stream_(), record_count_(0) {}
+
+std::set<TombstoneJournal::NameType> TombstoneJournal::Load() {
+  std::set<NameType> tombstones;
+  record_count_ = 0;
+  boost::system::error_code error_code;
+  if (!fs::exists(kJournalPath_, error_code))
+    return tombstones;
+  std::ifstream stream(kJournalPath_.string(), std::ios::binary);
+  byte record[kRecordSize];
+  while (stream.read(reinterpret_cast<char*>(record), kRecordSize)) {
+    if (record[0] > static_cast<byte>(RecordKind::kReinstate) ||
+        detail::GetLittleEndian<std::uint32_t>(record + kCrcOffset) != RecordCrc(record)) {
+      LOG(kWarning) << kJournalPath_ << " has a corrupt record; ignoring the rest of it";
+      break;
+    }
+    NameType hashed_name(Identity(std::vector<byte>(record + 1, record + 1 + identity_size)),
+                         DataTypeId(detail::GetLittleEndian<std::uint32_t>(
+                             record + 1 + identity_size)));
+    if (static_cast<RecordKind>(record[0]) == RecordKind::kTombstone)
+      tombstones.insert(hashed_name);
+    else
+      tombstones.erase(hashed_name);
+    ++record_count_;
+  }
+  return tombstones;
+}
+
+void TombstoneJournal::Tombstone(const NameType& hashed_name) {
+  Append(RecordKind::kTombstone, hashed_name);
+}
+
+void TombstoneJournal::Reinstate(const NameType& hashed_name) {
+  Append(RecordKind::kReinstate, hashed_name);
+}
+
+void TombstoneJournal::Rewrite(const std::set<NameType>& tombstones) {
+  if (stream_.is_open())
+    stream_.close();
+  boost::system::error_code error_code;
+  if (tombstones.empty()) {
+    fs::remove(kJournalPath_, error_code);
+    if (error_code) {
+      LOG(kError) << "Failed to remove " << kJournalPath_ << ": " << error_code.message();
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+    record_count_ = 0;
+    return;
+  }
+  fs::path temp_path(kJournalPath_.string() + ".tmp");
+  {
+    std::ofstream stream(temp_path.string(), std::ios::binary | std::ios::trunc);
+    for (const auto& hashed_name : tombstones)
+      WriteRecord(stream, static_cast<byte>(RecordKind::kTombstone), hashed_name);
+    if (!stream) {
+      LOG(kError) << "Failed to write " << temp_path;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+  }
+  fs::rename(temp_path, kJournalPath_, error_code);
+  if (error_code) {
+    LOG(kError) << "Failed to rename " << temp_path << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  record_count_ = tombstones.size();
+}
+
+void TombstoneJournal::Append(RecordKind kind, const NameType& hashed_name) {
+  if (!stream_.is_open()) {
+    boost::system::error_code error_code;
+    fs::create_directories(kJournalPath_.parent_path(), error_code);
+    stream_.open(kJournalPath_.string(), std::ios::binary | std::ios::app);
+  }
+  WriteRecord(stream_, static_cast<byte>(kind), hashed_name);
+  stream_.flush();
+  if (!stream_) {
+    LOG(kError) << "Failed to append to " << kJournalPath_;
+    stream_.close();
+    stream_.clear();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  ++record_count_;
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
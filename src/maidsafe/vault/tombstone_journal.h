@@ -0,0 +1,73 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_TOMBSTONE_JOURNAL_H_
+#define MAIDSAFE_VAULT_TOMBSTONE_JOURNAL_H_
+
+#include <cstdint>
+#include <fstream>
+#include <set>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/data.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Append-only record of the chunks a ChunkStore has deleted but not yet removed from its engine,
+// so that after a crash they aren't resurrected (with their usage) by the rescan of the engine.
+// Each record is checksummed; a torn final record is ignored.  Not thread-safe.
+class TombstoneJournal {
+ public:
+  using NameType = Data::NameAndTypeId;
+
+  explicit TombstoneJournal(const boost::filesystem::path& metadata_directory);
+  TombstoneJournal(const TombstoneJournal&) = delete;
+  TombstoneJournal(TombstoneJournal&&) = delete;
+  TombstoneJournal& operator=(const TombstoneJournal&) = delete;
+  TombstoneJournal& operator=(TombstoneJournal&&) = delete;
+
+  // Returns the names tombstoned and not since reinstated, according to the journal on disk.
+  std::set<NameType> Load();
+  // Each record is flushed to the OS before returning.
+  void Tombstone(const NameType& hashed_name);
+  void Reinstate(const NameType& hashed_name);
+  // Replaces the journal with one holding only 'tombstones'; if there are none, it's removed.
+  void Rewrite(const std::set<NameType>& tombstones);
+  // The number of records in the journal, which Rewrite reduces to the number of tombstones.
+  std::uint64_t RecordCount() const { return record_count_; }
+
+ private:
+  enum class RecordKind : byte { kTombstone = 0, kReinstate = 1 };
+
+  void Append(RecordKind kind, const NameType& hashed_name);
+
+  const boost::filesystem::path kJournalPath_;
+  std::ofstream stream_;
+  std::uint64_t record_count_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_TOMBSTONE_JOURNAL_H_
@@ -0,0 +1,365 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/uring_queue.h"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && \
+    defined(__NR_io_uring_register)
+#define MAIDSAFE_VAULT_IO_URING
+#endif
+#endif
+#endif
+
+#include "maidsafe/common/log.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+struct UringQueue::Operation {
+  enum class Kind { kNop, kOpenForRead, kOpenForWrite, kRead, kWrite, kClose };
+
+  Operation(Kind kind_in, Handler handler_in)
+      : kind(kind_in), fd(-1), address(nullptr), size(0), offset(0), path(),
+        handler(std::move(handler_in)) {}
+
+  Kind kind;
+  int fd;
+  const byte* address;
+  std::uint32_t size;
+  std::uint64_t offset;
+  std::string path;
+  Handler handler;
+};
+
+void UringQueue::OpenForRead(std::string path, Handler handler) {
+  std::unique_ptr<Operation> operation(new Operation(Operation::Kind::kOpenForRead,
+                                                     std::move(handler)));
+  operation->path = std::move(path);
+  Submit(std::move(operation));
+}
+
+void UringQueue::OpenForWrite(std::string path, Handler handler) {
+  std::unique_ptr<Operation> operation(new Operation(Operation::Kind::kOpenForWrite,
+                                                     std::move(handler)));
+  operation->path = std::move(path);
+  Submit(std::move(operation));
+}
+
+void UringQueue::Read(int fd, byte* buffer, std::uint32_t size, std::uint64_t offset,
+                      Handler handler) {
+  std::unique_ptr<Operation> operation(new Operation(Operation::Kind::kRead, std::move(handler)));
+  operation->fd = fd;
+  operation->address = buffer;
+  operation->size = size;
+  operation->offset = offset;
+  Submit(std::move(operation));
+}
+
+void UringQueue::Write(int fd, const byte* data, std::uint32_t size, std::uint64_t offset,
+                       Handler handler) {
+  std::unique_ptr<Operation> operation(new Operation(Operation::Kind::kWrite, std::move(handler)));
+  operation->fd = fd;
+  operation->address = data;
+  operation->size = size;
+  operation->offset = offset;
+  Submit(std::move(operation));
+}
+
+void UringQueue::Close(int fd, Handler handler) {
+  std::unique_ptr<Operation> operation(new Operation(Operation::Kind::kClose, std::move(handler)));
+  operation->fd = fd;
+  Submit(std::move(operation));
+}
+
+#ifdef MAIDSAFE_VAULT_IO_URING
+
+struct UringQueue::Rings {
+  Rings() : fd(-1), sq_ring(MAP_FAILED), cq_ring(MAP_FAILED), sq_ring_size(0), cq_ring_size(0),
+            sqes(MAP_FAILED), sqes_size(0), params() {}
+  ~Rings() {
+    if (sqes != MAP_FAILED)
+      munmap(sqes, sqes_size);
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+      munmap(cq_ring, cq_ring_size);
+    if (sq_ring != MAP_FAILED)
+      munmap(sq_ring, sq_ring_size);
+    if (fd >= 0)
+      close(fd);
+  }
+
+  unsigned* SqField(std::uint32_t offset) const {
+    return reinterpret_cast<unsigned*>(static_cast<char*>(sq_ring) + offset);
+  }
+  unsigned* CqField(std::uint32_t offset) const {
+    return reinterpret_cast<unsigned*>(static_cast<char*>(cq_ring) + offset);
+  }
+  io_uring_sqe* Sqes() const { return static_cast<io_uring_sqe*>(sqes); }
+  io_uring_cqe* Cqes() const {
+    return reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cq_ring) + params.cq_off.cqes);
+  }
+
+  int fd;
+  void* sq_ring;
+  void* cq_ring;
+  std::size_t sq_ring_size, cq_ring_size;
+  void* sqes;
+  std::size_t sqes_size;
+  io_uring_params params;
+};
+
+namespace {
+
+int Enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+bool SupportsRequiredOperations(int fd) {
+  const unsigned kProbeOps(256);
+  std::vector<char> buffer(sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op), 0);
+  auto probe(reinterpret_cast<io_uring_probe*>(buffer.data()));
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, kProbeOps) < 0)
+    return false;
+  for (unsigned op : {IORING_OP_NOP, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE,
+                      IORING_OP_CLOSE}) {
+    if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+      return false;
+  }
+  return true;
+}
+
+}  // unnamed namespace
+
+std::unique_ptr<UringQueue> UringQueue::Create(unsigned queue_depth) {
+  std::unique_ptr<Rings> rings(new Rings);
+  rings->fd = static_cast<int>(syscall(__NR_io_uring_setup, queue_depth, &rings->params));
+  if (rings->fd < 0) {
+    LOG(kInfo) << "io_uring is unavailable: " << std::strerror(errno);
+    return nullptr;
+  }
+  if (!SupportsRequiredOperations(rings->fd)) {
+    LOG(kInfo) << "io_uring doesn't support the required operations";
+    return nullptr;
+  }
+
+  const auto& params(rings->params);
+  rings->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  rings->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+  if (single_mmap)
+    rings->sq_ring_size = rings->cq_ring_size = std::max(rings->sq_ring_size, rings->cq_ring_size);
+  rings->sq_ring = mmap(nullptr, rings->sq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, rings->fd, IORING_OFF_SQ_RING);
+  if (rings->sq_ring == MAP_FAILED)
+    return nullptr;
+  rings->cq_ring = single_mmap ? rings->sq_ring
+                               : mmap(nullptr, rings->cq_ring_size, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE, rings->fd, IORING_OFF_CQ_RING);
+  if (rings->cq_ring == MAP_FAILED)
+    return nullptr;
+  rings->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  rings->sqes = mmap(nullptr, rings->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     rings->fd, IORING_OFF_SQES);
+  if (rings->sqes == MAP_FAILED)
+    return nullptr;
+
+  unsigned depth(params.sq_entries);
+  return std::unique_ptr<UringQueue>(new UringQueue(std::move(rings), depth));
+}
+
+UringQueue::UringQueue(std::unique_ptr<Rings> rings, unsigned queue_depth)
+    : rings_(std::move(rings)),
+      kQueueDepth_(queue_depth),
+      mutex_(),
+      space_available_(),
+      in_flight_(0),
+      stopping_(false),
+      completion_thread_() {
+  completion_thread_ = std::thread([this] { CompletionLoop(); });
+}
+
+UringQueue::~UringQueue() {
+  {
+    // The no-op wakes the completion thread in case nothing else is in flight.  It's submitted
+    // under the same lock as 'stopping_' is set, so the thread can't exit before it completes.
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+    Submit(std::unique_ptr<Operation>(new Operation(Operation::Kind::kNop, Handler())), lock);
+  }
+  completion_thread_.join();
+}
+
+void UringQueue::Submit(std::unique_ptr<Operation> operation) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  Submit(std::move(operation), lock);
+}
+
+void UringQueue::Submit(std::unique_ptr<Operation> operation, std::unique_lock<std::mutex>& lock) {
+  // Follow-on operations submitted by handlers mustn't wait, since only the completion thread can
+  // make space.  The completion queue is twice the depth, so it can absorb them.
+  if (std::this_thread::get_id() != completion_thread_.get_id())
+    space_available_.wait(lock, [this] { return in_flight_ < kQueueDepth_; });
+
+  unsigned* tail(rings_->SqField(rings_->params.sq_off.tail));
+  unsigned mask(*rings_->SqField(rings_->params.sq_off.ring_mask));
+  unsigned index(*tail & mask);
+  io_uring_sqe& sqe(rings_->Sqes()[index]);
+  std::memset(&sqe, 0, sizeof(sqe));
+  switch (operation->kind) {
+    case Operation::Kind::kNop:
+      sqe.opcode = IORING_OP_NOP;
+      break;
+    case Operation::Kind::kOpenForRead:
+    case Operation::Kind::kOpenForWrite:
+      sqe.opcode = IORING_OP_OPENAT;
+      sqe.fd = AT_FDCWD;
+      sqe.addr = reinterpret_cast<std::uint64_t>(operation->path.c_str());
+      sqe.open_flags = operation->kind == Operation::Kind::kOpenForRead
+                           ? O_RDONLY | O_CLOEXEC
+                           : O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+      sqe.len = 0644;
+      break;
+    case Operation::Kind::kRead:
+    case Operation::Kind::kWrite:
+      sqe.opcode = operation->kind == Operation::Kind::kRead ? IORING_OP_READ : IORING_OP_WRITE;
+      sqe.fd = operation->fd;
+      sqe.addr = reinterpret_cast<std::uint64_t>(operation->address);
+      sqe.len = operation->size;
+      sqe.off = operation->offset;
+      break;
+    case Operation::Kind::kClose:
+      sqe.opcode = IORING_OP_CLOSE;
+      sqe.fd = operation->fd;
+      break;
+  }
+  sqe.user_data = reinterpret_cast<std::uint64_t>(operation.get());
+  rings_->SqField(rings_->params.sq_off.array)[index] = index;
+  __atomic_store_n(tail, *tail + 1, __ATOMIC_RELEASE);
+
+  int result(0);
+  do {
+    result = Enter(rings_->fd, 1, 0, 0);
+  } while (result < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+  if (result < 0) {
+    // The entry wasn't consumed, so withdraw it and fail the operation here.
+    int error(errno);
+    __atomic_store_n(tail, *tail - 1, __ATOMIC_RELEASE);
+    lock.unlock();
+    LOG(kError) << "io_uring submission failed: " << std::strerror(error);
+    if (operation->handler)
+      operation->handler(-error);
+    return;
+  }
+  ++in_flight_;
+  operation.release();
+}
+
+void UringQueue::CompletionLoop() {
+  unsigned* head(rings_->CqField(rings_->params.cq_off.head));
+  unsigned* tail(rings_->CqField(rings_->params.cq_off.tail));
+  unsigned mask(*rings_->CqField(rings_->params.cq_off.ring_mask));
+  std::vector<std::pair<Operation*, int>> completed;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_ && in_flight_ == 0)
+        return;
+    }
+    if (Enter(rings_->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+      LOG(kError) << "io_uring wait failed: " << std::strerror(errno);
+      std::this_thread::yield();
+    }
+
+    completed.clear();
+    unsigned current(*head);
+    unsigned last(__atomic_load_n(tail, __ATOMIC_ACQUIRE));
+    for (; current != last; ++current) {
+      const io_uring_cqe& cqe(rings_->Cqes()[current & mask]);
+      completed.emplace_back(reinterpret_cast<Operation*>(cqe.user_data), cqe.res);
+    }
+    __atomic_store_n(head, current, __ATOMIC_RELEASE);
+    if (completed.empty())
+      continue;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      in_flight_ -= static_cast<unsigned>(completed.size());
+    }
+    space_available_.notify_all();
+
+    for (const auto& completion : completed) {
+      std::unique_ptr<Operation> operation(completion.first);
+      if (!operation->handler)
+        continue;
+      try {
+        operation->handler(completion.second);
+      } catch (const std::exception& e) {
+        LOG(kError) << "io_uring completion handler threw: " << e.what();
+      }
+    }
+  }
+}
+
+#else
+
+struct UringQueue::Rings {};
+
+std::unique_ptr<UringQueue> UringQueue::Create(unsigned /*queue_depth*/) { return nullptr; }
+
+UringQueue::UringQueue(std::unique_ptr<Rings> rings, unsigned queue_depth)
+    : rings_(std::move(rings)),
+      kQueueDepth_(queue_depth),
+      mutex_(),
+      space_available_(),
+      in_flight_(0),
+      stopping_(false),
+      completion_thread_() {}
+
+UringQueue::~UringQueue() {}
+
+void UringQueue::Submit(std::unique_ptr<Operation> operation) {
+  if (operation->handler)
+    operation->handler(-ENOSYS);
+}
+
+void UringQueue::Submit(std::unique_ptr<Operation> operation,
+                        std::unique_lock<std::mutex>& lock) {
+  lock.unlock();
+  Submit(std::move(operation));
+  lock.lock();
+}
+
+void UringQueue::CompletionLoop() {}
+
+#endif
+
+}  // namespace vault
+
+}  // namespace maidsafe
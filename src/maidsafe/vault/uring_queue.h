@@ -0,0 +1,88 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_URING_QUEUE_H_
+#define MAIDSAFE_VAULT_URING_QUEUE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "maidsafe/common/types.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Thin wrapper around a Linux io_uring instance, used directly through its system calls.  Up to
+// the queue depth operations are kept in flight; further submissions block until one completes.
+// Handlers are run one at a time on a dedicated completion thread and may submit follow-on
+// operations (which never block).  The destructor waits for every operation in flight, including
+// follow-ons, to complete.
+class UringQueue {
+ public:
+  // Receives the result of an operation: non-negative on success, otherwise a negated errno value.
+  using Handler = std::function<void(int result)>;
+
+  // Returns null if io_uring, or any operation used here, isn't supported by the platform or the
+  // running kernel.
+  static std::unique_ptr<UringQueue> Create(unsigned queue_depth = 128);
+
+  ~UringQueue();
+  UringQueue(const UringQueue&) = delete;
+  UringQueue(UringQueue&&) = delete;
+  UringQueue& operator=(const UringQueue&) = delete;
+  UringQueue& operator=(UringQueue&&) = delete;
+
+  // Open results are file descriptors.  OpenForWrite creates or truncates the file.
+  void OpenForRead(std::string path, Handler handler);
+  void OpenForWrite(std::string path, Handler handler);
+  // 'buffer' and 'data' must remain valid until the handler runs.  Results are byte counts, which
+  // may be short.
+  void Read(int fd, byte* buffer, std::uint32_t size, std::uint64_t offset, Handler handler);
+  void Write(int fd, const byte* data, std::uint32_t size, std::uint64_t offset, Handler handler);
+  void Close(int fd, Handler handler);
+
+ private:
+  struct Rings;
+  struct Operation;
+
+  UringQueue(std::unique_ptr<Rings> rings, unsigned queue_depth);
+  void Submit(std::unique_ptr<Operation> operation);
+  // 'lock' must hold 'mutex_'.  It is released if the submission fails.
+  void Submit(std::unique_ptr<Operation> operation, std::unique_lock<std::mutex>& lock);
+  void CompletionLoop();
+
+  std::unique_ptr<Rings> rings_;
+  const unsigned kQueueDepth_;
+  std::mutex mutex_;
+  std::condition_variable space_available_;
+  unsigned in_flight_;
+  bool stopping_;
+  std::thread completion_thread_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_URING_QUEUE_H_
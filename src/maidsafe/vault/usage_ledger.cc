@@ -0,0 +1,114 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/usage_ledger.h"
+
+#include <fstream>
+
+#include "boost/crc.hpp"
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/types.h"
+
+#include "maidsafe/vault/chunk_store_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Layout: magic(4) version(4) disk_usage(8) chunk_count(8) clean(1) crc(4)
+const std::uint32_t kLedgerMagic(0x4c55534d);  // "MSUL"
+const std::uint32_t kLedgerVersion(1);
+const std::size_t kLedgerSize(29);
+const std::size_t kCrcOffset(kLedgerSize - 4);
+
+std::uint32_t LedgerCrc(const byte* ledger) {
+  boost::crc_32_type crc;
+  crc.process_bytes(ledger, kCrcOffset);
+  return crc.checksum();
+}
+
+}  // unnamed namespace
+
+UsageLedger::UsageLedger(const fs::path& metadata_directory)
+    : kLedgerPath_(metadata_directory / "usage_ledger") {}
+
+boost::optional<UsageLedger::Checkpoint> UsageLedger::Take() const {
+  boost::system::error_code error_code;
+  if (!fs::exists(kLedgerPath_, error_code))
+    return boost::none;
+
+  boost::optional<Checkpoint> checkpoint;
+  {
+    byte ledger[kLedgerSize];
+    std::ifstream stream(kLedgerPath_.string(), std::ios::binary);
+    if (stream.read(reinterpret_cast<char*>(ledger), kLedgerSize) &&
+        detail::GetLittleEndian<std::uint32_t>(ledger) == kLedgerMagic &&
+        detail::GetLittleEndian<std::uint32_t>(ledger + 4) == kLedgerVersion &&
+        detail::GetLittleEndian<std::uint32_t>(ledger + kCrcOffset) == LedgerCrc(ledger)) {
+      checkpoint = Checkpoint{detail::GetLittleEndian<std::uint64_t>(ledger + 8),
+                              detail::GetLittleEndian<std::uint64_t>(ledger + 16),
+                              ledger[24] != 0};
+    } else {
+      LOG(kWarning) << kLedgerPath_ << " is corrupt and will be ignored";
+    }
+  }
+  fs::remove(kLedgerPath_, error_code);
+  if (error_code) {
+    LOG(kError) << "Failed to remove " << kLedgerPath_ << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  return checkpoint;
+}
+
+void UsageLedger::Write(const Checkpoint& checkpoint) const {
+  byte ledger[kLedgerSize];
+  detail::PutLittleEndian(kLedgerMagic, ledger);
+  detail::PutLittleEndian(kLedgerVersion, ledger + 4);
+  detail::PutLittleEndian(checkpoint.disk_usage, ledger + 8);
+  detail::PutLittleEndian(checkpoint.chunk_count, ledger + 16);
+  ledger[24] = checkpoint.clean ? 1 : 0;
+  detail::PutLittleEndian(LedgerCrc(ledger), ledger + kCrcOffset);
+
+  boost::system::error_code error_code;
+  fs::create_directories(kLedgerPath_.parent_path(), error_code);
+  fs::path temp_path(kLedgerPath_.string() + ".tmp");
+  {
+    std::ofstream stream(temp_path.string(), std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char*>(ledger), kLedgerSize);
+    if (!stream) {
+      LOG(kError) << "Failed to write " << temp_path;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+  }
+  fs::rename(temp_path, kLedgerPath_, error_code);
+  if (error_code) {
+    LOG(kError) << "Failed to rename " << temp_path << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,58 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_USAGE_LEDGER_H_
+#define MAIDSAFE_VAULT_USAGE_LEDGER_H_
+
+#include <cstdint>
+
+#include "boost/filesystem/path.hpp"
+#include "boost/optional/optional.hpp"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Small checksummed record of a ChunkStore's disk usage, so that a cleanly shut down store can
+// restore its usage on startup without scanning the disk.  ChunkStore only writes one on clean
+// shutdown; checkpoints marked unclean, which earlier versions wrote while the store was running,
+// can't be trusted after a crash so are ignored.
+class UsageLedger {
+ public:
+  struct Checkpoint {
+    std::uint64_t disk_usage;
+    std::uint64_t chunk_count;
+    bool clean;
+  };
+
+  explicit UsageLedger(const boost::filesystem::path& metadata_directory);
+
+  // Returns the last checkpoint, if any, and removes it from disk so that it can't outlive the
+  // session which is about to modify the store.
+  boost::optional<Checkpoint> Take() const;
+  void Write(const Checkpoint& checkpoint) const;
+
+ private:
+  const boost::filesystem::path kLedgerPath_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_USAGE_LEDGER_H_
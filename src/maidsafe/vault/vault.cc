@@ -18,23 +18,112 @@
 
 #include "maidsafe/vault/vault.h"
 
+#include <chrono>
+#include <string>
+#include <utility>
+
+#include "boost/filesystem/operations.hpp"
+
 #define COMPANY_NAME DummyValue
 #define APPLICATION_NAME DummyValue
 #include "maidsafe/common/application_support_directories.h"
 #undef COMPANY_NAME
 #undef APPLICATION_NAME
 
+#include "maidsafe/common/log.h"
+
 #include "maidsafe/vault/utils.h"
 
+namespace fs = boost::filesystem;
+
 namespace maidsafe {
 
 namespace vault {
 
+namespace {
+
+// What PmidNode, VersionHandler and MpidManager were allowed between them before they shared a
+// budget.
+const std::uint64_t kProvisionedDiskUsage(30000000000);
+
+// How long a chunk write may wait to share a flush with others, if chunks are committed durably.
+const std::chrono::microseconds kChunkCommitWindow(2000);
+
+// Before they shared a store, PmidNode and MpidManager each kept their chunks under
+// <persona>/permanent.
+fs::path PersonaStorePath(const std::string& persona) {
+  return VaultDir() / persona / "permanent";
+}
+
+// Moves what's left in a persona's own store into the shared one, and removes the persona's store
+// once it's empty.  Anything which can't be moved stays where it is and is retried on the next
+// start, rather than stopping the vault.
+void ImportPersonaStore(const std::string& persona, SharedChunkStore& shared) {
+  auto path(PersonaStorePath(persona));
+  boost::system::error_code error;
+  if (!fs::exists(path, error))
+    return;
+  try {
+    bool empty(false);
+    {
+      ChunkStore source(path, DiskUsage(kProvisionedDiskUsage));
+      shared.Import(source);
+      empty = source.Count() == 0;
+    }
+    if (empty)
+      fs::remove_all(path);
+  } catch (const std::exception& e) {
+    LOG(kError) << "Failed to import chunks of " << persona << " into the shared store: "
+                << boost::diagnostic_information(e);
+  }
+}
+
+}  // unnamed namespace
+
 boost::filesystem::path VaultDir() {
   static const boost::filesystem::path path(GetHomeDir() / "MaidSafe-Vault");
   return path;
 }
 
+// A full pass over a well-filled vault takes days at this rate, leaving the disk to clients.
+const std::uint64_t VaultFacade::kScrubBytesPerSecond(4 * 1024 * 1024);
+
+VaultFacade::Stores VaultFacade::MakeStores() {
+  // Chunks are guaranteed most of the disk and version records a little of it; whatever remains
+  // goes to whichever needs it.  The accounts keep the budget's pool alive.
+  DiskBudget disk_budget((DiskUsage(kProvisionedDiskUsage)));
+  auto chunks(disk_budget.AddAccount(
+      "chunks", DiskBudget::Limits{DiskUsage(kProvisionedDiskUsage * 3 / 5),
+                                   DiskUsage(kProvisionedDiskUsage)}));
+  auto versions(disk_budget.AddAccount(
+      "versions", DiskBudget::Limits{DiskUsage(kProvisionedDiskUsage / 10),
+                                     DiskUsage(kProvisionedDiskUsage / 3)}));
+  // On upgrading, PmidNode's store, which holds most of the chunks, becomes the shared store as
+  // is.  Any other chunks are then moved into it.
+  auto shared_path(VaultDir() / "shared" / "permanent");
+  boost::system::error_code error;
+  if (!fs::exists(shared_path, error) && fs::exists(PersonaStorePath("pmid_node"), error)) {
+    fs::create_directories(shared_path.parent_path(), error);
+    fs::rename(PersonaStorePath("pmid_node"), shared_path, error);
+    if (error) {
+      LOG(kWarning) << "Failed to move PmidNode's store to " << shared_path << ": "
+                    << error.message() << ".  Its chunks will be copied instead.";
+    }
+  }
+  Stores stores;
+  stores.chunks = std::make_shared<SharedChunkStore>(
+      shared_path, DiskUsage(kProvisionedDiskUsage),
+      ChunkStore::Engine::kFilePerChunk,
+      ChunkStore::Durability(ChunkStore::Durability::kBuffered, kChunkCommitWindow),
+      ChunkStore::Compression::kNone,
+      ChunkStore::CacheBypass{ChunkStore::CacheBypass::Mode::kNone, 0},
+      ChunkStore::FastTier{boost::filesystem::path(), DiskUsage(0)}, std::move(chunks));
+  for (const auto& persona : {"pmid_node", "mpid_manager"})
+    ImportPersonaStore(persona, *stores.chunks);
+  stores.versions = std::move(versions);
+  return stores;
+}
+
 routing::HandleGetReturn VaultFacade::HandleGet(routing::SourceAddress from,
                                                 routing::Authority /* from_authority */,
                                                 routing::Authority authority,
@@ -62,6 +151,16 @@ routing::HandleGetReturn VaultFacade::HandleGet(routing::SourceAddress from,
   return boost::make_unexpected(MakeError(VaultErrors::failed_to_handle_request));
 }
 
+routing::HandleGetReturn VaultFacade::HandleGetRange(routing::SourceAddress from,
+                                                     routing::Authority /* from_authority */,
+                                                     routing::Authority authority,
+                                                     Data::NameAndTypeId name_and_type_id,
+                                                     std::uint64_t offset, std::uint64_t length) {
+  if (authority == routing::Authority::managed_node)
+    return PmidNode::HandleGetRange(from, name_and_type_id, offset, length);
+  return boost::make_unexpected(MakeError(VaultErrors::failed_to_handle_request));
+}
+
 routing::HandlePutPostReturn VaultFacade::HandlePut(routing::SourceAddress from,
                                                     routing::DestinationAddress dest,
                                                     routing::Authority from_authority,
@@ -136,6 +235,29 @@ routing::HandlePutPostReturn VaultFacade::HandlePutResponse(routing::SourceAddre
   return boost::make_unexpected(MakeError(VaultErrors::failed_to_handle_request));
 }
 
+void VaultFacade::HandleCorruptChunk(const Data::NameAndTypeId& name_and_type_id) {
+  // The chunk has been purged, which DataManager treats as this node failing to store it: if too
+  // few holders remain, it chooses new ones.  Until routing is real, it's our own DataManager
+  // which is told, and nothing yet sends a good copy on to the holders it chooses.
+  routing::DestinationAddress holder(routing::Destination(OurId()), boost::none);
+  auto return_code(MakeError(CommonErrors::hashing_error));
+  routing::HandlePutPostReturn result(
+      boost::make_unexpected(MakeError(VaultErrors::failed_to_handle_request)));
+  if (name_and_type_id.type_id == detail::TypeId<ImmutableData>::value)
+    result = DataManager::template HandlePutResponse<ImmutableData>(name_and_type_id.name, holder,
+                                                                    return_code);
+  else if (name_and_type_id.type_id == detail::TypeId<MutableData>::value)
+    result = DataManager::template HandlePutResponse<MutableData>(name_and_type_id.name, holder,
+                                                                  return_code);
+  if (result.valid()) {
+    LOG(kInfo) << "Re-replicating corrupt chunk " << name_and_type_id.name << " to "
+               << result->size() << " new holders";
+  } else if (result.error().code() != make_error_code(CommonErrors::success)) {
+    LOG(kWarning) << "Failed to re-replicate corrupt chunk " << name_and_type_id.name << ": "
+                  << result.error().what();
+  }
+}
+
 bool VaultFacade::HandlePost(const routing::SerialisedMessage& message) {
   return VersionHandler::HandlePost(message);
 }
@@ -19,6 +19,8 @@
 #ifndef MAIDSAFE_VAULT_VAULT_H_
 #define MAIDSAFE_VAULT_VAULT_H_
 
+#include <cstdint>
+#include <memory>
 #include <string>
 
 #include "boost/expected/expected.hpp"
@@ -29,6 +31,8 @@
 #include "maidsafe/common/data_types/structured_data_versions.h"
 #include "maidsafe/passport/types.h"
 
+#include "maidsafe/vault/disk_budget.h"
+#include "maidsafe/vault/shared_chunk_store.h"
 #include "maidsafe/vault/data_manager/data_manager.h"
 #include "maidsafe/vault/maid_manager/maid_manager.h"
 #include "maidsafe/vault/pmid_manager/pmid_manager.h"
@@ -52,22 +56,23 @@ class VaultFacade : public MaidManager<VaultFacade>,
                     public MpidManager<VaultFacade>,
                     public routing::test::FakeRouting<VaultFacade> {
  public:
-  VaultFacade()
-      : MaidManager<VaultFacade>(),
-        DataManager<VaultFacade>(VaultDir()),
-        PmidManager<VaultFacade>(),
-        PmidNode<VaultFacade>(VaultDir(), DiskUsage(10000000000)),
-        VersionHandler<VaultFacade>(VaultDir(), DiskUsage(10000000000)),
-        MpidManager<VaultFacade>(VaultDir(), DiskUsage(10000000000)),
-        routing::test::FakeRouting<VaultFacade>() {}
+  VaultFacade() : VaultFacade(MakeStores()) {}
 
-  ~VaultFacade() = default;
+  // Stops the scrubber before the personas its corruption handler calls into are destroyed.
+  ~VaultFacade() { PmidNode<VaultFacade>::StopScrubbing(); }
 
   enum class FunctorType { FunctionOne, FunctionTwo };
 
   routing::HandleGetReturn HandleGet(routing::SourceAddress from, routing::Authority from_authority,
                                      routing::Authority authority,
                                      Data::NameAndTypeId name_and_type_id);
+  // Ranged form of HandleGet, letting clients which only need part of a chunk avoid fetching
+  // all of it.  Only chunks held as a managed node are served this way.
+  routing::HandleGetReturn HandleGetRange(routing::SourceAddress from,
+                                          routing::Authority from_authority,
+                                          routing::Authority authority,
+                                          Data::NameAndTypeId name_and_type_id,
+                                          std::uint64_t offset, std::uint64_t length);
 
   routing::HandlePutPostReturn HandlePut(routing::SourceAddress from,
       routing::DestinationAddress dest, routing::Authority from_authority,
@@ -93,6 +98,35 @@ class VaultFacade : public MaidManager<VaultFacade>,
   // if the implementation allows any put of data in unauthenticated mode
   bool HandleUnauthenticatedPut(routing::Address, routing::SerialisedMessage);
   void HandleChurn(routing::CloseGroupDifference diff);
+
+ private:
+  // PmidNode and MpidManager share one deduplicating chunk store.  It and VersionHandler draw on
+  // a single DiskBudget covering the disk provisioned for the vault.
+  struct Stores {
+    std::shared_ptr<SharedChunkStore> chunks;
+    std::shared_ptr<DiskBudget::Account> versions;
+  };
+  static Stores MakeStores();
+
+  explicit VaultFacade(const Stores& stores)
+      : MaidManager<VaultFacade>(),
+        DataManager<VaultFacade>(VaultDir()),
+        PmidManager<VaultFacade>(),
+        PmidNode<VaultFacade>(stores.chunks),
+        VersionHandler<VaultFacade>(VaultDir(), stores.versions),
+        MpidManager<VaultFacade>(stores.chunks),
+        routing::test::FakeRouting<VaultFacade>() {
+    PmidNode<VaultFacade>::StartScrubbing(
+        kScrubBytesPerSecond,
+        [this](const Data::NameAndTypeId& name_and_type_id) {
+          HandleCorruptChunk(name_and_type_id);
+        });
+  }
+
+  // Handles the loss of a chunk which PmidNode's scrubber found corrupt.
+  void HandleCorruptChunk(const Data::NameAndTypeId& name_and_type_id);
+
+  static const std::uint64_t kScrubBytesPerSecond;
 };
 
 }  // namespace vault
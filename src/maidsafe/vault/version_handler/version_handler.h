@@ -19,7 +19,11 @@
 #ifndef MAIDSAFE_VAULT_VERSION_HANDLER_VERSION_HANDLER_H_
 #define MAIDSAFE_VAULT_VERSION_HANDLER_VERSION_HANDLER_H_
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include "maidsafe/common/convert.h"
 #include "maidsafe/common/types.h"
@@ -27,6 +31,7 @@
 #include "maidsafe/routing/types.h"
 #include "maidsafe/routing/source_address.h"
 
+#include "maidsafe/vault/disk_budget.h"
 #include "maidsafe/vault/utils.h"
 #include "maidsafe/vault/version_handler/database.h"
 
@@ -39,6 +44,11 @@ class VersionHandler {
  public:
   VersionHandler(const boost::filesystem::path& vault_root_dir,
                  DiskUsage max_disk_usage);
+  // Reserves the space taken by each record (its key and serialised versions) from 'disk_budget',
+  // refusing Puts and Posts which it can't accommodate.
+  VersionHandler(const boost::filesystem::path& vault_root_dir,
+                 std::shared_ptr<DiskBudget::Account> disk_budget);
+  ~VersionHandler();
 
   routing::HandleGetReturn HandleGet(const routing::SourceAddress& from, const Identity& sdv_name);
 
@@ -49,13 +59,30 @@ class VersionHandler {
   void HandleChurn(routing::CloseGroupDifference);
 
  private:
+  bool Reserve(std::uint64_t bytes);
+  void Release(std::uint64_t bytes);
+
   VersionHandlerDatabase db_;
+  const std::shared_ptr<DiskBudget::Account> disk_budget_;
+  // What's been reserved from 'disk_budget_', which is returned on destruction since the database
+  // isn't reopened.
+  std::atomic<std::uint64_t> reserved_;
 };
 
 template <typename FacadeType>
 VersionHandler<FacadeType>::VersionHandler(const boost::filesystem::path& vault_root_dir,
                                            DiskUsage /*max_disk_usage*/)
-  : db_(UniqueDbPath(vault_root_dir)) {}
+  : db_(UniqueDbPath(vault_root_dir)), disk_budget_(), reserved_(0) {}
+
+template <typename FacadeType>
+VersionHandler<FacadeType>::VersionHandler(const boost::filesystem::path& vault_root_dir,
+                                           std::shared_ptr<DiskBudget::Account> disk_budget)
+  : db_(UniqueDbPath(vault_root_dir)), disk_budget_(std::move(disk_budget)), reserved_(0) {}
+
+template <typename FacadeType>
+VersionHandler<FacadeType>::~VersionHandler() {
+  Release(reserved_);
+}
 
 template <typename FacadeType>
 routing::HandleGetReturn VersionHandler<FacadeType>::HandleGet(
@@ -90,7 +117,16 @@ bool VersionHandler<FacadeType>::HandlePut(const routing::SerialisedMessage& mes
   }
   StructuredDataVersions sdv(max_versions, max_branches);
   sdv.Put(StructuredDataVersions::VersionName(), version);
-  db_.Put(key, convert::ToString(sdv.Serialise().data.string()));
+  std::string serialised_sdv(convert::ToString(sdv.Serialise().data.string()));
+  std::uint64_t record_size(key.size() + serialised_sdv.size());
+  if (!Reserve(record_size))
+    return false;
+  try {
+    db_.Put(key, serialised_sdv);
+  } catch (...) {
+    Release(record_size);
+    throw;
+  }
   return true;
 }
 
@@ -108,13 +144,43 @@ bool VersionHandler<FacadeType>::HandlePost(const routing::SerialisedMessage& me
     StructuredDataVersions sdv(20, 1);
     sdv.ApplySerialised(StructuredDataVersions::serialised_type(sdv_wrapper.Value()));
     sdv.Put(old_version, new_version);
-    db_.Put(key, convert::ToString(sdv.Serialise().data.string()));
+    std::string updated_sdv(convert::ToString(sdv.Serialise().data.string()));
+    std::uint64_t old_size(serialised_sdv.size()), new_size(updated_sdv.size());
+    if (new_size > old_size && !Reserve(new_size - old_size))
+      return false;
+    try {
+      db_.Put(key, updated_sdv);
+    } catch (...) {
+      if (new_size > old_size)
+        Release(new_size - old_size);
+      throw;
+    }
+    if (old_size > new_size)
+      Release(old_size - new_size);
   } catch (...) {
     return false;
   }
   return true;
 }
 
+template <typename FacadeType>
+bool VersionHandler<FacadeType>::Reserve(std::uint64_t bytes) {
+  if (!disk_budget_)
+    return true;
+  if (!disk_budget_->Reserve(bytes))
+    return false;
+  reserved_ += bytes;
+  return true;
+}
+
+template <typename FacadeType>
+void VersionHandler<FacadeType>::Release(std::uint64_t bytes) {
+  if (!disk_budget_)
+    return;
+  disk_budget_->Release(bytes);
+  reserved_ -= bytes;
+}
+
 }  // namespace vault
 
 }  // namespace maidsafe